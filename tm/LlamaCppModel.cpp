@@ -1,6 +1,7 @@
 #include "LlamaCppModel.h"
 #include <jsi/jsi.h>
 #include <algorithm>
+#include <atomic>
 #include <cmath>
 #include <cstdlib>
 #include <ctime>
@@ -15,10 +16,15 @@
 #include <mutex>
 #include <condition_variable>
 #include <memory>
+#include <thread>
 
 // Include rn-completion integration
 #include "rn-utils.hpp"
 #include "rn-llama.hpp"
+#include "rn-session.hpp"
+#include "rn-embedding.hpp"
+#include "rn-quantize.hpp"
+#include "LlamaVectorIndex.h"
 
 // Include llama.cpp headers
 #include "llama.h"
@@ -35,9 +41,56 @@
 
 namespace facebook::react {
 
-LlamaCppModel::LlamaCppModel(rn_llama_context* rn_ctx)
-    : rn_ctx_(rn_ctx), should_stop_completion_(false), is_predicting_(false) {
+// Native vector storage handed to JS as an ArrayBuffer without copying
+template <typename T>
+class VectorBuffer : public jsi::MutableBuffer {
+public:
+  explicit VectorBuffer(std::vector<T> values) : values_(std::move(values)) {}
+  size_t size() const override { return values_.size() * sizeof(T); }
+  uint8_t* data() override { return reinterpret_cast<uint8_t*>(values_.data()); }
+
+private:
+  std::vector<T> values_;
+};
+
+// Typed array view (e.g. "Float32Array") of length elements starting at byte offset of buffer
+static jsi::Object createTypedArray(jsi::Runtime& rt, const char* type, const jsi::ArrayBuffer& buffer,
+                                    size_t offset, size_t length) {
+  jsi::Function ctor = rt.global().getPropertyAsFunction(rt, type);
+  return ctor.callAsConstructor(rt, buffer, (double)offset, (double)length).getObject(rt);
+}
+
+LlamaCppModel::LlamaCppModel(rn_llama_context* rn_ctx, std::shared_ptr<CallInvoker> jsInvoker)
+    : rn_ctx_(rn_ctx), jsInvoker_(std::move(jsInvoker)), pool_(std::make_shared<WorkerPool>()),
+      completion_pool_(std::make_shared<WorkerPool>()), should_stop_completion_(false) {
     initHelpers();
+
+    // A completion holds its worker until it is done, so completions get one
+    // worker per scheduler slot; more would only wait in the scheduler's queue.
+    // Tokenization, embeddings, sessions and vector searches share the others.
+    startWorkers(completion_pool_, rn_ctx_ && rn_ctx_->scheduler ? rn_ctx_->scheduler->n_slots() : 1);
+    startWorkers(pool_, RN_ASYNC_WORKERS);
+}
+
+void LlamaCppModel::startWorkers(const std::shared_ptr<WorkerPool>& pool, int n_workers) {
+    for (int i = 0; i < n_workers; ++i) {
+      std::thread([pool]() {
+        std::unique_lock<std::mutex> lock(pool->mutex);
+        while (true) {
+          pool->cv.wait(lock, [&pool] { return pool->stopping || !pool->queue.empty(); });
+          if (pool->queue.empty()) {
+            return;
+          }
+          auto job = std::move(pool->queue.front());
+          pool->queue.pop_front();
+
+          lock.unlock();
+          job();
+          job = nullptr;
+          lock.lock();
+        }
+      }).detach();
+    }
 }
 
 void LlamaCppModel::initHelpers() {
@@ -47,33 +100,62 @@ void LlamaCppModel::initHelpers() {
 LlamaCppModel::~LlamaCppModel() {
   // Note: We don't automatically release resources here
   // as the user should call release() explicitly
+
+  // Queued jobs hold a reference to the model, so the queues are empty here
+  stopWorkers(completion_pool_);
+  stopWorkers(pool_);
+}
+
+void LlamaCppModel::stopWorkers(const std::shared_ptr<WorkerPool>& pool) {
+  {
+    std::lock_guard<std::mutex> lock(pool->mutex);
+    pool->stopping = true;
+  }
+  pool->cv.notify_all();
 }
 
 void LlamaCppModel::release() {
   // Cancel any ongoing predictions
-  if (is_predicting_) {
-    should_stop_completion_ = true;
-
-    // Optionally wait a bit for completion to stop
-    int retry = 0;
-    while (is_predicting_ && retry < 10) {
-      std::this_thread::sleep_for(std::chrono::milliseconds(10));
-      retry++;
-    }
-  }
+  setShouldStopCompletion(true);
 
   // Clean up our resources
   if (rn_ctx_) {
+    // Fail queued and running completions, then wait for the worker threads to
+    // return before the context they use goes away
+    if (rn_ctx_->scheduler) {
+      rn_ctx_->scheduler->stop();
+    }
+    {
+      std::unique_lock<std::mutex> lock(jobs_mutex_);
+      jobs_cv_.wait(lock, [this] { return n_jobs_ == 0; });
+    }
+    rn_ctx_->scheduler.reset();
+
     if (rn_ctx_->ctx) {
       llama_free(rn_ctx_->ctx);
       rn_ctx_->ctx = nullptr;
+      rn_ctx_->cache_tokens.clear();
     }
+    if (rn_ctx_->embd_ctx) {
+      llama_free(rn_ctx_->embd_ctx);
+      rn_ctx_->embd_ctx = nullptr;
+    }
+
+    // Cached grammars and grammar masks reference the model's vocab
+    rn_ctx_->grammar_cache.clear();
+    rn_ctx_->grammar_mask.clear();
+    rn_ctx_->embedding_cache.close();
 
     if (rn_ctx_->model) {
       llama_model_free(rn_ctx_->model);
       rn_ctx_->model = nullptr;
     }
 
+    if (rn_ctx_->model_dft) {
+      llama_model_free(rn_ctx_->model_dft);
+      rn_ctx_->model_dft = nullptr;
+    }
+
     // Note: rn_ctx_ itself is owned by the module, so we don't delete it here
     rn_ctx_ = nullptr;
   }
@@ -100,10 +182,14 @@ bool LlamaCppModel::shouldStopCompletion() const {
 }
 
 void LlamaCppModel::setShouldStopCompletion(bool value) {
+  std::lock_guard<std::mutex> lock(requests_mutex_);
   should_stop_completion_ = value;
   if (value) {
-    // Reset the predicting flag when stopping completion
-    is_predicting_ = false;
+    // Cancel every running completion; each stops at its next decode step, or
+    // mid-batch through the context's abort callback
+    for (const auto& cancel : active_requests_) {
+      cancel->cancel();
+    }
   }
 }
 
@@ -143,6 +229,15 @@ CompletionOptions LlamaCppModel::parseCompletionOptions(jsi::Runtime& rt, const
     options.n_keep = obj.getProperty(rt, "n_keep").asNumber();
   }
 
+  // Token probabilities
+  if (obj.hasProperty(rt, "n_probs") && !obj.getProperty(rt, "n_probs").isUndefined()) {
+    options.n_probs = std::max(0, (int)obj.getProperty(rt, "n_probs").asNumber());
+  }
+
+  if (obj.hasProperty(rt, "post_sampling_probs") && !obj.getProperty(rt, "post_sampling_probs").isUndefined()) {
+    options.post_sampling_probs = obj.getProperty(rt, "post_sampling_probs").asBool();
+  }
+
   // Extract seed
   if (obj.hasProperty(rt, "seed") && !obj.getProperty(rt, "seed").isUndefined()) {
     options.seed = obj.getProperty(rt, "seed").asNumber();
@@ -169,6 +264,50 @@ CompletionOptions LlamaCppModel::parseCompletionOptions(jsi::Runtime& rt, const
     options.grammar = obj.getProperty(rt, "grammar").asString(rt).utf8(rt);
   }
 
+  if (obj.hasProperty(rt, "grammar_lazy") && !obj.getProperty(rt, "grammar_lazy").isUndefined()) {
+    options.grammar_lazy = obj.getProperty(rt, "grammar_lazy").asBool();
+  }
+
+  // Triggers of a lazy grammar: { type: "word" | "pattern" | "pattern_start" | "token", value }
+  if (obj.hasProperty(rt, "grammar_triggers") && obj.getProperty(rt, "grammar_triggers").isObject()) {
+    auto triggersVal = obj.getProperty(rt, "grammar_triggers").getObject(rt);
+    if (triggersVal.isArray(rt)) {
+      auto triggersArr = triggersVal.getArray(rt);
+      for (size_t i = 0; i < triggersArr.size(rt); i++) {
+        auto triggerVal = triggersArr.getValueAtIndex(rt, i);
+        if (!triggerVal.isObject()) {
+          continue;
+        }
+        auto triggerObj = triggerVal.getObject(rt);
+
+        std::string type = "word";
+        SystemUtils::setIfExists(rt, triggerObj, "type", type);
+
+        common_grammar_trigger trigger;
+        if (type == "word") {
+          trigger.type = COMMON_GRAMMAR_TRIGGER_TYPE_WORD;
+        } else if (type == "pattern") {
+          trigger.type = COMMON_GRAMMAR_TRIGGER_TYPE_PATTERN;
+        } else if (type == "pattern_start") {
+          trigger.type = COMMON_GRAMMAR_TRIGGER_TYPE_PATTERN_START;
+        } else if (type == "token") {
+          trigger.type = COMMON_GRAMMAR_TRIGGER_TYPE_TOKEN;
+        } else {
+          throw std::runtime_error("Unknown grammar trigger type: " + type);
+        }
+
+        // Token triggers take a token id or the text of a single token
+        auto value = triggerObj.getProperty(rt, "value");
+        if (value.isNumber()) {
+          trigger.token = (llama_token)value.asNumber();
+        } else if (value.isString()) {
+          trigger.value = value.asString(rt).utf8(rt);
+        }
+        options.grammar_triggers.push_back(std::move(trigger));
+      }
+    }
+  }
+
   if (obj.hasProperty(rt, "ignore_eos") && !obj.getProperty(rt, "ignore_eos").isUndefined()) {
     options.ignore_eos = obj.getProperty(rt, "ignore_eos").asBool();
   }
@@ -177,6 +316,47 @@ CompletionOptions LlamaCppModel::parseCompletionOptions(jsi::Runtime& rt, const
     options.stream = obj.getProperty(rt, "stream").asBool();
   }
 
+  // Streaming frame policy
+  if (obj.hasProperty(rt, "stream_flush_tokens") && !obj.getProperty(rt, "stream_flush_tokens").isUndefined()) {
+    options.stream_flush_tokens = std::max(0, (int)obj.getProperty(rt, "stream_flush_tokens").asNumber());
+  }
+
+  if (obj.hasProperty(rt, "stream_flush_ms") && !obj.getProperty(rt, "stream_flush_ms").isUndefined()) {
+    options.stream_flush_ms = std::max(0, (int)obj.getProperty(rt, "stream_flush_ms").asNumber());
+  }
+
+  if (obj.hasProperty(rt, "stream_flush_on") && !obj.getProperty(rt, "stream_flush_on").isUndefined()) {
+    std::string boundary = obj.getProperty(rt, "stream_flush_on").asString(rt).utf8(rt);
+    if (boundary == "newline") {
+      options.stream_flush_boundary = RN_STREAM_BOUNDARY_NEWLINE;
+    } else if (boundary == "sentence") {
+      options.stream_flush_boundary = RN_STREAM_BOUNDARY_SENTENCE;
+    } else if (boundary != "none") {
+      throw std::runtime_error("Unknown stream_flush_on value: " + boundary);
+    }
+  }
+
+  // Ring buffer created by createTokenStream, recognized by its memory
+  if (obj.hasProperty(rt, "token_stream") && obj.getProperty(rt, "token_stream").isObject()) {
+    jsi::Object bufferObj = obj.getProperty(rt, "token_stream").getObject(rt);
+    if (!bufferObj.isArrayBuffer(rt)) {
+      throw std::runtime_error("token_stream must be an ArrayBuffer returned by createTokenStream");
+    }
+    const uint8_t* data = bufferObj.getArrayBuffer(rt).data(rt);
+
+    std::lock_guard<std::mutex> lock(token_rings_mutex_);
+    for (const auto& weak : token_rings_) {
+      auto ring = weak.lock();
+      if (ring && ring->data() == data) {
+        options.token_ring = ring;
+        break;
+      }
+    }
+    if (!options.token_ring) {
+      throw std::runtime_error("token_stream must be an ArrayBuffer returned by createTokenStream");
+    }
+  }
+
   // Extract and parse messages if present (for chat completion)
   if (obj.hasProperty(rt, "messages") && obj.getProperty(rt, "messages").isObject()) {
     auto messagesVal = obj.getProperty(rt, "messages").getObject(rt);
@@ -404,7 +584,8 @@ CompletionOptions LlamaCppModel::parseCompletionOptions(jsi::Runtime& rt, const
 }
 
 // Modify the completion function to use this helper
-CompletionResult LlamaCppModel::completion(const CompletionOptions& options, std::function<void(jsi::Runtime&, const char*)> partialCallback, jsi::Runtime* runtime) {
+CompletionResult LlamaCppModel::completion(const CompletionOptions& options, std::function<void(const CompletionChunk&)> partialCallback,
+                                           std::shared_ptr<rn_cancel_token> cancel) {
   if (!rn_ctx_ || !rn_ctx_->model || !rn_ctx_->ctx) {
     CompletionResult result;
     result.content = "";
@@ -414,65 +595,51 @@ CompletionResult LlamaCppModel::completion(const CompletionOptions& options, std
     return result;
   }
 
-  // Lock the mutex during completion to avoid concurrent accesses
-  std::lock_guard<std::mutex> lock(rn_ctx_->mutex);
-
-  // Clear the context KV cache
-  llama_kv_self_clear(rn_ctx_->ctx);
-
-  // Store original sampling parameters to restore later
-  float orig_temp = rn_ctx_->params.sampling.temp;
-  float orig_top_p = rn_ctx_->params.sampling.top_p;
-  float orig_top_k = rn_ctx_->params.sampling.top_k;
-  float orig_min_p = rn_ctx_->params.sampling.min_p;
-  int orig_n_predict = rn_ctx_->params.n_predict;
+  // Requests are queued on the context's scheduler, which runs concurrent
+  // completions as parallel sequences and applies the sampling options per request
 
-  // Set sampling parameters from options
-  rn_ctx_->params.sampling.temp = options.temperature;
-  rn_ctx_->params.sampling.top_p = options.top_p;
-  rn_ctx_->params.sampling.top_k = options.top_k;
-  rn_ctx_->params.sampling.min_p = options.min_p;
-  rn_ctx_->params.n_predict = options.n_predict;
-
-  // Check for a partial callback
-  auto callback_adapter = [&partialCallback, runtime](const std::string& token, bool is_done) -> bool {
-    if (partialCallback && runtime && !is_done) {
-      partialCallback(*runtime, token.c_str());
-    }
-    return true;
-  };
+  // Only stream when there is a partial callback
+  std::function<bool(const CompletionChunk&, bool)> callback_adapter = nullptr;
+  if (partialCallback) {
+    callback_adapter = [&partialCallback](const CompletionChunk& chunk, bool is_done) -> bool {
+      if (!is_done) {
+        partialCallback(chunk);
+      }
+      return true;
+    };
+  }
 
   // Run the completion based on whether we have messages or prompt
   CompletionResult result;
 
-  try {
-    // Set the predicting flag to prevent interruption
-    is_predicting_ = true;
+  // Register the request so that stopCompletion can cancel it
+  if (!cancel) {
+    cancel = std::make_shared<rn_cancel_token>();
+  }
+  {
+    std::lock_guard<std::mutex> lock(requests_mutex_);
     should_stop_completion_ = false;
+    active_requests_.insert(cancel);
+  }
 
+  try {
     if (!options.messages.empty()) {
       // Chat completion (with messages)
-      result = run_chat_completion(rn_ctx_, options, callback_adapter);
+      result = run_chat_completion(rn_ctx_, options, callback_adapter, cancel);
     } else {
       // Regular completion (with prompt)
-      result = run_completion(rn_ctx_, options, callback_adapter);
+      result = run_completion(rn_ctx_, options, callback_adapter, cancel);
     }
-
-    // Reset the predicting flag
-    is_predicting_ = false;
   } catch (const std::exception& e) {
-    is_predicting_ = false;
     result.success = false;
     result.error_msg = std::string("Completion failed: ") + e.what();
     result.error_type = RN_ERROR_INFERENCE;
   }
 
-  // Restore original parameters
-  rn_ctx_->params.sampling.temp = orig_temp;
-  rn_ctx_->params.sampling.top_p = orig_top_p;
-  rn_ctx_->params.sampling.top_k = orig_top_k;
-  rn_ctx_->params.sampling.min_p = orig_min_p;
-  rn_ctx_->params.n_predict = orig_n_predict;
+  {
+    std::lock_guard<std::mutex> lock(requests_mutex_);
+    active_requests_.erase(cancel);
+  }
 
   return result;
 }
@@ -498,15 +665,29 @@ jsi::Object LlamaCppModel::completionResultToJsi(jsi::Runtime& rt, const Complet
         jsonToJsi(rt, result.chat_response["choices"][0]["message"]["tool_calls"]));
     }
 
+    if (result.slot_id >= 0) {
+      chatResponse.setProperty(rt, "slot", jsi::Value(result.slot_id));
+    }
+
     return chatResponse;
   }
 
   // Standard completion result
   jsResult.setProperty(rt, "content", jsi::String::createFromUtf8(rt, result.content));
-  jsResult.setProperty(rt, "timings", jsi::Object(rt));
+  jsResult.setProperty(rt, "timings", jsonToJsi(rt, result.timings_to_json()));
   jsResult.setProperty(rt, "success", jsi::Value(result.success));
   jsResult.setProperty(rt, "promptTokens", jsi::Value(result.n_prompt_tokens));
   jsResult.setProperty(rt, "completionTokens", jsi::Value(result.n_predicted_tokens));
+  jsResult.setProperty(rt, "truncated", jsi::Value(result.truncated));
+  jsResult.setProperty(rt, "cancelled", jsi::Value(result.cancelled));
+  if (result.slot_id >= 0) {
+    jsResult.setProperty(rt, "slot", jsi::Value(result.slot_id));
+  }
+
+  if (!result.probs.empty()) {
+    jsResult.setProperty(rt, "completion_probabilities",
+      jsonToJsi(rt, token_probs_to_json(result.probs, result.post_sampling_probs)));
+  }
 
   if (!result.success) {
     jsResult.setProperty(rt, "error", jsi::String::createFromUtf8(rt, result.error_msg));
@@ -546,36 +727,219 @@ jsi::Value LlamaCppModel::jsonToJsi(jsi::Runtime& rt, const json& j) {
   return jsi::Value::undefined();
 }
 
+// Create a JS Error object carrying the given message
+static jsi::Value makeJsError(jsi::Runtime& rt, const std::string& message) {
+  return rt.global().getPropertyAsFunction(rt, "Error").callAsConstructor(rt, jsi::String::createFromUtf8(rt, message));
+}
+
+jsi::Value LlamaCppModel::runAsync(jsi::Runtime& rt, std::function<AsyncResultBuilder()> work, bool blocking) {
+  if (released_) {
+    throw std::runtime_error("Model has been released");
+  }
+  auto self = shared_from_this();
+  auto pool = blocking ? completion_pool_ : pool_;
+
+  auto executor = jsi::Function::createFromHostFunction(
+    rt, jsi::PropNameID::forAscii(rt, "executor"), 2,
+    [self, pool, work = std::move(work)](jsi::Runtime& runtime, const jsi::Value& thisValue, const jsi::Value* args, size_t count) -> jsi::Value {
+      auto resolve = std::make_shared<jsi::Function>(args[0].asObject(runtime).asFunction(runtime));
+      auto reject = std::make_shared<jsi::Function>(args[1].asObject(runtime).asFunction(runtime));
+
+      {
+        std::lock_guard<std::mutex> lock(self->jobs_mutex_);
+        self->n_jobs_++;
+      }
+
+      auto job = [self, work, resolve = std::move(resolve), reject = std::move(reject), &runtime]() mutable {
+        AsyncResultBuilder builder;
+        std::string error;
+        try {
+          builder = work();
+        } catch (const std::exception& e) {
+          error = e.what();
+        }
+
+        // The JS functions, including any captured by the work, are moved to the
+        // JS thread where they are called and released. The builder may use the
+        // model, which is kept alive until it has run.
+        self->jsInvoker_->invokeAsync(
+          [self, work = std::move(work), builder = std::move(builder), error = std::move(error),
+           resolve = std::move(resolve), reject = std::move(reject), &runtime]() {
+            try {
+              if (error.empty()) {
+                resolve->call(runtime, builder(runtime));
+              } else {
+                reject->call(runtime, makeJsError(runtime, error));
+              }
+            } catch (const jsi::JSError& e) {
+              reject->call(runtime, makeJsError(runtime, e.getMessage()));
+            } catch (const std::exception& e) {
+              reject->call(runtime, makeJsError(runtime, e.what()));
+            }
+          });
+
+        std::lock_guard<std::mutex> lock(self->jobs_mutex_);
+        if (--self->n_jobs_ == 0) {
+          self->jobs_cv_.notify_all();
+        }
+      };
+
+      {
+        std::lock_guard<std::mutex> lock(pool->mutex);
+        pool->queue.push_back(std::move(job));
+      }
+      pool->cv.notify_one();
+
+      return jsi::Value::undefined();
+    });
+
+  return rt.global().getPropertyAsFunction(rt, "Promise").callAsConstructor(rt, executor);
+}
+
 // JSI method for completions
 jsi::Value LlamaCppModel::completionJsi(jsi::Runtime& rt, const jsi::Value* args, size_t count) {
   if (count < 1 || !args[0].isObject()) {
     throw jsi::JSError(rt, "completion requires an options object");
   }
 
-  // Create partial callback function for token streaming
-  std::function<void(jsi::Runtime&, const char*)> partialCallback = nullptr;
+  // Streamed tokens are passed to the JS callback on the JS thread
+  std::function<void(const CompletionChunk&)> partialCallback = nullptr;
 
-  if (count > 1 && args[1].isObject() && args[1].getObject(rt).isFunction(rt)) {
-    auto callbackFn = std::make_shared<jsi::Function>(args[1].getObject(rt).getFunction(rt));
-    partialCallback = [callbackFn](jsi::Runtime& rt, const char* token) {
-      jsi::Object data(rt);
-      data.setProperty(rt, "token", jsi::String::createFromUtf8(rt, token));
-      callbackFn->call(rt, data);
-    };
-  }
+  // Frames sent and JS thread time spent in them, only touched on the JS thread.
+  // Frame callbacks are queued before the promise is resolved, so the totals are
+  // complete when the result is built.
+  struct stream_stats {
+    int n_frames = 0;
+    double js_ms = 0.0;
+    std::atomic<bool> queued{false}; // a token_stream notification is waiting for the JS thread
+  };
+  auto stats = std::make_shared<stream_stats>();
+  auto self = shared_from_this();
 
   try {
     // Parse options from JSI object
     CompletionOptions options = parseCompletionOptions(rt, args[0].getObject(rt));
 
+    if (count > 1 && args[1].isObject() && args[1].getObject(rt).isFunction(rt)) {
+      auto callbackFn = std::make_shared<jsi::Function>(args[1].getObject(rt).getFunction(rt));
+      auto jsInvoker = jsInvoker_;
+      const bool post_sampling_probs = options.post_sampling_probs;
+      const bool ring = options.token_ring != nullptr;
+      partialCallback = [self, callbackFn, jsInvoker, stats, post_sampling_probs, ring, &rt](const CompletionChunk& chunk) {
+        // The data is read from the ring, so frames only tell JS to look at it
+        // and one waiting notification covers every token written before it runs
+        if (ring) {
+          if (stats->queued.exchange(true)) {
+            return;
+          }
+          jsInvoker->invokeAsync([callbackFn, stats, &rt]() {
+            const auto t_start = std::chrono::steady_clock::now();
+            stats->queued = false;
+
+            jsi::Object data(rt);
+            data.setProperty(rt, "token", jsi::String::createFromUtf8(rt, ""));
+            data.setProperty(rt, "tokens", jsi::Array(rt, 0));
+            data.setProperty(rt, "t_ms", jsi::Value(0));
+            callbackFn->call(rt, data);
+
+            stats->n_frames++;
+            stats->js_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t_start).count();
+          });
+          return;
+        }
+
+        // Probabilities are converted to JSON here to keep the JS thread's share small
+        json probs = chunk.probs.empty() ? json() : token_probs_to_json(chunk.probs, post_sampling_probs);
+        jsInvoker->invokeAsync([self, callbackFn, stats, token = chunk.text, tokens = chunk.tokens,
+                                t_ms = chunk.t_ms, probs = std::move(probs), &rt]() {
+          const auto t_start = std::chrono::steady_clock::now();
+
+          jsi::Object data(rt);
+          data.setProperty(rt, "token", jsi::String::createFromUtf8(rt, token));
+          jsi::Array tokensArray(rt, tokens.size());
+          for (size_t i = 0; i < tokens.size(); i++) {
+            tokensArray.setValueAtIndex(rt, i, jsi::Value((int)tokens[i]));
+          }
+          data.setProperty(rt, "tokens", tokensArray);
+          data.setProperty(rt, "t_ms", jsi::Value(t_ms));
+          if (!probs.is_null()) {
+            data.setProperty(rt, "completion_probabilities", self->jsonToJsi(rt, probs));
+          }
+          callbackFn->call(rt, data);
+
+          stats->n_frames++;
+          stats->js_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t_start).count();
+        });
+      };
+    }
+
     // Set streaming flag based on callback presence
     options.stream = (partialCallback != nullptr);
 
-    // Call our C++ completion method which properly initializes rn_llama_context
-    CompletionResult result = completion(options, partialCallback, &rt);
+    // Registered now, so that stopCompletion also cancels a request still
+    // waiting for a worker
+    auto cancel = std::make_shared<rn_cancel_token>();
+    {
+      std::lock_guard<std::mutex> lock(requests_mutex_);
+      active_requests_.insert(cancel);
+    }
+
+    return runAsync(rt, [self, options, partialCallback, stats, cancel]() -> AsyncResultBuilder {
+      // Call our C++ completion method which properly initializes rn_llama_context
+      auto result = std::make_shared<CompletionResult>(self->completion(options, partialCallback, cancel));
+
+      // Convert the result to a JSI object using our helper
+      return [self, result, stats, streamed = partialCallback != nullptr](jsi::Runtime& rt) -> jsi::Value {
+        jsi::Object jsResult = self->completionResultToJsi(rt, *result);
+
+        jsi::Value timings = jsResult.getProperty(rt, "timings");
+        if (streamed && timings.isObject()) {
+          jsi::Object timingsObj = timings.getObject(rt);
+          timingsObj.setProperty(rt, "stream_frames", jsi::Value(stats->n_frames));
+          timingsObj.setProperty(rt, "stream_js_ms", jsi::Value(stats->js_ms));
+        }
+        return jsResult;
+      };
+    }, true);
+  } catch (const std::exception& e) {
+    throw jsi::JSError(rt, e.what());
+  }
+}
+
+jsi::Value LlamaCppModel::createTokenStreamJsi(jsi::Runtime& rt, const jsi::Value* args, size_t count) {
+  // Exposes the ring's memory to JS without copying
+  class TokenRingBuffer : public jsi::MutableBuffer {
+  public:
+    explicit TokenRingBuffer(std::shared_ptr<rn_token_ring> ring) : ring_(std::move(ring)) {}
+    size_t size() const override { return ring_->size(); }
+    uint8_t* data() override { return ring_->data(); }
+
+  private:
+    std::shared_ptr<rn_token_ring> ring_;
+  };
+
+  try {
+    int n_tokens = RN_TOKEN_RING_DEFAULT_TOKENS;
+    int n_bytes = RN_TOKEN_RING_DEFAULT_BYTES;
+    if (count > 0 && args[0].isObject()) {
+      jsi::Object options = args[0].getObject(rt);
+      SystemUtils::setIfExists(rt, options, "tokens", n_tokens);
+      SystemUtils::setIfExists(rt, options, "bytes", n_bytes);
+    }
+    if (n_tokens <= 0 || n_bytes <= 0) {
+      throw std::runtime_error("createTokenStream requires positive tokens and bytes capacities");
+    }
+
+    auto ring = std::make_shared<rn_token_ring>((uint32_t)n_tokens, (uint32_t)n_bytes);
+    {
+      std::lock_guard<std::mutex> lock(token_rings_mutex_);
+      token_rings_.erase(std::remove_if(token_rings_.begin(), token_rings_.end(),
+                                        [](const std::weak_ptr<rn_token_ring>& weak) { return weak.expired(); }),
+                         token_rings_.end());
+      token_rings_.push_back(ring);
+    }
 
-    // Convert the result to a JSI object using our helper
-    return completionResultToJsi(rt, result);
+    return jsi::ArrayBuffer(rt, std::make_shared<TokenRingBuffer>(ring));
   } catch (const std::exception& e) {
     throw jsi::JSError(rt, e.what());
   }
@@ -601,64 +965,71 @@ jsi::Value LlamaCppModel::tokenizeJsi(jsi::Runtime& rt, const jsi::Value* args,
     SystemUtils::setIfExists(rt, options, "add_special", add_special);
     SystemUtils::setIfExists(rt, options, "with_pieces", with_pieces);
 
-    // Parameter for llama_tokenize
-    bool parse_special = true;
+    return runAsync(rt, [this, content, add_special, with_pieces]() -> AsyncResultBuilder {
+      // Parameter for llama_tokenize
+      bool parse_special = true;
 
-    if (!rn_ctx_ || !rn_ctx_->model || !rn_ctx_->vocab) {
-      throw std::runtime_error("Model not loaded or vocab not available");
-    }
-
-    // Use the common_token_to_piece function from llama.cpp for more consistent tokenization
-    std::vector<llama_token> tokens;
-
-    if (content.empty()) {
-      // Handle empty content specially
-      tokens = {};
-    } else {
-      // First determine how many tokens are needed
-      int n_tokens = llama_tokenize(rn_ctx_->vocab, content.c_str(), content.length(), nullptr, 0, add_special, parse_special);
-      if (n_tokens < 0) {
-        n_tokens = -n_tokens; // Convert negative value (indicates insufficient buffer)
+      if (!rn_ctx_ || !rn_ctx_->model || !rn_ctx_->vocab) {
+        throw std::runtime_error("Tokenization error: Model not loaded or vocab not available");
       }
 
-      // Allocate buffer and do the actual tokenization
-      tokens.resize(n_tokens);
-      n_tokens = llama_tokenize(rn_ctx_->vocab, content.c_str(), content.length(), tokens.data(), tokens.size(), add_special, parse_special);
+      // Use the common_token_to_piece function from llama.cpp for more consistent tokenization
+      std::vector<llama_token> tokens;
 
-      if (n_tokens < 0) {
-        throw std::runtime_error("Tokenization failed: insufficient buffer");
-      }
-
-      // Resize to the actual number of tokens used
-      tokens.resize(n_tokens);
-    }
+      if (!content.empty()) {
+        // First determine how many tokens are needed
+        int n_tokens = llama_tokenize(rn_ctx_->vocab, content.c_str(), content.length(), nullptr, 0, add_special, parse_special);
+        if (n_tokens < 0) {
+          n_tokens = -n_tokens; // Convert negative value (indicates insufficient buffer)
+        }
 
-    // Create result object with tokens array
-    jsi::Object result(rt);
-    jsi::Array tokensArray(rt, tokens.size());
+        // Allocate buffer and do the actual tokenization
+        tokens.resize(n_tokens);
+        n_tokens = llama_tokenize(rn_ctx_->vocab, content.c_str(), content.length(), tokens.data(), tokens.size(), add_special, parse_special);
 
-    // Fill the tokens array with token IDs and text
-    for (size_t i = 0; i < tokens.size(); i++) {
-      if (with_pieces) {
-        // Create an object with ID and piece text
-        jsi::Object tokenObj(rt);
-        tokenObj.setProperty(rt, "id", jsi::Value((int)tokens[i]));
+        if (n_tokens < 0) {
+          throw std::runtime_error("Tokenization error: insufficient buffer");
+        }
 
-        // Get the text piece for this token
-        std::string piece = common_token_to_piece(rn_ctx_->vocab, tokens[i]);
-        tokenObj.setProperty(rt, "text", jsi::String::createFromUtf8(rt, piece));
+        // Resize to the actual number of tokens used
+        tokens.resize(n_tokens);
+      }
 
-        tokensArray.setValueAtIndex(rt, i, tokenObj);
-      } else {
-        // Just add the token ID
-        tokensArray.setValueAtIndex(rt, i, jsi::Value((int)tokens[i]));
+      // Get the text piece of each token while still off the JS thread
+      std::vector<std::string> pieces;
+      if (with_pieces) {
+        pieces.reserve(tokens.size());
+        for (llama_token token : tokens) {
+          pieces.push_back(common_token_to_piece(rn_ctx_->vocab, token));
+        }
       }
-    }
 
-    result.setProperty(rt, "tokens", tokensArray);
-    result.setProperty(rt, "count", jsi::Value((int)tokens.size()));
+      return [tokens = std::move(tokens), pieces = std::move(pieces), with_pieces](jsi::Runtime& rt) -> jsi::Value {
+        // Create result object with tokens array
+        jsi::Object result(rt);
+        jsi::Array tokensArray(rt, tokens.size());
+
+        // Fill the tokens array with token IDs and text
+        for (size_t i = 0; i < tokens.size(); i++) {
+          if (with_pieces) {
+            // Create an object with ID and piece text
+            jsi::Object tokenObj(rt);
+            tokenObj.setProperty(rt, "id", jsi::Value((int)tokens[i]));
+            tokenObj.setProperty(rt, "text", jsi::String::createFromUtf8(rt, pieces[i]));
+
+            tokensArray.setValueAtIndex(rt, i, tokenObj);
+          } else {
+            // Just add the token ID
+            tokensArray.setValueAtIndex(rt, i, jsi::Value((int)tokens[i]));
+          }
+        }
 
-    return result;
+        result.setProperty(rt, "tokens", tokensArray);
+        result.setProperty(rt, "count", jsi::Value((int)tokens.size()));
+
+        return result;
+      };
+    });
   } catch (const std::exception& e) {
     throw jsi::JSError(rt, std::string("Tokenization error: ") + e.what());
   }
@@ -685,10 +1056,6 @@ jsi::Value LlamaCppModel::detokenizeJsi(jsi::Runtime& rt, const jsi::Value* args
     jsi::Array tokensArr = tokensVal.getArray(rt);
     int token_count = tokensArr.size(rt);
 
-    if (!rn_ctx_ || !rn_ctx_->model || !rn_ctx_->vocab) {
-      throw std::runtime_error("Model not loaded or vocab not available");
-    }
-
     // Create a vector of token IDs
     std::vector<llama_token> tokens;
     tokens.reserve(token_count);
@@ -705,17 +1072,24 @@ jsi::Value LlamaCppModel::detokenizeJsi(jsi::Runtime& rt, const jsi::Value* args
       }
     }
 
-    // Use common_token_to_piece for each token and concatenate the results
-    std::string result_text;
-    for (auto token : tokens) {
-      result_text += common_token_to_piece(rn_ctx_->vocab, token);
-    }
+    return runAsync(rt, [this, tokens = std::move(tokens)]() -> AsyncResultBuilder {
+      if (!rn_ctx_ || !rn_ctx_->model || !rn_ctx_->vocab) {
+        throw std::runtime_error("Detokenization error: Model not loaded or vocab not available");
+      }
 
-    // Create result object
-    jsi::Object result(rt);
-    result.setProperty(rt, "text", jsi::String::createFromUtf8(rt, result_text));
+      // Use common_token_to_piece for each token and concatenate the results
+      std::string result_text;
+      for (auto token : tokens) {
+        result_text += common_token_to_piece(rn_ctx_->vocab, token);
+      }
 
-    return result;
+      return [result_text = std::move(result_text)](jsi::Runtime& rt) -> jsi::Value {
+        // Create result object
+        jsi::Object result(rt);
+        result.setProperty(rt, "text", jsi::String::createFromUtf8(rt, result_text));
+        return result;
+      };
+    });
   } catch (const std::exception& e) {
     throw jsi::JSError(rt, std::string("Detokenization error: ") + e.what());
   }
@@ -739,13 +1113,26 @@ jsi::Value LlamaCppModel::embeddingJsi(jsi::Runtime& rt, const jsi::Value* args,
   try {
     jsi::Object options = args[0].getObject(rt);
 
-    // Extract required content parameter, support both 'input' (OpenAI) and 'content' (custom format)
-    std::string content;
-
-    if (options.hasProperty(rt, "input") && options.getProperty(rt, "input").isString()) {
-      content = options.getProperty(rt, "input").getString(rt).utf8(rt);
-    } else if (options.hasProperty(rt, "content") && options.getProperty(rt, "content").isString()) {
-      content = options.getProperty(rt, "content").getString(rt).utf8(rt);
+    // Extract required content parameter, support both 'input' (OpenAI) and 'content' (custom format).
+    // Either can be an array of strings that are embedded together.
+    const char* input_key = options.hasProperty(rt, "input") ? "input" : "content";
+    jsi::Value input = options.getProperty(rt, input_key);
+    std::vector<std::string> contents;
+
+    if (input.isString()) {
+      contents.push_back(input.getString(rt).utf8(rt));
+    } else if (input.isObject() && input.getObject(rt).isArray(rt)) {
+      jsi::Array inputArr = input.getObject(rt).getArray(rt);
+      for (size_t i = 0; i < inputArr.size(rt); i++) {
+        jsi::Value item = inputArr.getValueAtIndex(rt, i);
+        if (!item.isString()) {
+          throw jsi::JSError(rt, std::string("embedding '") + input_key + "' array must only contain strings");
+        }
+        contents.push_back(item.getString(rt).utf8(rt));
+      }
+      if (contents.empty()) {
+        throw jsi::JSError(rt, std::string("embedding '") + input_key + "' array is empty");
+      }
     } else {
       throw jsi::JSError(rt, "embedding requires either 'input' or 'content' string field");
     }
@@ -754,8 +1141,9 @@ jsi::Value LlamaCppModel::embeddingJsi(jsi::Runtime& rt, const jsi::Value* args,
     std::string encoding_format = "float";
     if (options.hasProperty(rt, "encoding_format") && options.getProperty(rt, "encoding_format").isString()) {
       encoding_format = options.getProperty(rt, "encoding_format").getString(rt).utf8(rt);
-      if (encoding_format != "float" && encoding_format != "base64") {
-        throw jsi::JSError(rt, "encoding_format must be either 'float' or 'base64'");
+      if (encoding_format != "float" && encoding_format != "base64" &&
+          encoding_format != "int8" && encoding_format != "binary") {
+        throw jsi::JSError(rt, "encoding_format must be 'float', 'base64', 'int8' or 'binary'");
       }
     }
 
@@ -764,157 +1152,453 @@ jsi::Value LlamaCppModel::embeddingJsi(jsi::Runtime& rt, const jsi::Value* args,
       add_bos = options.getProperty(rt, "add_bos_token").getBool();
     }
 
-    // Check model and context
-    if (!rn_ctx_ || !rn_ctx_->model || !rn_ctx_->ctx || !rn_ctx_->vocab) {
-      throw std::runtime_error("Model not loaded or context not initialized");
+    // Defaults to the pooling the model was loaded with, or mean pooling for OpenAI compatibility
+    enum llama_pooling_type pooling_type = LLAMA_POOLING_TYPE_UNSPECIFIED;
+    if (options.hasProperty(rt, "pooling") && options.getProperty(rt, "pooling").isString()) {
+      pooling_type = rn_parse_pooling(options.getProperty(rt, "pooling").getString(rt).utf8(rt));
     }
 
-    // Tokenize the input text
-    std::vector<llama_token> tokens;
-    int n_tokens = llama_tokenize(rn_ctx_->vocab, content.c_str(), content.length(), nullptr, 0, add_bos, true);
-    if (n_tokens < 0) {
-      n_tokens = -n_tokens;
-    }
-    tokens.resize(n_tokens);
-    n_tokens = llama_tokenize(rn_ctx_->vocab, content.c_str(), content.length(), tokens.data(), n_tokens, add_bos, true);
-    if (n_tokens < 0) {
-      throw std::runtime_error("Tokenization failed for embedding");
-    }
-    tokens.resize(n_tokens);
-
-    if (tokens.empty()) {
-      throw jsi::JSError(rt, "No tokens generated from input text");
-    }
-
-    // Clear the context KV cache to ensure clean embedding
-    llama_kv_self_clear(rn_ctx_->ctx);
-
-    // Enable embedding mode
-    llama_set_embeddings(rn_ctx_->ctx, true);
-
-    // Evaluate tokens one by one
-    for (int i = 0; i < (int)tokens.size(); i++) {
-      llama_token token = tokens[i];
-      llama_batch batch = {
-        /* n_tokens    */ 1,
-        /* token       */ &token,
-        /* embd        */ nullptr,
-        /* pos         */ &i,
-        /* n_seq_id    */ nullptr,
-        /* seq_id      */ nullptr,
-        /* logits      */ nullptr
+    bool normalize = true;
+    bool use_cache = true;
+    int dimensions = 0;
+    SystemUtils::setIfExists(rt, options, "normalize", normalize);
+    SystemUtils::setIfExists(rt, options, "cache", use_cache);
+    SystemUtils::setIfExists(rt, options, "dimensions", dimensions);
+    if (dimensions < 0) {
+      throw jsi::JSError(rt, "dimensions must be positive");
+    }
+
+    // Create model info
+    std::string model_name = "llamacpp";
+    if (options.hasProperty(rt, "model") && options.getProperty(rt, "model").isString()) {
+      model_name = options.getProperty(rt, "model").getString(rt).utf8(rt);
+    }
+
+    return runAsync(rt, [this, contents, encoding_format, add_bos, pooling_type, normalize, use_cache,
+                         dimensions, model_name]() -> AsyncResultBuilder {
+      // Check model and context
+      if (!rn_ctx_ || !rn_ctx_->model || !rn_ctx_->ctx || !rn_ctx_->vocab) {
+        throw std::runtime_error("Embedding error: Model not loaded or context not initialized");
+      }
+
+      const int n_embd = llama_model_n_embd(rn_ctx_->model);
+      enum llama_pooling_type pooling;
+      {
+        std::lock_guard<std::mutex> lock(rn_ctx_->embd_mutex);
+        pooling = rn_resolve_pooling(rn_embedding_context(rn_ctx_), pooling_type);
+      }
+      if (dimensions > n_embd) {
+        throw std::runtime_error("Embedding error: dimensions exceeds the model's " + std::to_string(n_embd));
+      }
+      std::vector<float> embeddings(contents.size() * n_embd);
+
+      // Look the inputs up before tokenizing them; only the misses are embedded
+      std::vector<rn_embedding_key> keys;
+      std::vector<size_t> missing;
+      for (size_t i = 0; i < contents.size(); i++) {
+        if (use_cache) {
+          keys.push_back(rn_embedding_cache::make_key(contents[i], pooling, add_bos));
+          if (rn_ctx_->embedding_cache.get(keys.back(), embeddings.data() + i * n_embd)) {
+            continue;
+          }
+        }
+        missing.push_back(i);
+      }
+
+      // Tokenize the remaining inputs
+      std::vector<std::vector<llama_token>> inputs;
+      inputs.reserve(missing.size());
+      int n_tokens = 0;
+      for (size_t i : missing) {
+        inputs.push_back(common_tokenize(rn_ctx_->vocab, contents[i], add_bos, true));
+        if (inputs.back().empty()) {
+          throw std::runtime_error("Embedding error: No tokens generated from input text");
+        }
+        n_tokens += (int)inputs.back().size();
+      }
+
+      if (!inputs.empty()) {
+        std::vector<float> computed;
+        {
+          // Embeddings have a context of their own, so completions keep running
+          std::lock_guard<std::mutex> lock(rn_ctx_->embd_mutex);
+          computed = rn_embed(rn_ctx_, inputs, pooling, false);
+        }
+
+        for (size_t k = 0; k < missing.size(); k++) {
+          const float* embd = computed.data() + k * n_embd;
+          std::copy(embd, embd + n_embd, embeddings.data() + missing[k] * n_embd);
+          if (use_cache) {
+            rn_ctx_->embedding_cache.put(keys[missing[k]], embd);
+          }
+        }
+      }
+      const int n_cached = (int)(contents.size() - missing.size());
+
+      // Matryoshka models front-load the information, so the leading dimensions
+      // make a smaller embedding; it is normalized after truncation
+      const size_t n_inputs = contents.size();
+      const size_t n_dims = dimensions > 0 ? (size_t)dimensions : (size_t)n_embd;
+      std::vector<float> vectors(n_inputs * n_dims);
+      for (size_t i = 0; i < n_inputs; i++) {
+        float* out = vectors.data() + i * n_dims;
+        std::copy(embeddings.data() + i * n_embd, embeddings.data() + i * n_embd + n_dims, out);
+        if (normalize) {
+          rn_normalize_f32(out, n_dims);
+        }
+      }
+      embeddings.clear();
+
+      // Encode the vectors off the JS thread as well; JS gets typed array views
+      // of the native memory, one row per input
+      std::shared_ptr<jsi::MutableBuffer> buffer;
+      std::vector<std::string> base64_strs;
+      std::vector<float> scales;
+      const char* array_type = "Float32Array";
+      size_t row_size = n_dims; // elements per input
+      size_t element_size = sizeof(float);
+      if (encoding_format == "base64") {
+        for (size_t i = 0; i < n_inputs; i++) {
+          const char* data_ptr = reinterpret_cast<const char*>(vectors.data() + i * n_dims);
+          base64_strs.push_back(base64::encode(data_ptr, n_dims * sizeof(float)));
+        }
+      } else if (encoding_format == "int8") {
+        std::vector<int8_t> codes(n_inputs * n_dims);
+        scales.resize(n_inputs);
+        for (size_t i = 0; i < n_inputs; i++) {
+          scales[i] = rn_quantize_int8(vectors.data() + i * n_dims, n_dims, codes.data() + i * n_dims);
+        }
+        buffer = std::make_shared<VectorBuffer<int8_t>>(std::move(codes));
+        array_type = "Int8Array";
+        element_size = 1;
+      } else if (encoding_format == "binary") {
+        row_size = rn_binary_size(n_dims);
+        std::vector<uint8_t> bits(n_inputs * row_size);
+        for (size_t i = 0; i < n_inputs; i++) {
+          rn_quantize_binary(vectors.data() + i * n_dims, n_dims, bits.data() + i * row_size);
+        }
+        buffer = std::make_shared<VectorBuffer<uint8_t>>(std::move(bits));
+        array_type = "Uint8Array";
+        element_size = 1;
+      } else {
+        buffer = std::make_shared<VectorBuffer<float>>(std::move(vectors));
+      }
+
+      return [buffer, base64_strs = std::move(base64_strs), scales = std::move(scales), n_inputs,
+              n_dims, array_type, row_size, element_size, model_name, n_tokens, n_cached](jsi::Runtime& rt) -> jsi::Value {
+        // Create OpenAI-compatible response
+        jsi::Object response(rt);
+
+        std::unique_ptr<jsi::ArrayBuffer> arrayBuffer;
+        if (buffer) {
+          arrayBuffer = std::make_unique<jsi::ArrayBuffer>(rt, buffer);
+          // Every vector in one row-major array, for callers that handle the batch as a whole
+          response.setProperty(rt, "embeddings", createTypedArray(rt, array_type, *arrayBuffer, 0, n_inputs * row_size));
+        }
+
+        // Add embedding data, one entry per input
+        jsi::Array dataArray(rt, n_inputs);
+        for (size_t i = 0; i < n_inputs; i++) {
+          jsi::Object embeddingObj(rt);
+
+          if (!buffer) {
+            embeddingObj.setProperty(rt, "embedding", jsi::String::createFromUtf8(rt, base64_strs[i]));
+            embeddingObj.setProperty(rt, "encoding_format", jsi::String::createFromUtf8(rt, "base64"));
+          } else {
+            embeddingObj.setProperty(rt, "embedding",
+                                     createTypedArray(rt, array_type, *arrayBuffer, i * row_size * element_size, row_size));
+          }
+          if (!scales.empty()) {
+            // embedding[j] * scale approximates the float value
+            embeddingObj.setProperty(rt, "scale", jsi::Value((double)scales[i]));
+          }
+
+          embeddingObj.setProperty(rt, "object", jsi::String::createFromUtf8(rt, "embedding"));
+          embeddingObj.setProperty(rt, "index", jsi::Value((int)i));
+
+          dataArray.setValueAtIndex(rt, i, embeddingObj);
+        }
+
+        // The vector size, in dimensions rather than bytes for binary embeddings
+        response.setProperty(rt, "dimensions", jsi::Value((int)n_dims));
+
+        // Create usage info
+        jsi::Object usage(rt);
+        usage.setProperty(rt, "prompt_tokens", jsi::Value(n_tokens));
+        usage.setProperty(rt, "total_tokens", jsi::Value(n_tokens));
+        usage.setProperty(rt, "cached_inputs", jsi::Value(n_cached));
+
+        // Assemble the response
+        response.setProperty(rt, "object", jsi::String::createFromUtf8(rt, "list"));
+        response.setProperty(rt, "data", dataArray);
+        response.setProperty(rt, "model", jsi::String::createFromUtf8(rt, model_name));
+        response.setProperty(rt, "usage", usage);
+
+        return response;
       };
+    });
+  } catch (const std::exception& e) {
+    throw jsi::JSError(rt, std::string("Embedding error: ") + e.what());
+  }
+}
+
+jsi::Value LlamaCppModel::rerankJsi(jsi::Runtime& rt, const jsi::Value* args, size_t count) {
+  if (count < 2 || !args[0].isString() || !args[1].isObject() || !args[1].getObject(rt).isArray(rt)) {
+    throw jsi::JSError(rt, "rerank requires a query string and an array of documents");
+  }
 
-      if (llama_decode(rn_ctx_->ctx, batch) != 0) {
-        throw std::runtime_error("Failed to decode token for embedding");
+  try {
+    std::string query = args[0].getString(rt).utf8(rt);
+    jsi::Array docsArray = args[1].getObject(rt).getArray(rt);
+    std::vector<std::string> documents;
+    documents.reserve(docsArray.size(rt));
+    for (size_t i = 0; i < docsArray.size(rt); i++) {
+      jsi::Value doc = docsArray.getValueAtIndex(rt, i);
+      if (!doc.isString()) {
+        throw jsi::JSError(rt, "rerank documents must be strings");
       }
+      documents.push_back(doc.getString(rt).utf8(rt));
     }
 
-    // Get embedding size from the model
-    const int n_embd = llama_model_n_embd(rn_ctx_->model);
-    if (n_embd <= 0) {
-      throw std::runtime_error("Invalid embedding dimension");
+    int top_n = (int)documents.size();
+    if (count > 2 && args[2].isObject()) {
+      SystemUtils::setIfExists(rt, args[2].getObject(rt), "top_n", top_n);
     }
+    top_n = std::max(0, std::min(top_n, (int)documents.size()));
 
-    // For OpenAI compatibility, default to mean pooling
-    enum llama_pooling_type pooling_type = LLAMA_POOLING_TYPE_MEAN;
-    if (options.hasProperty(rt, "pooling") && options.getProperty(rt, "pooling").isString()) {
-      std::string pooling = options.getProperty(rt, "pooling").getString(rt).utf8(rt);
-      if (pooling == "last") {
-        pooling_type = LLAMA_POOLING_TYPE_LAST;
-      } else if (pooling == "cls" || pooling == "first") {
-        pooling_type = LLAMA_POOLING_TYPE_CLS;
+    return runAsync(rt, [this, query, documents, top_n]() -> AsyncResultBuilder {
+      if (!rn_ctx_ || !rn_ctx_->model || !rn_ctx_->ctx || !rn_ctx_->vocab) {
+        throw std::runtime_error("Rerank error: Model not loaded or context not initialized");
       }
-    }
 
-    // Get the embeddings
-    std::vector<float> embedding_vec(n_embd);
-    const float* embd = llama_get_embeddings(rn_ctx_->ctx);
+      std::vector<float> scores;
+      if (!documents.empty()) {
+        std::lock_guard<std::mutex> lock(rn_ctx_->embd_mutex);
+        scores = rn_rerank(rn_ctx_, query, documents);
+      }
 
-    if (!embd) {
-      throw std::runtime_error("Failed to extract embeddings");
-    }
+      // Most relevant first, ties in document order
+      std::vector<size_t> order(documents.size());
+      for (size_t i = 0; i < order.size(); i++) {
+        order[i] = i;
+      }
+      std::stable_sort(order.begin(), order.end(), [&scores](size_t a, size_t b) { return scores[a] > scores[b]; });
+      order.resize(top_n);
+
+      return [scores = std::move(scores), order = std::move(order)](jsi::Runtime& rt) -> jsi::Value {
+        jsi::Array results(rt, order.size());
+        for (size_t i = 0; i < order.size(); i++) {
+          jsi::Object result(rt);
+          result.setProperty(rt, "index", jsi::Value((int)order[i]));
+          result.setProperty(rt, "relevance_score", jsi::Value((double)scores[order[i]]));
+          results.setValueAtIndex(rt, i, result);
+        }
+
+        jsi::Object response(rt);
+        response.setProperty(rt, "results", results);
+        return response;
+      };
+    });
+  } catch (const std::exception& e) {
+    throw jsi::JSError(rt, std::string("Rerank error: ") + e.what());
+  }
+}
 
-    // Copy embeddings to our vector
-    std::copy(embd, embd + n_embd, embedding_vec.begin());
+jsi::Value LlamaCppModel::embeddingCacheStatsJsi(jsi::Runtime& rt, const jsi::Value* args, size_t count) {
+  if (!rn_ctx_) {
+    throw jsi::JSError(rt, "Model not loaded");
+  }
 
-    // Normalize embedding
-    float norm = 0.0f;
-    for (int i = 0; i < n_embd; ++i) {
-      norm += embedding_vec[i] * embedding_vec[i];
-    }
-    norm = std::sqrt(norm);
+  rn_embedding_cache_stats stats = rn_ctx_->embedding_cache.stats();
+  const uint64_t n_lookups = stats.hits + stats.misses;
 
-    if (norm > 0) {
-      for (int i = 0; i < n_embd; ++i) {
-        embedding_vec[i] /= norm;
-      }
+  jsi::Object result(rt);
+  result.setProperty(rt, "hits", jsi::Value((double)stats.hits));
+  result.setProperty(rt, "file_hits", jsi::Value((double)stats.file_hits));
+  result.setProperty(rt, "misses", jsi::Value((double)stats.misses));
+  result.setProperty(rt, "hit_rate", jsi::Value(n_lookups > 0 ? (double)stats.hits / n_lookups : 0.0));
+  result.setProperty(rt, "memory_entries", jsi::Value((double)stats.n_memory));
+  result.setProperty(rt, "file_entries", jsi::Value((double)stats.n_file));
+  return result;
+}
+
+jsi::Value LlamaCppModel::createVectorIndexJsi(jsi::Runtime& rt, const jsi::Value* args, size_t count) {
+  try {
+    rn_vector_index_params params;
+    std::string path;
+
+    // Sized for this model's embeddings unless given
+    if (rn_ctx_ && rn_ctx_->model) {
+      params.dim = llama_model_n_embd(rn_ctx_->model);
     }
 
-    // Create OpenAI-compatible response
-    jsi::Object response(rt);
+    if (count > 0 && args[0].isObject()) {
+      jsi::Object options = args[0].getObject(rt);
+      SystemUtils::setIfExists(rt, options, "dim", params.dim);
+      SystemUtils::setIfExists(rt, options, "M", params.M);
+      SystemUtils::setIfExists(rt, options, "ef_construction", params.ef_construction);
+      SystemUtils::setIfExists(rt, options, "ef_search", params.ef_search);
+      if (SystemUtils::setIfExists(rt, options, "path", path)) {
+        SystemUtils::normalizeFilePath(path);
+      }
 
-    // Add embedding data
-    jsi::Array dataArray(rt, 1);
-    jsi::Object embeddingObj(rt);
+      std::string type;
+      if (SystemUtils::setIfExists(rt, options, "type", type)) {
+        if (type == "hnsw") {
+          params.type = RN_VECTOR_INDEX_HNSW;
+        } else if (type != "flat") {
+          throw std::runtime_error("Unknown vector index type: " + type);
+        }
+      }
 
-    if (encoding_format == "base64") {
-      // Base64 encode the embedding vector
-      const char* data_ptr = reinterpret_cast<const char*>(embedding_vec.data());
-      size_t data_size = embedding_vec.size() * sizeof(float);
-      std::string base64_str = base64::encode(data_ptr, data_size);
+      std::string metric;
+      if (SystemUtils::setIfExists(rt, options, "metric", metric)) {
+        if (metric == "dot") {
+          params.metric = RN_VECTOR_METRIC_DOT;
+        } else if (metric == "l2") {
+          params.metric = RN_VECTOR_METRIC_L2;
+        } else if (metric != "cosine") {
+          throw std::runtime_error("Unknown vector index metric: " + metric);
+        }
+      }
 
-      embeddingObj.setProperty(rt, "embedding", jsi::String::createFromUtf8(rt, base64_str));
-      embeddingObj.setProperty(rt, "encoding_format", jsi::String::createFromUtf8(rt, "base64"));
-    } else {
-      // Create embedding array of floats
-      jsi::Array embeddingArray(rt, n_embd);
-      for (int i = 0; i < n_embd; i++) {
-        embeddingArray.setValueAtIndex(rt, i, jsi::Value(embedding_vec[i]));
+      std::string encoding;
+      if (SystemUtils::setIfExists(rt, options, "encoding", encoding)) {
+        if (encoding == "int8") {
+          params.encoding = RN_VECTOR_ENCODING_INT8;
+        } else if (encoding == "binary") {
+          params.encoding = RN_VECTOR_ENCODING_BINARY;
+        } else if (encoding != "float32") {
+          throw std::runtime_error("Unknown vector index encoding: " + encoding);
+        }
       }
-      embeddingObj.setProperty(rt, "embedding", embeddingArray);
     }
 
-    embeddingObj.setProperty(rt, "object", jsi::String::createFromUtf8(rt, "embedding"));
-    embeddingObj.setProperty(rt, "index", jsi::Value(0));
+    auto index = std::make_shared<rn_vector_index>(params, path);
+    return jsi::Object::createFromHostObject(rt, std::make_shared<LlamaVectorIndex>(index, shared_from_this()));
+  } catch (const std::exception& e) {
+    throw jsi::JSError(rt, e.what());
+  }
+}
 
-    dataArray.setValueAtIndex(rt, 0, embeddingObj);
+size_t LlamaCppModel::saveSession(const std::string& path, int slot) {
+  if (!rn_ctx_ || !rn_ctx_->model || !rn_ctx_->ctx || !rn_ctx_->scheduler) {
+    throw std::runtime_error("Model not loaded or context not initialized");
+  }
 
-    // Create model info
-    std::string model_name = "llamacpp";
-    if (options.hasProperty(rt, "model") && options.getProperty(rt, "model").isString()) {
-      model_name = options.getProperty(rt, "model").getString(rt).utf8(rt);
-    }
+  // Runs between decode steps, so it does not wait for the request queue to drain
+  return rn_ctx_->scheduler->save_session(path, slot);
+}
+
+int LlamaCppModel::loadSession(const std::string& path, int slot) {
+  if (!rn_ctx_ || !rn_ctx_->model || !rn_ctx_->ctx || !rn_ctx_->scheduler) {
+    throw std::runtime_error("Model not loaded or context not initialized");
+  }
 
-    // Create usage info
-    jsi::Object usage(rt);
-    usage.setProperty(rt, "prompt_tokens", jsi::Value((int)tokens.size()));
-    usage.setProperty(rt, "total_tokens", jsi::Value((int)tokens.size()));
+  return rn_ctx_->scheduler->load_session(path, slot);
+}
+
+// Reads the optional { slot } argument of saveSession/loadSession
+static int sessionSlotOption(jsi::Runtime& rt, const jsi::Value* args, size_t count) {
+  if (count < 2 || !args[1].isObject()) {
+    return -1;
+  }
+  jsi::Object options = args[1].getObject(rt);
+  if (!options.hasProperty(rt, "slot") || options.getProperty(rt, "slot").isUndefined()) {
+    return -1;
+  }
+  return (int)options.getProperty(rt, "slot").asNumber();
+}
 
-    // Assemble the response
-    response.setProperty(rt, "object", jsi::String::createFromUtf8(rt, "list"));
-    response.setProperty(rt, "data", dataArray);
-    response.setProperty(rt, "model", jsi::String::createFromUtf8(rt, model_name));
-    response.setProperty(rt, "usage", usage);
+jsi::Value LlamaCppModel::saveSessionJsi(jsi::Runtime& rt, const jsi::Value* args, size_t count) {
+  if (count < 1 || !args[0].isString()) {
+    throw jsi::JSError(rt, "saveSession requires a path string");
+  }
 
-    return response;
+  try {
+    std::string path = args[0].getString(rt).utf8(rt);
+    SystemUtils::normalizeFilePath(path);
+    int slot = sessionSlotOption(rt, args, count);
+
+    return runAsync(rt, [this, path, slot]() -> AsyncResultBuilder {
+      try {
+        saveSession(path, slot);
+      } catch (const std::exception& e) {
+        throw std::runtime_error(std::string("Session save error: ") + e.what());
+      }
+      return [](jsi::Runtime&) -> jsi::Value { return jsi::Value(true); };
+    });
   } catch (const std::exception& e) {
-    throw jsi::JSError(rt, std::string("Embedding error: ") + e.what());
+    throw jsi::JSError(rt, std::string("Session save error: ") + e.what());
   }
 }
 
-jsi::Value LlamaCppModel::releaseJsi(jsi::Runtime& rt, const jsi::Value* args, size_t count) {
+jsi::Value LlamaCppModel::loadSessionJsi(jsi::Runtime& rt, const jsi::Value* args, size_t count) {
+  if (count < 1 || !args[0].isString()) {
+    throw jsi::JSError(rt, "loadSession requires a path string");
+  }
+
   try {
-    release();
-    return jsi::Value(true);
+    std::string path = args[0].getString(rt).utf8(rt);
+    SystemUtils::normalizeFilePath(path);
+    int slot = sessionSlotOption(rt, args, count);
+
+    return runAsync(rt, [this, path, slot]() -> AsyncResultBuilder {
+      int loaded = -1;
+      try {
+        loaded = loadSession(path, slot);
+      } catch (const std::exception& e) {
+        throw std::runtime_error(std::string("Session load error: ") + e.what());
+      }
+      return [loaded](jsi::Runtime&) -> jsi::Value { return jsi::Value(loaded); };
+    });
   } catch (const std::exception& e) {
-    throw jsi::JSError(rt, e.what());
+    throw jsi::JSError(rt, std::string("Session load error: ") + e.what());
   }
 }
 
+jsi::Value LlamaCppModel::stopCompletionJsi(jsi::Runtime& rt, const jsi::Value* args, size_t count) {
+  setShouldStopCompletion(true);
+  return jsi::Value::undefined();
+}
+
+jsi::Value LlamaCppModel::releaseJsi(jsi::Runtime& rt, const jsi::Value* args, size_t count) {
+  // Cancel what is running now and refuse new calls; stopping the scheduler and
+  // waiting for the workers happens off the JS thread
+  const bool first = !released_;
+  released_ = true;
+  setShouldStopCompletion(true);
+
+  auto self = shared_from_this();
+  auto executor = jsi::Function::createFromHostFunction(
+    rt, jsi::PropNameID::forAscii(rt, "executor"), 2,
+    [self, first](jsi::Runtime& runtime, const jsi::Value& thisValue, const jsi::Value* args, size_t count) -> jsi::Value {
+      auto resolve = std::make_shared<jsi::Function>(args[0].asObject(runtime).asFunction(runtime));
+      if (!first) {
+        resolve->call(runtime, jsi::Value::undefined());
+        return jsi::Value::undefined();
+      }
+
+      std::thread([self, resolve = std::move(resolve), &runtime]() mutable {
+        self->release();
+        self->jsInvoker_->invokeAsync([resolve = std::move(resolve), &runtime]() {
+          resolve->call(runtime, jsi::Value::undefined());
+        });
+      }).detach();
+
+      return jsi::Value::undefined();
+    });
+
+  return rt.global().getPropertyAsFunction(rt, "Promise").callAsConstructor(rt, executor);
+}
+
 jsi::Value LlamaCppModel::get(jsi::Runtime& rt, const jsi::PropNameID& name) {
   auto nameStr = name.utf8(rt);
 
+  if (released_ && nameStr != "release" && nameStr != "stopCompletion") {
+    throw jsi::JSError(rt, "Model has been released");
+  }
+
   if (nameStr == "tokenize") {
     return jsi::Function::createFromHostFunction(
       rt, name, 1,
@@ -943,6 +1627,34 @@ jsi::Value LlamaCppModel::get(jsi::Runtime& rt, const jsi::PropNameID& name) {
         return this->embeddingJsi(runtime, args, count);
       });
   }
+  else if (nameStr == "rerank") {
+    return jsi::Function::createFromHostFunction(
+      rt, name, 3,
+      [this](jsi::Runtime& runtime, const jsi::Value& thisValue, const jsi::Value* args, size_t count) {
+        return this->rerankJsi(runtime, args, count);
+      });
+  }
+  else if (nameStr == "saveSession") {
+    return jsi::Function::createFromHostFunction(
+      rt, name, 1,
+      [this](jsi::Runtime& runtime, const jsi::Value& thisValue, const jsi::Value* args, size_t count) {
+        return this->saveSessionJsi(runtime, args, count);
+      });
+  }
+  else if (nameStr == "loadSession") {
+    return jsi::Function::createFromHostFunction(
+      rt, name, 1,
+      [this](jsi::Runtime& runtime, const jsi::Value& thisValue, const jsi::Value* args, size_t count) {
+        return this->loadSessionJsi(runtime, args, count);
+      });
+  }
+  else if (nameStr == "stopCompletion") {
+    return jsi::Function::createFromHostFunction(
+      rt, name, 0,
+      [this](jsi::Runtime& runtime, const jsi::Value& thisValue, const jsi::Value* args, size_t count) {
+        return this->stopCompletionJsi(runtime, args, count);
+      });
+  }
   else if (nameStr == "release") {
     return jsi::Function::createFromHostFunction(
       rt, name, 0,
@@ -950,6 +1662,27 @@ jsi::Value LlamaCppModel::get(jsi::Runtime& rt, const jsi::PropNameID& name) {
         return this->releaseJsi(runtime, args, count);
       });
   }
+  else if (nameStr == "createTokenStream") {
+    return jsi::Function::createFromHostFunction(
+      rt, name, 1,
+      [this](jsi::Runtime& runtime, const jsi::Value& thisValue, const jsi::Value* args, size_t count) {
+        return this->createTokenStreamJsi(runtime, args, count);
+      });
+  }
+  else if (nameStr == "embeddingCacheStats") {
+    return jsi::Function::createFromHostFunction(
+      rt, name, 0,
+      [this](jsi::Runtime& runtime, const jsi::Value& thisValue, const jsi::Value* args, size_t count) {
+        return this->embeddingCacheStatsJsi(runtime, args, count);
+      });
+  }
+  else if (nameStr == "createVectorIndex") {
+    return jsi::Function::createFromHostFunction(
+      rt, name, 1,
+      [this](jsi::Runtime& runtime, const jsi::Value& thisValue, const jsi::Value* args, size_t count) {
+        return this->createVectorIndexJsi(runtime, args, count);
+      });
+  }
   else if (nameStr == "n_vocab") {
     return jsi::Value(getVocabSize());
   }
@@ -974,7 +1707,14 @@ std::vector<jsi::PropNameID> LlamaCppModel::getPropertyNames(jsi::Runtime& rt) {
   result.push_back(jsi::PropNameID::forAscii(rt, "detokenize"));
   result.push_back(jsi::PropNameID::forAscii(rt, "completion"));
   result.push_back(jsi::PropNameID::forAscii(rt, "embedding"));
+  result.push_back(jsi::PropNameID::forAscii(rt, "rerank"));
+  result.push_back(jsi::PropNameID::forAscii(rt, "saveSession"));
+  result.push_back(jsi::PropNameID::forAscii(rt, "loadSession"));
+  result.push_back(jsi::PropNameID::forAscii(rt, "stopCompletion"));
   result.push_back(jsi::PropNameID::forAscii(rt, "release"));
+  result.push_back(jsi::PropNameID::forAscii(rt, "createTokenStream"));
+  result.push_back(jsi::PropNameID::forAscii(rt, "embeddingCacheStats"));
+  result.push_back(jsi::PropNameID::forAscii(rt, "createVectorIndex"));
   result.push_back(jsi::PropNameID::forAscii(rt, "n_vocab"));
   result.push_back(jsi::PropNameID::forAscii(rt, "n_ctx"));
   result.push_back(jsi::PropNameID::forAscii(rt, "n_embd"));
@@ -1,11 +1,15 @@
 #pragma once
 
 #include <jsi/jsi.h>
+#include <ReactCommon/CallInvoker.h>
+#include <condition_variable>
+#include <deque>
 #include <memory>
 #include <mutex>
 #include <string>
 #include <vector>
 #include <unordered_map>
+#include <unordered_set>
 #include <functional>
 
 // Include all necessary common headers from llama.cpp
@@ -20,6 +24,10 @@
 
 namespace facebook::react {
 
+// Workers of the calls other than completions: tokenization, embeddings,
+// sessions and vector index operations
+#define RN_ASYNC_WORKERS 2
+
 // Chat message structure for representing messages in a conversation
 struct Message {
   std::string role;       // Role such as "user", "assistant", "system"
@@ -64,24 +72,29 @@ struct ToolCall {
  * - Tokenization and detokenization
  * - Embedding generation
  *
+ * Completion, tokenization and embedding run on native worker threads and return
+ * Promises; results and streamed tokens are handed back to JS through the CallInvoker.
+ *
  * It leverages native llama.cpp functionality where possible rather than reimplementing it:
  * - Uses common_chat_parse for parsing structured responses (tool calls)
  * - Uses llama_get_embeddings for embedding extraction
  * - Uses common_token_to_piece for token->text conversion
  * - Leverages the llama.cpp chat template system
  */
-class LlamaCppModel : public jsi::HostObject {
+class LlamaCppModel : public jsi::HostObject, public std::enable_shared_from_this<LlamaCppModel> {
 public:
   /**
    * Constructor
    * @param rn_ctx A pointer to an initialized rn_llama_context
+   * @param jsInvoker Invoker used to resolve promises and stream tokens on the JS thread
    */
-  LlamaCppModel(rn_llama_context* rn_ctx);
+  LlamaCppModel(rn_llama_context* rn_ctx, std::shared_ptr<CallInvoker> jsInvoker);
   virtual ~LlamaCppModel();
 
   /**
    * Clean up resources (should be called explicitly)
-   * Frees the llama_model and llama_context
+   * Frees the llama_model and llama_context once the running jobs have returned,
+   * so it must not be called on the JS thread
    */
   void release();
 
@@ -94,6 +107,7 @@ public:
 
   /**
    * Control for active completion state
+   * Setting it to true cancels every completion that is currently running
    */
   bool shouldStopCompletion() const;
   void setShouldStopCompletion(bool value);
@@ -101,16 +115,27 @@ public:
   /**
    * Core completion method that can be called internally
    * Uses run_completion and run_chat_completion from llama.cpp
+   * Blocks until the completion is done, so it must not be called on the JS thread
    *
    * @param options CompletionOptions with all parameters
-   * @param partialCallback Callback for streaming tokens
-   * @param runtime Pointer to JSI runtime for callbacks
+   * @param partialCallback Callback for streaming tokens, called on the calling thread
+   * @param cancel Cancellation token, registered with stopCompletion if not already
    * @return CompletionResult with generated text and metadata
    */
   CompletionResult completion(
       const CompletionOptions& options,
-      std::function<void(jsi::Runtime&, const char*)> partialCallback = nullptr,
-      jsi::Runtime* runtime = nullptr);
+      std::function<void(const CompletionChunk&)> partialCallback = nullptr,
+      std::shared_ptr<rn_cancel_token> cancel = nullptr);
+
+  /**
+   * Persist the KV cache and the tokens it holds to disk, or restore them.
+   * A restored session is reused by the next completion that shares its prefix.
+   *
+   * @param path File path of the session
+   * @return Number of tokens saved or restored
+   */
+  size_t saveSession(const std::string& path, int slot = -1);
+  int loadSession(const std::string& path, int slot = -1);
 
   /**
    * JSI interface implementation
@@ -120,6 +145,9 @@ public:
   std::vector<jsi::PropNameID> getPropertyNames(jsi::Runtime& rt) override;
 
 private:
+  // Vector indexes resolve their promises through runAsync
+  friend class LlamaVectorIndex;
+
   /**
    * JSI method implementations
    */
@@ -127,7 +155,14 @@ private:
   jsi::Value tokenizeJsi(jsi::Runtime& rt, const jsi::Value* args, size_t count);
   jsi::Value detokenizeJsi(jsi::Runtime& rt, const jsi::Value* args, size_t count);
   jsi::Value embeddingJsi(jsi::Runtime& rt, const jsi::Value* args, size_t count);
+  jsi::Value rerankJsi(jsi::Runtime& rt, const jsi::Value* args, size_t count);
+  jsi::Value saveSessionJsi(jsi::Runtime& rt, const jsi::Value* args, size_t count);
+  jsi::Value loadSessionJsi(jsi::Runtime& rt, const jsi::Value* args, size_t count);
+  jsi::Value stopCompletionJsi(jsi::Runtime& rt, const jsi::Value* args, size_t count);
   jsi::Value releaseJsi(jsi::Runtime& rt, const jsi::Value* args, size_t count);
+  jsi::Value createTokenStreamJsi(jsi::Runtime& rt, const jsi::Value* args, size_t count);
+  jsi::Value embeddingCacheStatsJsi(jsi::Runtime& rt, const jsi::Value* args, size_t count);
+  jsi::Value createVectorIndexJsi(jsi::Runtime& rt, const jsi::Value* args, size_t count);
 
   /**
    * Helper to parse completion options from JS object
@@ -146,6 +181,15 @@ private:
    */
   jsi::Value jsonToJsi(jsi::Runtime& rt, const json& j);
 
+  /**
+   * Run work on a worker thread and return a Promise for its result.
+   * The work returns a builder that converts its result to a JSI value on the JS thread;
+   * exceptions thrown by the work reject the promise. Work that blocks until a
+   * completion is done runs on workers of its own, so short calls never queue behind it.
+   */
+  using AsyncResultBuilder = std::function<jsi::Value(jsi::Runtime&)>;
+  jsi::Value runAsync(jsi::Runtime& rt, std::function<AsyncResultBuilder()> work, bool blocking = false);
+
   /**
    * Initialize utility functions and handlers
    */
@@ -154,9 +198,41 @@ private:
   // LLAMA context pointer (owned by the module)
   rn_llama_context* rn_ctx_;
 
-  // Completion state
+  // Invoker for the JS thread
+  std::shared_ptr<CallInvoker> jsInvoker_;
+
+  // Fixed pool of worker threads that run runAsync jobs in order. The threads
+  // share the pool rather than the model, so a job may drop the last reference
+  // to the model.
+  struct WorkerPool {
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::deque<std::function<void()>> queue;
+    bool stopping = false;
+  };
+  static void startWorkers(const std::shared_ptr<WorkerPool>& pool, int n_workers);
+  static void stopWorkers(const std::shared_ptr<WorkerPool>& pool);
+  std::shared_ptr<WorkerPool> pool_;            // short jobs
+  std::shared_ptr<WorkerPool> completion_pool_; // completions, one worker per scheduler slot
+
+  // Set on the JS thread by release; the model then rejects new calls while
+  // the teardown finishes on its own thread
+  bool released_ = false;
+
+  // Jobs queued or running; release() waits for them before freeing the context
+  std::mutex jobs_mutex_;
+  std::condition_variable jobs_cv_;
+  int n_jobs_ = 0;
+
+  // Completion state: cancellation tokens of the running completions
+  std::mutex requests_mutex_;
+  std::unordered_set<std::shared_ptr<rn_cancel_token>> active_requests_;
   bool should_stop_completion_;
-  bool is_predicting_;
+
+  // Token rings handed to JS as ArrayBuffers, looked up by their memory when
+  // passed back as a completion's token_stream
+  std::mutex token_rings_mutex_;
+  std::vector<std::weak_ptr<rn_token_ring>> token_rings_;
 };
 
 } // namespace facebook::react
\ No newline at end of file
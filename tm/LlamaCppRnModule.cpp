@@ -1,5 +1,6 @@
 #include "LlamaCppRnModule.h"
 #include <jsi/jsi.h>
+#include <algorithm>
 #include <functional>
 #include <future>
 #include <memory>
@@ -10,6 +11,7 @@
 #include "SystemUtils.h"
 // Include our custom headers - this was missing!
 #include "rn-llama.hpp"
+#include "rn-embedding.hpp"
 #include "LlamaCppModel.h"
 // Include the llama.cpp common headers
 #include "chat.h"
@@ -162,6 +164,8 @@ jsi::Value LlamaCppRn::initLlama(jsi::Runtime &runtime, jsi::Object options) {
     SystemUtils::setIfExists(runtime, options, "n_batch", params.n_batch);
     SystemUtils::setIfExists(runtime, options, "n_ubatch", params.n_ubatch);
     SystemUtils::setIfExists(runtime, options, "n_keep", params.n_keep);
+    SystemUtils::setIfExists(runtime, options, "n_parallel", params.n_parallel);
+    SystemUtils::setIfExists(runtime, options, "ctx_shift", params.ctx_shift);
 
     // Memory and resource options - MUST respect user settings
     SystemUtils::setIfExists(runtime, options, "use_mmap", params.use_mmap);
@@ -188,6 +192,10 @@ jsi::Value LlamaCppRn::initLlama(jsi::Runtime &runtime, jsi::Object options) {
     // Additional model parameters
     SystemUtils::setIfExists(runtime, options, "logits_file", params.logits_file);
     SystemUtils::setIfExists(runtime, options, "embedding", params.embedding);
+    std::string pooling;
+    if (SystemUtils::setIfExists(runtime, options, "pooling", pooling)) {
+      params.pooling_type = facebook::react::rn_parse_pooling(pooling);
+    }
     SystemUtils::setIfExists(runtime, options, "rope_freq_base", params.rope_freq_base);
     SystemUtils::setIfExists(runtime, options, "rope_freq_scale", params.rope_freq_scale);
 
@@ -211,6 +219,46 @@ jsi::Value LlamaCppRn::initLlama(jsi::Runtime &runtime, jsi::Object options) {
       params.yarn_beta_slow = options.getProperty(runtime, "yarn_beta_slow").asNumber();
     }
 
+    // Speculative decoding with an optional draft model
+    std::string draft_model_path;
+    if (SystemUtils::setIfExists(runtime, options, "draft_model", draft_model_path)) {
+      SystemUtils::normalizeFilePath(draft_model_path);
+      params.speculative.model.path = draft_model_path;
+    }
+    SystemUtils::setIfExists(runtime, options, "n_draft", params.speculative.n_max);
+    SystemUtils::setIfExists(runtime, options, "n_draft_min", params.speculative.n_min);
+    SystemUtils::setIfExists(runtime, options, "p_min", params.speculative.p_min);
+    params.speculative.n_gpu_layers = n_gpu_layers;
+    if (options.hasProperty(runtime, "n_gpu_layers_draft") && gpuSupported) {
+      params.speculative.n_gpu_layers = options.getProperty(runtime, "n_gpu_layers_draft").asNumber();
+    }
+
+    // Prompt lookup decoding drafts from n-gram caches when no draft model is given
+    bool lookup_decoding = false;
+    SystemUtils::setIfExists(runtime, options, "lookup_decoding", lookup_decoding);
+    if (SystemUtils::setIfExists(runtime, options, "lookup_cache_static", params.lookup_cache_static)) {
+      SystemUtils::normalizeFilePath(params.lookup_cache_static);
+    }
+    if (SystemUtils::setIfExists(runtime, options, "lookup_cache_dynamic", params.lookup_cache_dynamic)) {
+      SystemUtils::normalizeFilePath(params.lookup_cache_dynamic);
+    }
+
+    // Embedding cache, persisted to a per-model file when a directory is given
+    std::string embedding_cache_dir;
+    int embedding_cache_size = RN_EMBEDDING_CACHE_SIZE;
+    int embedding_cache_entries = RN_EMBEDDING_CACHE_FILE_ENTRIES;
+    if (SystemUtils::setIfExists(runtime, options, "embedding_cache_dir", embedding_cache_dir)) {
+      SystemUtils::normalizeFilePath(embedding_cache_dir);
+    }
+    SystemUtils::setIfExists(runtime, options, "embedding_cache_size", embedding_cache_size);
+    SystemUtils::setIfExists(runtime, options, "embedding_cache_entries", embedding_cache_entries);
+
+    // Embeddings get a context of their own with a smaller window and thread budget
+    int embedding_n_ctx = 0;
+    int embedding_n_threads = 0;
+    SystemUtils::setIfExists(runtime, options, "embedding_n_ctx", embedding_n_ctx);
+    SystemUtils::setIfExists(runtime, options, "embedding_n_threads", embedding_n_threads);
+
     // Support for chat template override
     std::string chat_template;
     if (SystemUtils::setIfExists(runtime, options, "chat_template", chat_template)) {
@@ -252,12 +300,16 @@ jsi::Value LlamaCppRn::initLlama(jsi::Runtime &runtime, jsi::Object options) {
       throw std::runtime_error("Failed to initialize model and context");
     }
 
-    // Create and initialize rn_llama_context
-    rn_ctx_ = std::make_unique<facebook::react::rn_llama_context>();
-    rn_ctx_->model = result.model.release();
-    rn_ctx_->ctx = result.context.release();
-    rn_ctx_->model_loaded = true;
-    rn_ctx_->vocab = llama_model_get_vocab(rn_ctx_->model);
+    // Everything is built into a local context and owned by RAII holders until
+    // the last step succeeds, so a failed init frees what it loaded and leaves
+    // the previous state untouched. The draft model is declared before the
+    // context so that the scheduler, which uses it, is destroyed first.
+    llama_model_ptr model_dft;
+    auto rn_ctx = std::make_unique<facebook::react::rn_llama_context>();
+    rn_ctx->model = result.model.get();
+    rn_ctx->ctx = result.context.get();
+    rn_ctx->model_loaded = true;
+    rn_ctx->vocab = llama_model_get_vocab(rn_ctx->model);
 
     // Create a rn_common_params from the common_params
     rn_common_params rn_params;
@@ -268,8 +320,10 @@ jsi::Value LlamaCppRn::initLlama(jsi::Runtime &runtime, jsi::Object options) {
     rn_params.reasoning_format = COMMON_REASONING_FORMAT_NONE;
     // Use chatml format by default instead of content-only for better tool support
     rn_params.chat_format = COMMON_CHAT_FORMAT_GENERIC;
+    rn_params.embd_n_ctx = std::max(0, embedding_n_ctx);
+    rn_params.embd_n_threads = std::max(0, embedding_n_threads);
     // Now assign to the context
-    rn_ctx_->params = rn_params;
+    rn_ctx->params = rn_params;
 
     // Initialize chat templates with proper error handling
     try {
@@ -280,27 +334,76 @@ jsi::Value LlamaCppRn::initLlama(jsi::Runtime &runtime, jsi::Object options) {
         SystemUtils::setIfExists(runtime, options, "bos_token", bos_token_override);
         SystemUtils::setIfExists(runtime, options, "eos_token", eos_token_override);
 
-        rn_ctx_->chat_templates = common_chat_templates_init(
-            rn_ctx_->model,
+        rn_ctx->chat_templates = common_chat_templates_init(
+            rn_ctx->model,
             params.chat_template,
             bos_token_override,
             eos_token_override
         );
 
-        if (!rn_ctx_->chat_templates) {
+        if (!rn_ctx->chat_templates) {
             throw std::runtime_error("Failed to initialize chat templates");
         }
     } catch (const std::exception& e) {
         // Log warning and fallback to chatml
         fprintf(stderr, "Warning: Failed to initialize chat template: %s. Falling back to chatml.\n", e.what());
-        rn_ctx_->chat_templates = common_chat_templates_init(rn_ctx_->model, "chatml");
-        if (!rn_ctx_->chat_templates) {
+        rn_ctx->chat_templates = common_chat_templates_init(rn_ctx->model, "chatml");
+        if (!rn_ctx->chat_templates) {
             throw std::runtime_error("Failed to initialize fallback chatml template");
         }
     }
 
-    // Create the model object and return it
-    return createModelObject(runtime, rn_ctx_.get());
+    // Load the draft model used for speculative decoding, if any
+    if (!params.speculative.model.path.empty()) {
+      llama_model_params mparams_dft = common_model_params_to_llama(params);
+      mparams_dft.n_gpu_layers = params.speculative.n_gpu_layers;
+
+      model_dft.reset(llama_model_load_from_file(params.speculative.model.path.c_str(), mparams_dft));
+      rn_ctx->model_dft = model_dft.get();
+      if (!rn_ctx->model_dft) {
+        throw std::runtime_error("Failed to load draft model from file: " + params.speculative.model.path);
+      }
+    }
+
+    // Load the n-gram caches used for prompt lookup decoding
+    if (lookup_decoding && !rn_ctx->model_dft) {
+      rn_ctx->lookup_decoding = true;
+
+      if (!params.lookup_cache_static.empty()) {
+        try {
+          rn_ctx->lookup_cache_static = common_ngram_cache_load(params.lookup_cache_static);
+        } catch (const std::exception& e) {
+          throw std::runtime_error(std::string("Failed to load static lookup cache: ") + e.what());
+        }
+      }
+
+      // The dynamic cache does not exist until the first session has been saved
+      if (!params.lookup_cache_dynamic.empty()) {
+        try {
+          rn_ctx->lookup_cache_dynamic = common_ngram_cache_load(params.lookup_cache_dynamic);
+        } catch (const std::exception&) {
+          rn_ctx->lookup_cache_dynamic.clear();
+        }
+      }
+    }
+
+    try {
+      rn_ctx->embedding_cache.open(rn_ctx->model, embedding_cache_dir,
+                                    std::max(0, embedding_cache_size), std::max(0, embedding_cache_entries));
+    } catch (const std::exception& e) {
+      throw std::runtime_error(std::string("Failed to open embedding cache: ") + e.what());
+    }
+
+    // Start the completion scheduler, one slot per parallel sequence
+    rn_ctx->scheduler = std::make_unique<rn_completion_scheduler>(rn_ctx.get());
+
+    // Create the model object, then hand the context and what it points to over
+    jsi::Object model_object = createModelObject(runtime, rn_ctx.get());
+    result.model.release();
+    result.context.release();
+    model_dft.release();
+    rn_ctx_ = std::move(rn_ctx);
+    return model_object;
   } catch (const std::exception& e) {
     fprintf(stderr, "initLlama error: %s\n", e.what());
     throw jsi::JSError(runtime, e.what());
@@ -308,8 +411,8 @@ jsi::Value LlamaCppRn::initLlama(jsi::Runtime &runtime, jsi::Object options) {
 }
 
 jsi::Object LlamaCppRn::createModelObject(jsi::Runtime& runtime, rn_llama_context* rn_ctx) {
-  // Create a shared_ptr to a new LlamaCppModel instance
-  auto llamaModel = std::make_shared<LlamaCppModel>(rn_ctx);
+  // Create a shared_ptr to a new LlamaCppModel instance; it resolves its promises through our invoker
+  auto llamaModel = std::make_shared<LlamaCppModel>(rn_ctx, jsInvoker_);
 
   // Create a host object from the LlamaCppModel instance
   return jsi::Object::createFromHostObject(runtime, std::move(llamaModel));
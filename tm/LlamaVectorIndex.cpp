@@ -0,0 +1,203 @@
+#include "LlamaVectorIndex.h"
+#include "LlamaCppModel.h"
+#include "SystemUtils.h"
+
+#include <stdexcept>
+#include <string>
+
+namespace facebook::react {
+
+LlamaVectorIndex::LlamaVectorIndex(std::shared_ptr<rn_vector_index> index, std::shared_ptr<LlamaCppModel> model)
+    : index_(std::move(index)), model_(std::move(model)) {}
+
+std::vector<int64_t> LlamaVectorIndex::readIds(jsi::Runtime& rt, const jsi::Value& value) {
+  std::vector<int64_t> ids;
+  if (value.isNumber()) {
+    ids.push_back((int64_t)value.asNumber());
+  } else if (value.isObject() && value.asObject(rt).isArray(rt)) {
+    jsi::Array arr = value.asObject(rt).asArray(rt);
+    ids.resize(arr.size(rt));
+    for (size_t i = 0; i < ids.size(); i++) {
+      ids[i] = (int64_t)arr.getValueAtIndex(rt, i).asNumber();
+    }
+  } else {
+    throw std::runtime_error("ids must be a number or an array of numbers");
+  }
+  return ids;
+}
+
+jsi::Value LlamaVectorIndex::addJsi(jsi::Runtime& rt, const jsi::Value* args, size_t count) {
+  if (count < 2) {
+    throw jsi::JSError(rt, "add requires ids and vectors");
+  }
+
+  try {
+    std::vector<int64_t> ids = readIds(rt, args[0]);
+    std::vector<float> vectors = SystemUtils::readFloatArray(rt, args[1]);
+    const size_t dim = index_->params().dim;
+    if (vectors.size() != ids.size() * dim) {
+      throw std::runtime_error("add expects " + std::to_string(ids.size() * dim) + " floats for " +
+                               std::to_string(ids.size()) + " vectors of dimension " + std::to_string(dim) +
+                               ", got " + std::to_string(vectors.size()));
+    }
+
+    auto index = index_;
+    return model_->runAsync(rt, [index, ids = std::move(ids), vectors = std::move(vectors)]() -> LlamaCppModel::AsyncResultBuilder {
+      index->add(ids.data(), vectors.data(), ids.size());
+      const size_t size = index->size();
+      return [size](jsi::Runtime& rt) -> jsi::Value {
+        return jsi::Value((double)size);
+      };
+    });
+  } catch (const std::exception& e) {
+    throw jsi::JSError(rt, e.what());
+  }
+}
+
+jsi::Value LlamaVectorIndex::removeJsi(jsi::Runtime& rt, const jsi::Value* args, size_t count) {
+  if (count < 1) {
+    throw jsi::JSError(rt, "remove requires ids");
+  }
+
+  try {
+    std::vector<int64_t> ids = readIds(rt, args[0]);
+
+    auto index = index_;
+    return model_->runAsync(rt, [index, ids = std::move(ids)]() -> LlamaCppModel::AsyncResultBuilder {
+      const size_t n_removed = index->remove(ids.data(), ids.size());
+      return [n_removed](jsi::Runtime& rt) -> jsi::Value {
+        return jsi::Value((double)n_removed);
+      };
+    });
+  } catch (const std::exception& e) {
+    throw jsi::JSError(rt, e.what());
+  }
+}
+
+jsi::Value LlamaVectorIndex::searchJsi(jsi::Runtime& rt, const jsi::Value* args, size_t count) {
+  if (count < 1) {
+    throw jsi::JSError(rt, "search requires a query vector");
+  }
+
+  try {
+    std::vector<float> query = SystemUtils::readFloatArray(rt, args[0]);
+    if (query.size() != index_->params().dim) {
+      throw std::runtime_error("search expects a query of dimension " + std::to_string(index_->params().dim) +
+                               ", got " + std::to_string(query.size()));
+    }
+
+    size_t k = 10;
+    if (count > 1 && args[1].isNumber()) {
+      k = (size_t)std::max(0.0, args[1].asNumber());
+    }
+    size_t ef = 0;
+    if (count > 2 && args[2].isObject()) {
+      SystemUtils::setIfExists(rt, args[2].asObject(rt), "ef", ef);
+    }
+
+    auto index = index_;
+    return model_->runAsync(rt, [index, query = std::move(query), k, ef]() -> LlamaCppModel::AsyncResultBuilder {
+      auto matches = std::make_shared<std::vector<rn_vector_match>>(index->search(query.data(), k, ef));
+      return [matches](jsi::Runtime& rt) -> jsi::Value {
+        jsi::Array ids(rt, matches->size());
+        jsi::Array scores(rt, matches->size());
+        for (size_t i = 0; i < matches->size(); i++) {
+          ids.setValueAtIndex(rt, i, jsi::Value((double)(*matches)[i].id));
+          scores.setValueAtIndex(rt, i, jsi::Value((double)(*matches)[i].score));
+        }
+        jsi::Object result(rt);
+        result.setProperty(rt, "ids", ids);
+        result.setProperty(rt, "scores", scores);
+        return result;
+      };
+    });
+  } catch (const std::exception& e) {
+    throw jsi::JSError(rt, e.what());
+  }
+}
+
+jsi::Value LlamaVectorIndex::syncJsi(jsi::Runtime& rt, const jsi::Value* args, size_t count) {
+  try {
+    auto index = index_;
+    return model_->runAsync(rt, [index]() -> LlamaCppModel::AsyncResultBuilder {
+      index->sync();
+      return [](jsi::Runtime& rt) -> jsi::Value {
+        return jsi::Value::undefined();
+      };
+    });
+  } catch (const std::exception& e) {
+    throw jsi::JSError(rt, e.what());
+  }
+}
+
+jsi::Value LlamaVectorIndex::get(jsi::Runtime& rt, const jsi::PropNameID& name) {
+  auto nameStr = name.utf8(rt);
+
+  if (nameStr == "add") {
+    return jsi::Function::createFromHostFunction(
+      rt, name, 2,
+      [this](jsi::Runtime& runtime, const jsi::Value& thisValue, const jsi::Value* args, size_t count) {
+        return this->addJsi(runtime, args, count);
+      });
+  }
+  else if (nameStr == "remove") {
+    return jsi::Function::createFromHostFunction(
+      rt, name, 1,
+      [this](jsi::Runtime& runtime, const jsi::Value& thisValue, const jsi::Value* args, size_t count) {
+        return this->removeJsi(runtime, args, count);
+      });
+  }
+  else if (nameStr == "search") {
+    return jsi::Function::createFromHostFunction(
+      rt, name, 3,
+      [this](jsi::Runtime& runtime, const jsi::Value& thisValue, const jsi::Value* args, size_t count) {
+        return this->searchJsi(runtime, args, count);
+      });
+  }
+  else if (nameStr == "sync") {
+    return jsi::Function::createFromHostFunction(
+      rt, name, 0,
+      [this](jsi::Runtime& runtime, const jsi::Value& thisValue, const jsi::Value* args, size_t count) {
+        return this->syncJsi(runtime, args, count);
+      });
+  }
+  else if (nameStr == "size") {
+    return jsi::Value((double)index_->size());
+  }
+  else if (nameStr == "dim") {
+    return jsi::Value((double)index_->params().dim);
+  }
+  else if (nameStr == "type") {
+    return jsi::String::createFromAscii(rt, index_->params().type == RN_VECTOR_INDEX_HNSW ? "hnsw" : "flat");
+  }
+  else if (nameStr == "metric") {
+    const auto metric = index_->params().metric;
+    return jsi::String::createFromAscii(rt, metric == RN_VECTOR_METRIC_L2 ? "l2" : metric == RN_VECTOR_METRIC_DOT ? "dot" : "cosine");
+  }
+  else if (nameStr == "encoding") {
+    const auto encoding = index_->params().encoding;
+    return jsi::String::createFromAscii(rt, encoding == RN_VECTOR_ENCODING_INT8 ? "int8" : encoding == RN_VECTOR_ENCODING_BINARY ? "binary" : "float32");
+  }
+
+  return jsi::Value::undefined();
+}
+
+void LlamaVectorIndex::set(jsi::Runtime& rt, const jsi::PropNameID& name, const jsi::Value& value) {
+  throw jsi::JSError(rt, "Cannot modify vector index properties");
+}
+
+std::vector<jsi::PropNameID> LlamaVectorIndex::getPropertyNames(jsi::Runtime& rt) {
+  std::vector<jsi::PropNameID> result;
+  result.push_back(jsi::PropNameID::forAscii(rt, "add"));
+  result.push_back(jsi::PropNameID::forAscii(rt, "remove"));
+  result.push_back(jsi::PropNameID::forAscii(rt, "search"));
+  result.push_back(jsi::PropNameID::forAscii(rt, "sync"));
+  result.push_back(jsi::PropNameID::forAscii(rt, "size"));
+  result.push_back(jsi::PropNameID::forAscii(rt, "dim"));
+  result.push_back(jsi::PropNameID::forAscii(rt, "type"));
+  result.push_back(jsi::PropNameID::forAscii(rt, "metric"));
+  result.push_back(jsi::PropNameID::forAscii(rt, "encoding"));
+  return result;
+}
+
+} // namespace facebook::react
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <jsi/jsi.h>
+#include <memory>
+#include <vector>
+
+#include "rn-vector-index.hpp"
+
+namespace facebook::react {
+
+class LlamaCppModel;
+
+/**
+ * LlamaVectorIndex - JSI wrapper around an rn_vector_index
+ *
+ * Created by LlamaCppModel::createVectorIndex. Vectors are copied from
+ * Float32Arrays into native memory once, and searches run on worker threads
+ * without touching the JS heap; only the k results are returned to JS.
+ * Promises are resolved through the model that created the index.
+ */
+class LlamaVectorIndex : public jsi::HostObject {
+public:
+  LlamaVectorIndex(std::shared_ptr<rn_vector_index> index, std::shared_ptr<LlamaCppModel> model);
+
+  jsi::Value get(jsi::Runtime& rt, const jsi::PropNameID& name) override;
+  void set(jsi::Runtime& rt, const jsi::PropNameID& name, const jsi::Value& value) override;
+  std::vector<jsi::PropNameID> getPropertyNames(jsi::Runtime& rt) override;
+
+private:
+  jsi::Value addJsi(jsi::Runtime& rt, const jsi::Value* args, size_t count);
+  jsi::Value removeJsi(jsi::Runtime& rt, const jsi::Value* args, size_t count);
+  jsi::Value searchJsi(jsi::Runtime& rt, const jsi::Value* args, size_t count);
+  jsi::Value syncJsi(jsi::Runtime& rt, const jsi::Value* args, size_t count);
+
+  // Ids of a number or an array of numbers
+  static std::vector<int64_t> readIds(jsi::Runtime& rt, const jsi::Value& value);
+
+  std::shared_ptr<rn_vector_index> index_;
+  std::shared_ptr<LlamaCppModel> model_;
+};
+
+} // namespace facebook::react
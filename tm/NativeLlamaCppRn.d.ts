@@ -16,11 +16,27 @@ export interface LlamaModelParams {
     n_ubatch?: number;
     n_threads?: number;
     n_keep?: number;
+    n_parallel?: number;
+    ctx_shift?: boolean;
+    draft_model?: string;
+    n_draft?: number;
+    n_draft_min?: number;
+    p_min?: number;
+    n_gpu_layers_draft?: number;
+    lookup_decoding?: boolean;
+    lookup_cache_static?: string;
+    lookup_cache_dynamic?: string;
     n_gpu_layers?: number;
     use_mmap?: boolean;
     use_mlock?: boolean;
     vocab_only?: boolean;
     embedding?: boolean;
+    pooling?: 'none' | 'mean' | 'cls' | 'last';
+    embedding_cache_dir?: string;
+    embedding_cache_size?: number;
+    embedding_cache_entries?: number;
+    embedding_n_ctx?: number;
+    embedding_n_threads?: number;
     seed?: number;
     rope_freq_base?: number;
     rope_freq_scale?: number;
@@ -49,6 +65,10 @@ export interface LlamaCompletionParams {
     max_tokens?: number;
     stop?: string[];
     stream?: boolean;
+    stream_flush_tokens?: number;
+    stream_flush_ms?: number;
+    stream_flush_on?: 'none' | 'newline' | 'sentence';
+    token_stream?: ArrayBuffer;
     chat_template?: string;
     tool_choice?: string | 'auto' | 'none';
     tools?: LlamaTool[];
@@ -58,6 +78,31 @@ export interface LlamaCompletionParams {
     presence_penalty?: number;
     seed?: number;
     grammar?: string;
+    grammar_lazy?: boolean;
+    grammar_triggers?: LlamaGrammarTrigger[];
+    n_probs?: number;
+    post_sampling_probs?: boolean;
+}
+export interface LlamaCompletionFrame {
+    token: string;
+    tokens: number[];
+    t_ms: number;
+    completion_probabilities?: LlamaTokenProbabilities[];
+}
+export interface LlamaTokenProbability {
+    id: number;
+    token: string;
+    bytes: number[];
+    logprob?: number;
+    prob?: number;
+}
+export interface LlamaTokenProbabilities extends LlamaTokenProbability {
+    top_logprobs?: LlamaTokenProbability[];
+    top_probs?: LlamaTokenProbability[];
+}
+export interface LlamaGrammarTrigger {
+    type: 'word' | 'pattern' | 'pattern_start' | 'token';
+    value: string | number;
 }
 export interface LlamaMessage {
     role: 'system' | 'user' | 'assistant' | 'tool';
@@ -95,12 +140,30 @@ export interface LlamaTool {
 export interface LlamaCompletionResult {
     text: string;
     tokens_predicted: number;
+    truncated?: boolean;
+    cancelled?: boolean;
+    slot?: number;
+    completion_probabilities?: LlamaTokenProbabilities[];
     timings: {
         predicted_n: number;
         predicted_ms: number;
         prompt_n: number;
+        cache_n: number;
         prompt_ms: number;
+        prompt_per_second: number;
+        predicted_per_second: number;
         total_ms: number;
+        draft_n?: number;
+        draft_n_accepted?: number;
+        draft_acceptance_rate?: number;
+        forced_n?: number;
+        cancel_ms?: number;
+        grammar_ms?: number;
+        grammar_cache_hit?: boolean;
+        grammar_mask_n?: number;
+        grammar_mask_ms?: number;
+        stream_frames?: number;
+        stream_js_ms?: number;
     };
     choices?: Array<{
         index: number;
@@ -131,27 +194,76 @@ export interface EmbeddingOptions {
     input?: string | string[];
     content?: string | string[];
     add_bos_token?: boolean;
-    encoding_format?: 'float' | 'base64';
+    encoding_format?: 'float' | 'base64' | 'int8' | 'binary';
+    dimensions?: number;
+    pooling?: 'mean' | 'cls' | 'first' | 'last';
+    normalize?: boolean;
+    cache?: boolean;
     model?: string;
 }
 export interface EmbeddingResponse {
     data: Array<{
-        embedding: number[] | string;
+        embedding: Float32Array | Int8Array | Uint8Array | string;
         index: number;
         object: 'embedding';
         encoding_format?: 'base64';
+        scale?: number;
     }>;
+    embeddings?: Float32Array | Int8Array | Uint8Array;
+    dimensions: number;
     model: string;
     object: 'list';
     usage: {
         prompt_tokens: number;
         total_tokens: number;
+        cached_inputs?: number;
     };
 }
+export interface VectorIndexOptions {
+    type?: 'flat' | 'hnsw';
+    metric?: 'cosine' | 'dot' | 'l2';
+    encoding?: 'float32' | 'int8' | 'binary';
+    dim?: number;
+    path?: string;
+    M?: number;
+    ef_construction?: number;
+    ef_search?: number;
+}
+export interface VectorIndex {
+    readonly size: number;
+    readonly dim: number;
+    readonly type: 'flat' | 'hnsw';
+    readonly metric: 'cosine' | 'dot' | 'l2';
+    readonly encoding: 'float32' | 'int8' | 'binary';
+    add(ids: number | number[], vectors: Float32Array | number[]): Promise<number>;
+    remove(ids: number | number[]): Promise<number>;
+    search(query: Float32Array | number[], k?: number, options?: {
+        ef?: number;
+    }): Promise<{
+        ids: number[];
+        scores: number[];
+    }>;
+    sync(): Promise<void>;
+}
+export interface RerankOptions {
+    top_n?: number;
+}
+export interface RerankResponse {
+    results: Array<{
+        index: number;
+        relevance_score: number;
+    }>;
+}
+export interface EmbeddingCacheStats {
+    hits: number;
+    file_hits: number;
+    misses: number;
+    hit_rate: number;
+    memory_entries: number;
+    file_entries: number;
+}
 export interface LlamaContextMethods {
-    completion(params: LlamaCompletionParams, partialCallback?: (data: {
-        token: string;
-    }) => void): Promise<LlamaCompletionResult>;
+    completion(params: LlamaCompletionParams, partialCallback?: (data: LlamaCompletionFrame) => void): Promise<LlamaCompletionResult>;
     tokenize(options: {
         content: string;
         add_special?: boolean;
@@ -174,11 +286,22 @@ export interface LlamaContextMethods {
      * @returns Array of embedding values or OpenAI-compatible embedding response
      */
     embedding(options: EmbeddingOptions): Promise<EmbeddingResponse>;
+    rerank(query: string, documents: string[], options?: RerankOptions): Promise<RerankResponse>;
     detectTemplate(messages: LlamaMessage[]): Promise<string>;
-    loadSession(path: string): Promise<boolean>;
-    saveSession(path: string): Promise<boolean>;
+    loadSession(path: string, options?: {
+        slot?: number;
+    }): Promise<number>;
+    saveSession(path: string, options?: {
+        slot?: number;
+    }): Promise<boolean>;
     stopCompletion(): Promise<void>;
     release(): Promise<void>;
+    createTokenStream(options?: {
+        tokens?: number;
+        bytes?: number;
+    }): ArrayBuffer;
+    embeddingCacheStats(): EmbeddingCacheStats;
+    createVectorIndex(options?: VectorIndexOptions): VectorIndex;
 }
 export interface Spec extends TurboModule {
     initLlama(params: LlamaModelParams): Promise<LlamaContextType & LlamaContextMethods>;
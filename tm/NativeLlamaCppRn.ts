@@ -23,6 +23,18 @@ export interface LlamaModelParams {
   n_ubatch?: number;          // micro batch size for prompt processing
   n_threads?: number;         // number of threads (default: number of physical CPU cores)
   n_keep?: number;            // number of tokens to keep from initial promp
+  n_parallel?: number;        // number of completions decoded concurrently, each gets n_ctx / n_parallel (default: 1)
+  ctx_shift?: boolean;        // discard old tokens after n_keep when the context is full instead of stopping (default: true)
+
+  // Speculative decoding parameters
+  draft_model?: string;       // path to a small draft model sharing the vocabulary of the main model
+  n_draft?: number;           // maximum number of tokens drafted per step (default: 16)
+  n_draft_min?: number;       // minimum number of drafted tokens worth verifying (default: 0)
+  p_min?: number;             // minimum draft probability to keep drafting (default: 0.75)
+  n_gpu_layers_draft?: number; // number of draft model layers to store in VRAM (default: n_gpu_layers)
+  lookup_decoding?: boolean;  // draft from n-grams of the prompt and past generations when no draft_model is set
+  lookup_cache_static?: string;  // path to a read-only n-gram cache built from a text corpus
+  lookup_cache_dynamic?: string; // path where n-grams of previous requests are persisted
 
   // GPU acceleration parameters
   n_gpu_layers?: number;      // number of layers to store in VRAM (default: 0)
@@ -34,6 +46,12 @@ export interface LlamaModelParams {
   // Model behavior parameters
   vocab_only?: boolean;       // only load the vocabulary, no weights
   embedding?: boolean;        // use embedding mode (default: false)
+  pooling?: 'none' | 'mean' | 'cls' | 'last' | 'rank'; // pooling done by llama.cpp for embeddings (default: the model's)
+  embedding_cache_dir?: string; // directory of the per-model embedding cache file (default: memory only)
+  embedding_cache_size?: number; // embeddings kept in memory (default: 1024)
+  embedding_cache_entries?: number; // embeddings kept in the cache file (default: 16384)
+  embedding_n_ctx?: number;   // tokens of the separate embedding context (default: min(training context, n_ctx))
+  embedding_n_threads?: number; // threads of the embedding context (default: half of n_threads)
   seed?: number;              // RNG seed for reproducibility
 
   // RoPE parameters
@@ -74,6 +92,12 @@ export interface LlamaCompletionParams {
   max_tokens?: number;         // alias for n_predic
   stop?: string[];             // stop sequences
   stream?: boolean;            // stream tokens as they're generated (default: true)
+  stream_flush_tokens?: number; // send a streaming frame every N tokens
+  stream_flush_ms?: number;    // send a streaming frame once M ms passed since the previous one
+  stream_flush_on?: 'none' | 'newline' | 'sentence'; // send a streaming frame at these boundaries
+                               // (a frame is sent once any condition holds; with none set, every token is a frame)
+  token_stream?: ArrayBuffer;  // ring from createTokenStream that tokens and text are written to;
+                               // frames then carry no data and only signal that the ring advanced
   // Chat parameters
   chat_template?: string;      // optional chat template name to use
 
@@ -88,6 +112,35 @@ export interface LlamaCompletionParams {
   presence_penalty?: number;    // presence penalty (default: 0.0)
   seed?: number;                // RNG seed (default: -1, random)
   grammar?: string;             // GBNF grammar for structured outpu
+  grammar_lazy?: boolean;       // only enforce the grammar once a trigger appears in the output
+  grammar_triggers?: LlamaGrammarTrigger[]; // triggers of a lazy grammar
+  n_probs?: number;             // return the probabilities of the top n_probs tokens at each position (default: 0)
+  post_sampling_probs?: boolean; // report probabilities after the sampler chain instead of raw log-probabilities
+}
+
+export interface LlamaCompletionFrame {
+  token: string;                // text generated since the previous frame
+  tokens: number[];             // ids of the tokens generated since the previous frame
+  t_ms: number;                 // generation time when the frame was sent (ms)
+  completion_probabilities?: LlamaTokenProbabilities[]; // probabilities of those tokens when n_probs > 0
+}
+
+export interface LlamaTokenProbability {
+  id: number;
+  token: string;
+  bytes: number[];              // UTF-8 bytes of the token, which may be an incomplete character
+  logprob?: number;             // log-probability from the model's logits
+  prob?: number;                // probability after sampling, with post_sampling_probs
+}
+
+export interface LlamaTokenProbabilities extends LlamaTokenProbability {
+  top_logprobs?: LlamaTokenProbability[]; // most likely tokens at this position
+  top_probs?: LlamaTokenProbability[];    // same, with post_sampling_probs
+}
+
+export interface LlamaGrammarTrigger {
+  type: 'word' | 'pattern' | 'pattern_start' | 'token';
+  value: string | number;       // text, regex, or token id / single-token text for 'token'
 }
 
 export interface LlamaMessage {
@@ -132,12 +185,30 @@ export interface LlamaTool {
 export interface LlamaCompletionResult {
   text: string;                          // The generated completion tex
   tokens_predicted: number;              // Number of tokens generated
+  truncated?: boolean;                   // The prompt or context was shifted to fit n_ctx
+  cancelled?: boolean;                   // Stopped early by stopCompletion
+  slot?: number;                         // Slot the request ran in, for saveSession
+  completion_probabilities?: LlamaTokenProbabilities[]; // One entry per generated token when n_probs > 0
   timings: {
     predicted_n: number;                 // Number of tokens predicted
     predicted_ms: number;                // Time spent generating tokens (ms)
-    prompt_n: number;                    // Number of tokens in the promp
+    prompt_n: number;                    // Number of prompt tokens evaluated
+    cache_n: number;                     // Number of prompt tokens reused from the KV cache
     prompt_ms: number;                   // Time spent processing prompt (ms)
+    prompt_per_second: number;           // Prompt processing speed (tokens/s)
+    predicted_per_second: number;        // Generation speed (tokens/s)
     total_ms: number;                    // Total time spent (ms)
+    draft_n?: number;                    // Number of drafted tokens (speculative decoding)
+    draft_n_accepted?: number;           // Number of drafted tokens accepted
+    draft_acceptance_rate?: number;      // draft_n_accepted / draft_n
+    forced_n?: number;                   // Tokens forced by the grammar and decoded without sampling
+    cancel_ms?: number;                  // Time from stopCompletion until generation stopped (ms)
+    grammar_ms?: number;                 // Time spent preparing the grammar (ms)
+    grammar_cache_hit?: boolean;         // The grammar was reused from an earlier request
+    grammar_mask_n?: number;             // Sampled tokens the grammar rejected and that were resampled
+    grammar_mask_ms?: number;            // Time spent masking the vocabulary for those tokens (ms)
+    stream_frames?: number;              // Streaming frames delivered to the partial callback
+    stream_js_ms?: number;               // JS thread time spent delivering them (ms)
   };
 
   // OpenAI-compatible response fields
@@ -174,27 +245,82 @@ export interface EmbeddingOptions {
   input?: string | string[];      // Text input to embed (OpenAI format)
   content?: string | string[];    // Alternative text input (custom format)
   add_bos_token?: boolean;        // Whether to add a beginning of sequence token (default: true)
-  encoding_format?: 'float' | 'base64'; // Output encoding forma
+  encoding_format?: 'float' | 'base64' | 'int8' | 'binary'; // Output encoding forma
+  dimensions?: number;            // keep the leading dimensions of a Matryoshka embedding (default: n_embd)
+  pooling?: 'mean' | 'cls' | 'first' | 'last'; // Pooling of the token embeddings (default: the context's, or mean)
+  normalize?: boolean;            // L2-normalize the vectors (default: true)
+  cache?: boolean;                // Reuse and store vectors in the embedding cache (default: true)
   model?: string;                 // Model identifier (ignored, included for OpenAI compatibility)
 }
 
 export interface EmbeddingResponse {
   data: Array<{
-    embedding: number[] | string; // Can be array of numbers or base64 string
+    embedding: Float32Array | Int8Array | Uint8Array | string; // View of the native vector, or base64 string
     index: number;
     object: 'embedding';
     encoding_format?: 'base64';   // Present only when base64 encoding is used
+    scale?: number;               // int8 only: embedding[j] * scale approximates the float value
   }>;
+  embeddings?: Float32Array | Int8Array | Uint8Array; // every vector in input order (not with base64)
+  dimensions: number;             // dimensions of each vector
   model: string;
   object: 'list';
   usage: {
     prompt_tokens: number;
     total_tokens: number;
+    cached_inputs?: number;       // inputs served from the embedding cache
   };
 }
 
+export interface RerankOptions {
+  top_n?: number;                 // return only the n most relevant documents (default: all)
+}
+
+export interface RerankResponse {
+  results: Array<{
+    index: number;                // position of the document in the input array
+    relevance_score: number;      // score from the reranker head, higher is more relevant
+  }>;                             // most relevant first
+}
+
+export interface EmbeddingCacheStats {
+  hits: number;
+  file_hits: number;              // hits read from the cache file
+  misses: number;
+  hit_rate: number;
+  memory_entries: number;
+  file_entries: number;
+}
+
+export interface VectorIndexOptions {
+  type?: 'flat' | 'hnsw';         // exact scan or approximate graph search (default: 'flat')
+  metric?: 'cosine' | 'dot' | 'l2'; // default: 'cosine'
+  encoding?: 'float32' | 'int8' | 'binary'; // how vectors are stored (default: 'float32')
+  dim?: number;                   // vector dimension (default: the model's n_embd)
+  path?: string;                  // memory-mapped file the index is stored in; opened if it exists
+  M?: number;                     // HNSW links per node (default: 16)
+  ef_construction?: number;       // HNSW candidates when adding (default: 200)
+  ef_search?: number;             // HNSW candidates when searching (default: 64)
+}
+
+export interface VectorIndex {
+  readonly size: number;
+  readonly dim: number;
+  readonly type: 'flat' | 'hnsw';
+  readonly metric: 'cosine' | 'dot' | 'l2';
+  readonly encoding: 'float32' | 'int8' | 'binary';
+  // Add vectors (ids.length * dim floats); an existing id is replaced. Resolves to the new size.
+  add(ids: number | number[], vectors: Float32Array | number[]): Promise<number>;
+  // Resolves to how many of the ids were in the index
+  remove(ids: number | number[]): Promise<number>;
+  // The k closest vectors, best first; scores are similarities for cosine and dot, distances for l2
+  search(query: Float32Array | number[], k?: number, options?: { ef?: number }): Promise<{ ids: number[]; scores: number[] }>;
+  // Write a file-backed index to storage
+  sync(): Promise<void>;
+}
+
 export interface LlamaContextMethods {
-  completion(params: LlamaCompletionParams, partialCallback?: (data: {token: string}) => void): Promise<LlamaCompletionResult>;
+  completion(params: LlamaCompletionParams, partialCallback?: (data: LlamaCompletionFrame) => void): Promise<LlamaCompletionResult>;
 
   // Updated tokenize method to match server.cpp interface
   tokenize(options: {
@@ -219,11 +345,29 @@ export interface LlamaContextMethods {
    * @returns Array of embedding values or OpenAI-compatible embedding response
    */
   embedding(options: EmbeddingOptions): Promise<EmbeddingResponse>;
+  // Score documents against a query with a reranker model loaded with rank pooling
+  rerank(query: string, documents: string[], options?: RerankOptions): Promise<RerankResponse>;
   detectTemplate(messages: LlamaMessage[]): Promise<string>;
-  loadSession(path: string): Promise<boolean>;
-  saveSession(path: string): Promise<boolean>;
+  loadSession(path: string, options?: { slot?: number }): Promise<number>;
+  saveSession(path: string, options?: { slot?: number }): Promise<boolean>;
   stopCompletion(): Promise<void>;
   release(): Promise<void>;
+
+  /**
+   * Create a ring buffer a completion can stream into without a JS call per token.
+   * The buffer starts with a Uint32 header [magic, version, token_capacity, byte_capacity,
+   * token_write, byte_write, state, sequence], followed by token_capacity Int32 token ids,
+   * token_capacity Uint32 values of byte_write after each token, and byte_capacity UTF-8 bytes.
+   * Token i is at i % token_capacity and byte b at b % byte_capacity; state is 0 idle,
+   * 1 running, 2 done, 3 failed. A reader more than a capacity behind has lost the oldest data.
+   */
+  createTokenStream(options?: { tokens?: number; bytes?: number }): ArrayBuffer;
+
+  // Lookups of the embedding cache since the model was loaded
+  embeddingCacheStats(): EmbeddingCacheStats;
+
+  // Native index of embedding vectors searched by similarity
+  createVectorIndex(options?: VectorIndexOptions): VectorIndex;
 }
 
 export interface Spec extends TurboModule {
@@ -5,6 +5,8 @@
 #include <string>
 #include <sstream>
 #include <cinttypes> // For PRId64 macros
+#include <cstring>
+#include <stdexcept>
 
 // Platform-specific includes
 #if defined(__APPLE__)
@@ -177,4 +179,39 @@ bool SystemUtils::setIfExists(jsi::Runtime& rt, const jsi::Object& options, cons
   return false;
 }
 
+std::vector<float> SystemUtils::readFloatArray(jsi::Runtime& rt, const jsi::Value& value) {
+  if (!value.isObject()) {
+    throw std::runtime_error("Expected a Float32Array or an array of numbers");
+  }
+  jsi::Object obj = value.asObject(rt);
+
+  if (obj.isArray(rt)) {
+    jsi::Array arr = obj.asArray(rt);
+    std::vector<float> result(arr.size(rt));
+    for (size_t i = 0; i < result.size(); ++i) {
+      result[i] = (float)arr.getValueAtIndex(rt, i).asNumber();
+    }
+    return result;
+  }
+
+  // A Float32Array is a view of length floats at byteOffset of its buffer. Other
+  // 4-byte views such as Int32Array would be reinterpreted, so they are refused.
+  jsi::Function float32Array = rt.global().getPropertyAsFunction(rt, "Float32Array");
+  jsi::Value buffer = obj.getProperty(rt, "buffer");
+  if (!obj.instanceOf(rt, float32Array) || !buffer.isObject() || !buffer.asObject(rt).isArrayBuffer(rt)) {
+    throw std::runtime_error("Expected a Float32Array or an array of numbers");
+  }
+  jsi::ArrayBuffer arrayBuffer = buffer.asObject(rt).getArrayBuffer(rt);
+  const double offset = obj.getProperty(rt, "byteOffset").asNumber();
+  const double length = obj.getProperty(rt, "length").asNumber();
+  if (!(offset >= 0) || !(length >= 0) || offset + length * sizeof(float) > (double)arrayBuffer.size(rt)) {
+    throw std::runtime_error("Float32Array lies outside of its buffer");
+  }
+  const uint8_t* data = arrayBuffer.data(rt) + (size_t)offset;
+
+  std::vector<float> result((size_t)length);
+  std::memcpy(result.data(), data, result.size() * sizeof(float));
+  return result;
+}
+
 } // namespace facebook::react
\ No newline at end of file
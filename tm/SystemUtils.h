@@ -69,6 +69,12 @@ public:
 
   // Specialized version for vector
   static bool setIfExists(jsi::Runtime& rt, const jsi::Object& options, const std::string& key, std::vector<jsi::Value>& outValue);
+
+  /**
+   * Copy the floats of a Float32Array, read straight from its buffer, or of an array of numbers.
+   * Throws std::runtime_error for other values.
+   */
+  static std::vector<float> readFloatArray(jsi::Runtime& rt, const jsi::Value& value);
 };
 
 } // namespace facebook::react
\ No newline at end of file
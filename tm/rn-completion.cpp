@@ -4,14 +4,26 @@
 #include "chat.h"
 #include "llama.h"
 #include "sampling.h"
+#include "speculative.h"
 #include "rn-utils.hpp"
-
+#include "rn-stop-matcher.hpp"
+#include "rn-session.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
 #include <string>
 #include <vector>
 #include <thread>
 #include <functional>
 #include <mutex>
 #include <condition_variable>
+#include <deque>
+#include <future>
+#include <memory>
+#include <cmath>
 #include <random>
 
 namespace facebook::react {
@@ -30,13 +42,24 @@ struct completion_state {
 
     int n_past = 0;
     int n_ctx = 0;
+    int n_keep = 0;        // prompt tokens that are never discarded by a context shift
+    bool ctx_shift = false;
     int n_predict = 0;
     int n_decoded = 0;
     int n_remaining = 0;
 
     size_t n_sent_text = 0;
+    size_t n_sent_tokens = 0;
     size_t last_nl_pos = 0;
 
+    // Streaming frame policy, see CompletionOptions
+    int flush_tokens = 0;
+    int64_t flush_us = 0;
+    rn_stream_boundary flush_boundary = RN_STREAM_BOUNDARY_NONE;
+    int64_t t_last_flush = 0;
+    bool flush_pending = false;  // a boundary was generated but its text is held back
+    rn_token_ring* ring = nullptr; // written instead of the frames' text and tokens when set
+
     std::string prompt;
     std::string generated_text;
     std::string stopping_word;
@@ -46,7 +69,45 @@ struct completion_state {
     std::vector<llama_token> generated_tokens;
 
     common_sampler* sampler = nullptr;
+    llama_sampler_ptr grammar;                 // applied on top of the sampler, null when unconstrained
+    std::vector<uint64_t> grammar_mask;        // tokens accepted by the grammar in its slow path
+    bool grammar_single_prefix = false;        // the last sampled token's mask allowed one prefix only
+    bool grammar_forced_prev = true;           // the last probe found forced text; the grammar's start is probed
+    int n_grammar_masks = 0;
+    int64_t t_grammar_mask_us = 0;
     std::vector<std::string> antiprompt; // Storing stop words here
+    rn_stop_matcher stop_matcher;        // built from antiprompt, fed each new token's text
+    bool ignore_eos = false;
+
+    // Token probabilities, reported when n_probs > 0
+    int n_probs = 0;
+    bool post_sampling_probs = false;
+    std::vector<CompletionTokenProbs> probs; // one entry per generated token
+    size_t n_sent_probs = 0;
+    std::vector<std::pair<float, llama_token>> top_heap;
+
+    // Scheduling state
+    llama_seq_id seq_id = 0;
+    bool prompt_done = false;
+    int n_batch_tokens = 0;                   // tokens of this sequence in the current batch
+    int i_batch = -1;                         // index of this sequence's logits in the current batch
+    llama_token next_token = LLAMA_TOKEN_NULL; // sampled token waiting to be decoded
+    std::vector<llama_token> draft;           // drafted tokens decoded after next_token
+    std::vector<llama_token> forced;          // tokens forced by the grammar, decoded after next_token without sampling
+    int n_batch_forced = 0;                   // forced tokens of this sequence in the current batch
+    int n_forced_total = 0;
+
+    // Speculative decoding statistics
+    int n_draft_total = 0;
+    int n_draft_accepted = 0;
+
+    // Prompt lookup decoding: every token seen so far (prompt, generation and
+    // next_token) and the n-gram cache built over them
+    std::vector<llama_token> lookup_tokens;
+    common_ngram_cache lookup_context;
+
+    int64_t t_start_prompt = 0;
+    int64_t t_start_generation = 0;
 
     // Chat format and tools info
     common_chat_format chat_format = COMMON_CHAT_FORMAT_CONTENT_ONLY;  // Store the chat format for proper parsing
@@ -61,48 +122,25 @@ struct completion_state {
 };
 
 // Helper function to check for stopping criteria
-static bool check_stop_conditions(
-    completion_state& state,
-    const std::vector<std::string>& stop_words,
-    const std::string& token_text,
-    bool ignore_eos) {
-
+static bool check_stop_conditions(completion_state& state, const std::string& token_text) {
     if (state.n_remaining <= 0) {
         state.has_next_token = false;
         return true;
     }
 
-    // Check for stopping strings
-    size_t stop_pos = std::string::npos;
-
-    for (const std::string & word : stop_words) {
-        size_t pos = state.generated_text.find(word, state.n_sent_text > 0 ? state.n_sent_text - 1 : 0);
-        if (pos != std::string::npos && (stop_pos == std::string::npos || pos < stop_pos)) {
-            state.stopping_word = word;
-            state.has_next_token = false;
-            stop_pos = pos;
-        }
-    }
-
-    if (stop_pos != std::string::npos) {
-        state.generated_text.erase(
-            state.generated_text.begin() + stop_pos,
-            state.generated_text.end()
-        );
+    // Check for stopping strings in the text added by this token only
+    size_t stop_pos = 0;
+    size_t stop_word = 0;
+    if (state.stop_matcher.feed(token_text.data(), token_text.size(), stop_pos, stop_word)) {
+        state.stopping_word = state.stop_matcher.word(stop_word);
+        state.has_next_token = false;
+        state.generated_text.erase(stop_pos);
         state.stop_found = true;
         return true;
     }
 
-    // Check for partial stop strings at the end
-    for (const std::string & word : stop_words) {
-        if (size_t partial_pos = find_partial_stop_string(word, state.generated_text);
-            partial_pos != std::string::npos) {
-            return false; // Don't send token yet, wait for full stop word
-        }
-    }
-
-    // Check if context is full
-    if (state.n_past >= state.n_ctx) {
+    // Check if context is full and cannot be shifted
+    if (!state.ctx_shift && state.n_past >= state.n_ctx) {
         state.truncated = true;
         state.has_next_token = false;
         return true;
@@ -116,57 +154,925 @@ static bool check_stop_conditions(
     return false;
 }
 
-CompletionResult run_completion(
-    rn_llama_context* rn_ctx,
-    const CompletionOptions& options,
-    std::function<bool(const std::string&, bool)> callback) {
+// A completion request handed from the submitting thread to the scheduler thread
+struct completion_task {
+    CompletionOptions options;
+    std::vector<llama_token> prompt_tokens;
+    bool stream = false;
+    std::shared_ptr<rn_cancel_token> cancel;
+    llama_sampler_ptr grammar;  // built on the submitting thread, moved into the state
 
+    std::unique_ptr<completion_state> state;  // owned by the scheduler thread while running
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::deque<CompletionChunk> chunks;  // streamed text not yet passed to the callback
+    bool done = false;
     CompletionResult result;
-    completion_state state;
+};
 
-    if (!rn_ctx || !rn_ctx->model || !rn_ctx->ctx) {
-        result.success = false;
-        result.error_msg = "Model not initialized";
-        result.error_type = RN_ERROR_MODEL_LOAD;
-        return result;
+// One sequence of the shared context
+struct completion_slot {
+    llama_seq_id id = 0;
+    std::shared_ptr<completion_task> task;  // null while the slot is idle
+    int64_t t_last_used = 0;
+
+    // Draft context used for speculative decoding, if a draft model is loaded
+    llama_context* ctx_dft = nullptr;
+    common_speculative* spec = nullptr;
+};
+
+// Keep the longest common prefix between the tokens already in the KV cache of
+// the sequence and the new prompt, dropping only the diverging tail. Returns the
+// number of prompt tokens that do not need to be decoded again.
+static int reuse_cached_prefix(rn_llama_context* rn_ctx, llama_seq_id seq_id, const std::vector<llama_token>& prompt_tokens) {
+    auto& cache_tokens = rn_ctx->cache_tokens[seq_id];
+    size_t n_reuse = common_lcp(cache_tokens, prompt_tokens);
+
+    // The last prompt token is always decoded again so that there are logits to sample from
+    if (n_reuse >= prompt_tokens.size()) {
+        n_reuse = prompt_tokens.size() - 1;
+    }
+
+    // Some memory types (e.g. recurrent models) cannot drop a partial range
+    if (!llama_kv_self_seq_rm(rn_ctx->ctx, seq_id, n_reuse, -1)) {
+        llama_kv_self_seq_rm(rn_ctx->ctx, seq_id, -1, -1);
+        n_reuse = 0;
+    }
+
+    cache_tokens.resize(n_reuse);
+    return (int)n_reuse;
+}
+
+// Make room in a full sequence by discarding the oldest half of the tokens after
+// the first n_keep and moving the remaining ones back, so that generation can
+// continue without evaluating the context again
+static void shift_context(rn_llama_context* rn_ctx, llama_seq_id seq_id, completion_state& state) {
+    auto& cache_tokens = rn_ctx->cache_tokens[seq_id];
+
+    const int n_keep = std::min(state.n_keep, state.n_past - 1);
+    const int n_left = state.n_past - n_keep;
+    const int n_discard = n_left / 2;
+
+    llama_kv_self_seq_rm(rn_ctx->ctx, seq_id, n_keep, n_keep + n_discard);
+    llama_kv_self_seq_add(rn_ctx->ctx, seq_id, n_keep + n_discard, state.n_past, -n_discard);
+
+    cache_tokens.erase(cache_tokens.begin() + n_keep, cache_tokens.begin() + n_keep + n_discard);
+    state.n_past -= n_discard;
+    state.truncated = true;
+}
+
+// Take the streamed text, tokens and token probabilities that were not sent
+// yet, up to n_send_end bytes of the generated text
+static CompletionChunk take_chunk(completion_state& state, size_t n_send_end) {
+    const int64_t t_now = ggml_time_us();
+
+    // With a ring the frame is only a notification, its data is already in the ring
+    CompletionChunk chunk;
+    if (!state.ring) {
+        chunk.text = state.generated_text.substr(state.n_sent_text, n_send_end - state.n_sent_text);
+        state.n_sent_text = n_send_end;
+
+        chunk.tokens.assign(state.generated_tokens.begin() + state.n_sent_tokens, state.generated_tokens.end());
+        chunk.probs.assign(state.probs.begin() + state.n_sent_probs, state.probs.end());
+    }
+    state.n_sent_tokens = state.generated_tokens.size();
+    state.n_sent_probs = state.probs.size();
+
+    chunk.t_ms = (t_now - state.t_start_generation) / 1000.0;
+    state.t_last_flush = t_now;
+    state.flush_pending = false;
+    return chunk;
+}
+
+static bool ends_frame(rn_stream_boundary boundary, const std::string& token_text) {
+    switch (boundary) {
+        case RN_STREAM_BOUNDARY_NEWLINE:
+            return token_text.find('\n') != std::string::npos;
+        case RN_STREAM_BOUNDARY_SENTENCE:
+            return token_text.find_first_of("\n.!?") != std::string::npos
+                || token_text.find("\u3002") != std::string::npos   // ideographic full stop
+                || token_text.find("\uff01") != std::string::npos   // fullwidth exclamation mark
+                || token_text.find("\uff1f") != std::string::npos;  // fullwidth question mark
+        default:
+            return false;
+    }
+}
+
+// Whether the frame in progress should be sent after a token with token_text.
+// Frames are only checked when a token arrives, so a time limit can be exceeded
+// by up to one token's latency.
+static bool should_flush(completion_state& state, const std::string& token_text) {
+    if (state.flush_tokens <= 0 && state.flush_us <= 0 && state.flush_boundary == RN_STREAM_BOUNDARY_NONE) {
+        return true;
+    }
+
+    state.flush_pending = state.flush_pending || ends_frame(state.flush_boundary, token_text);
+
+    const int n_pending = (int)(state.generated_tokens.size() - state.n_sent_tokens);
+    return state.flush_pending
+        || (state.flush_tokens > 0 && n_pending >= state.flush_tokens)
+        || (state.flush_us > 0 && ggml_time_us() - state.t_last_flush >= state.flush_us);
+}
+
+// Add the next sampled token to the generated text and evaluate the stopping
+// criteria. probs holds the token's probabilities when they were requested,
+// and is null for tokens forced by the grammar. Returns false once the request
+// is finished.
+static bool process_token(completion_state& state, completion_task& task, llama_token token_id,
+                          const CompletionTokenProbs* probs = nullptr) {
+    const llama_vocab* vocab = state.rn_ctx->vocab;
+
+    // Check for EOS token if not ignoring
+    if (!state.ignore_eos && llama_vocab_is_eog(vocab, token_id)) {
+        state.has_next_token = false;
+        return false;
+    }
+
+    // Extract the token text
+    std::string token_text = common_token_to_piece(vocab, token_id);
+
+    // Add to generated text
+    state.generated_text += token_text;
+    state.generated_tokens.push_back(token_id);
+
+    if (state.n_probs > 0) {
+        if (probs) {
+            state.probs.push_back(*probs);
+        } else {
+            // The grammar allowed no other token
+            CompletionTokenProbs forced;
+            forced.token = { token_id, token_text, state.post_sampling_probs ? 1.0f : 0.0f };
+            forced.top.push_back(forced.token);
+            state.probs.push_back(std::move(forced));
+        }
+    }
+
+    // Update state
+    state.n_decoded++;
+    state.n_remaining--;
+
+    // Check stopping conditions
+    bool should_stop = check_stop_conditions(state, token_text);
+
+    // Handle stream mode, holding back text that may turn out to be the start of a
+    // stop string and coalescing tokens into frames
+    // A stop string erases text the matcher has already seen, so its partial
+    // match can be longer than what is left
+    const size_t n_held = std::min(state.stop_matcher.partial_length(), state.generated_text.size());
+    const size_t n_send_end = state.generated_text.size() - n_held;
+    if (state.ring) {
+        if (!should_stop && n_send_end > state.n_sent_text) {
+            state.ring->write_text(state.generated_text.data() + state.n_sent_text, n_send_end - state.n_sent_text);
+            state.n_sent_text = n_send_end;
+        }
+        state.ring->write_token(token_id);
+    }
+
+    const bool has_new_data = state.ring ? state.generated_tokens.size() > state.n_sent_tokens : n_send_end > state.n_sent_text;
+    if (task.stream && !should_stop && should_flush(state, token_text) && has_new_data) {
+        CompletionChunk chunk = take_chunk(state, n_send_end);
+
+        std::lock_guard<std::mutex> lock(task.mutex);
+        task.chunks.push_back(std::move(chunk));
+        task.cv.notify_one();
+    }
+
+    if (should_stop) {
+        state.has_next_token = false;
+        return false;
+    }
+
+    return true;
+}
+
+static bool grammar_accepts(completion_state& state, llama_token id) {
+    llama_token_data single = { id, 1.0f, 0.0f };
+    llama_token_data_array single_p = { &single, 1, -1, false };
+    llama_sampler_apply(state.grammar.get(), &single_p);
+    return single.logit != -INFINITY;
+}
+
+// Log-probabilities of the n_probs most likely tokens at batch index idx, from
+// the model's logits before any sampling. The top tokens are selected with a
+// bounded min-heap in one pass over the vocabulary, which is never sorted; the
+// sampled token's log-probability is filled in by set_sampled_prob.
+static void logit_probs(completion_state& state, llama_context* ctx, int idx, CompletionTokenProbs& probs) {
+    const llama_vocab* vocab = state.rn_ctx->vocab;
+    const float* logits = llama_get_logits_ith(ctx, idx);
+    const int n_vocab = llama_vocab_n_tokens(vocab);
+    const size_t n_top = std::min(state.n_probs, n_vocab);
+
+    auto& heap = state.top_heap;
+    heap.clear();
+
+    float max_logit = -INFINITY;
+    for (llama_token token = 0; token < n_vocab; ++token) {
+        const float logit = logits[token];
+        max_logit = std::max(max_logit, logit);
+
+        if (heap.size() < n_top) {
+            heap.emplace_back(logit, token);
+            std::push_heap(heap.begin(), heap.end(), std::greater<>());
+        } else if (logit > heap.front().first) {
+            std::pop_heap(heap.begin(), heap.end(), std::greater<>());
+            heap.back() = { logit, token };
+            std::push_heap(heap.begin(), heap.end(), std::greater<>());
+        }
+    }
+
+    double sum = 0.0;
+    for (llama_token token = 0; token < n_vocab; ++token) {
+        sum += std::exp(logits[token] - max_logit);
+    }
+    const float log_z = max_logit + (float)std::log(sum);
+
+    // Sorting the heap with the same comparator leaves the most likely token first
+    std::sort_heap(heap.begin(), heap.end(), std::greater<>());
+    probs.top.clear();
+    for (const auto& [logit, token] : heap) {
+        probs.top.push_back({ token, common_token_to_piece(vocab, token), logit - log_z });
+    }
+    // Keep the normalizer for the sampled token, which is only known after sampling
+    probs.token = { LLAMA_TOKEN_NULL, "", log_z };
+}
+
+// Fill in the sampled token's probability: from the raw logits, or with
+// post_sampling_probs from the sampler's final candidates, whose n_probs most
+// likely entries become the alternatives
+static void set_sampled_prob(completion_state& state, llama_context* ctx, int idx, llama_token id, CompletionTokenProbs& probs) {
+    const llama_vocab* vocab = state.rn_ctx->vocab;
+
+    if (!state.post_sampling_probs) {
+        const float log_z = probs.token.value;
+        probs.token = { id, common_token_to_piece(vocab, id), llama_get_logits_ith(ctx, idx)[id] - log_z };
+        return;
+    }
+
+    llama_token_data_array* cur_p = common_sampler_get_candidates(state.sampler);
+    llama_token_data* begin = cur_p->data;
+    llama_token_data* end = cur_p->data + cur_p->size;
+
+    probs.token = { id, common_token_to_piece(vocab, id), 0.0f };
+    for (const llama_token_data* data = begin; data != end; ++data) {
+        if (data->id == id) {
+            probs.token.value = data->p;
+            break;
+        }
+    }
+
+    llama_token_data* top_end = begin + std::min<size_t>(state.n_probs, cur_p->size);
+    if (!cur_p->sorted) {
+        std::partial_sort(begin, top_end, end,
+            [](const llama_token_data& a, const llama_token_data& b) { return a.p > b.p; });
+    }
+    probs.top.clear();
+    for (const llama_token_data* data = begin; data != top_end; ++data) {
+        probs.top.push_back({ data->id, common_token_to_piece(vocab, data->id), data->p });
+    }
+}
+
+// Sample a token at batch index idx, constrained by the request's grammar if it
+// has one. As in common_sampler, the sampled token is checked against the grammar
+// first, and the grammar mask of the whole vocabulary is only computed when it
+// is rejected. probs, if given, receives the token's probabilities.
+static llama_token sample_token(completion_state& state, llama_context* ctx, int idx, CompletionTokenProbs* probs = nullptr) {
+    // Raw probabilities are read before the grammar masks any logits
+    if (probs && !state.post_sampling_probs) {
+        logit_probs(state, ctx, idx, *probs);
+    }
+
+    llama_token id = common_sampler_sample(state.sampler, ctx, idx);
+    if (!state.grammar || grammar_accepts(state, id)) {
+        state.grammar_single_prefix = false;
+        if (probs) {
+            set_sampled_prob(state, ctx, idx, id, *probs);
+        }
+        return id;
     }
 
+    // Mask out every token the grammar rejects and sample again
+    const int64_t t_start = ggml_time_us();
+    float* logits = llama_get_logits_ith(ctx, idx);
+    const llama_vocab* vocab = state.rn_ctx->vocab;
+    const int n_vocab = llama_vocab_n_tokens(vocab);
+
+    state.rn_ctx->grammar_mask.compute(vocab, state.grammar.get(), state.grammar_mask);
+    rn_grammar_mask::apply(state.grammar_mask, logits, n_vocab);
+    id = common_sampler_sample(state.sampler, ctx, idx);
+
+    state.grammar_single_prefix = state.rn_ctx->grammar_mask.single_prefix(state.grammar_mask);
+    state.n_grammar_masks++;
+    state.t_grammar_mask_us += ggml_time_us() - t_start;
+
+    if (probs) {
+        set_sampled_prob(state, ctx, idx, id, *probs);
+    }
+    return id;
+}
+
+static void accept_token(completion_state& state, llama_token id) {
+    common_sampler_accept(state.sampler, id, false);
+    if (state.grammar) {
+        llama_sampler_accept(state.grammar.get(), id);
+    }
+}
+
+// Tokens of the text the grammar forces after the last accepted token, at most
+// n_max. The last token of the span is left to the model, since the text that
+// follows the span could merge with it into a different token.
+//
+// Probing walks every trie root through the grammar, so it is only done where
+// forced text is likely: right after a mask that allowed a single prefix, or
+// after a probe that found forced text.
+static std::vector<llama_token> grammar_forced_tokens(completion_state& state, int n_max) {
+    if (!state.grammar || n_max <= 0) {
+        return {};
+    }
+    if (!state.grammar_single_prefix && !state.grammar_forced_prev) {
+        return {};
+    }
+
+    const llama_vocab* vocab = state.rn_ctx->vocab;
+    const std::string text = state.rn_ctx->grammar_mask.forced_text(vocab, state.grammar.get(), RN_GRAMMAR_FORCED_MAX_BYTES);
+    state.grammar_forced_prev = !text.empty();
+    if (text.empty()) {
+        return {};
+    }
+
+    // Tokenizers that insert a leading space would change the text
+    std::vector<llama_token> tokens = common_tokenize(vocab, text, false, false);
+    std::string pieces;
+    for (llama_token token : tokens) {
+        pieces += common_token_to_piece(vocab, token);
+    }
+    if (pieces != text) {
+        return {};
+    }
+
+    tokens.pop_back();
+    if ((int)tokens.size() > n_max) {
+        tokens.resize(n_max);
+    }
+    return tokens;
+}
+
+// Equivalent of common_sampler_sample_and_accept_n with the grammar applied:
+// sample at i_batch + i for every drafted position, accepting drafted tokens
+// until the sampled token disagrees with the draft. When n_probs is set, probs
+// receives the probabilities of every returned token.
+static std::vector<llama_token> sample_and_accept_n(
+    completion_state& state, llama_context* ctx, int i_batch, const std::vector<llama_token>& draft,
+    std::vector<CompletionTokenProbs>& probs) {
+
+    std::vector<llama_token> result;
+    result.reserve(draft.size() + 1);
+    probs.clear();
+
+    for (size_t i = 0; i <= draft.size(); ++i) {
+        CompletionTokenProbs* token_probs = nullptr;
+        if (state.n_probs > 0) {
+            token_probs = &probs.emplace_back();
+        }
+
+        const llama_token id = sample_token(state, ctx, i_batch + (int)i, token_probs);
+        accept_token(state, id);
+        result.push_back(id);
+
+        if (i == draft.size() || draft[i] != id) {
+            break;
+        }
+    }
+
+    return result;
+}
+
+rn_completion_scheduler::rn_completion_scheduler(rn_llama_context* rn_ctx)
+    : rn_ctx_(rn_ctx) {
+    n_batch_ = std::max(1, std::min(rn_ctx->params.n_batch, (int)llama_n_batch(rn_ctx->ctx)));
+
+    // Every active sequence contributes at least one token per batch
+    const int n_seq = std::max(1, std::min((int)llama_n_seq_max(rn_ctx->ctx), n_batch_));
+
+    slots_.resize(n_seq);
+    for (int i = 0; i < n_seq; ++i) {
+        slots_[i].id = i;
+    }
+    rn_ctx->cache_tokens.assign(n_seq, {});
+
+    if (rn_ctx->model_dft) {
+        // The draft context evaluates a whole prompt in one batch, so n_batch matches n_ctx
+        llama_context_params cparams_dft = common_context_params_to_llama(rn_ctx->params);
+        cparams_dft.n_ctx = llama_n_ctx(rn_ctx->ctx) / n_seq;
+        cparams_dft.n_batch = cparams_dft.n_ctx;
+        cparams_dft.n_seq_max = 1;
+
+        for (auto& slot : slots_) {
+            slot.ctx_dft = llama_init_from_model(rn_ctx->model_dft, cparams_dft);
+            if (!slot.ctx_dft || !common_speculative_are_compatible(rn_ctx->ctx, slot.ctx_dft)) {
+                free_draft_contexts();
+                throw std::runtime_error("Draft model is not compatible with the target model");
+            }
+            slot.spec = common_speculative_init(slot.ctx_dft);
+        }
+    }
+
+    batch_ = llama_batch_init(n_batch_, 0, 1);
+    llama_set_abort_callback(rn_ctx->ctx, &rn_completion_scheduler::abort_callback, this);
+    thread_ = std::thread(&rn_completion_scheduler::loop, this);
+}
+
+rn_completion_scheduler::~rn_completion_scheduler() {
+    stop();
+    llama_set_abort_callback(rn_ctx_->ctx, nullptr, nullptr);
+    free_draft_contexts();
+    llama_batch_free(batch_);
+}
+
+void rn_completion_scheduler::free_draft_contexts() {
+    for (auto& slot : slots_) {
+        if (slot.spec) {
+            common_speculative_free(slot.spec);
+            slot.spec = nullptr;
+        }
+        if (slot.ctx_dft) {
+            llama_free(slot.ctx_dft);
+            slot.ctx_dft = nullptr;
+        }
+    }
+}
+
+bool rn_completion_scheduler::abort_callback(void* data) {
+    auto* self = static_cast<rn_completion_scheduler*>(data);
+    if (self->stopping_) {
+        self->aborted_ = true;
+        return true;
+    }
+
+    // Called from llama_decode on the scheduler thread, so the slots cannot
+    // change underneath. Other requests in the batch keep it running.
+    bool has_batch = false;
+    for (const auto& slot : self->slots_) {
+        if (!slot.task || !slot.task->state || slot.task->state->n_batch_tokens == 0) {
+            continue;
+        }
+        if (!slot.task->cancel->cancelled) {
+            return false;
+        }
+        has_batch = true;
+    }
+    self->aborted_ = has_batch;
+    return has_batch;
+}
+
+void rn_completion_scheduler::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    cv_.notify_all();
+
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+}
+
+// Copy the dynamic lookup cache if it changed since the last save and that save
+// is at least RN_LOOKUP_CACHE_SAVE_INTERVAL_MS old, or whenever it changed if
+// force is set. Called with the context held; the copy is written after it is
+// released.
+bool rn_completion_scheduler::snapshot_lookup_cache(common_ngram_cache& snapshot, bool force) {
+    if (!rn_ctx_->lookup_cache_dirty || rn_ctx_->params.lookup_cache_dynamic.empty()) {
+        return false;
+    }
+    const int64_t t_now = ggml_time_us();
+    if (!force && t_now - t_lookup_saved_us_ < RN_LOOKUP_CACHE_SAVE_INTERVAL_MS * 1000LL) {
+        return false;
+    }
+
+    snapshot = rn_ctx_->lookup_cache_dynamic;
+    rn_ctx_->lookup_cache_dirty = false;
+    t_lookup_saved_us_ = t_now;
+    return true;
+}
+
+// Write the cache next to its file and rename it over it, so a crash during the
+// write leaves the previous cache in place
+void rn_completion_scheduler::save_lookup_cache(const common_ngram_cache& cache) {
+    const std::string& path = rn_ctx_->params.lookup_cache_dynamic;
+    const std::string tmp_path = path + ".tmp";
+
+    // Same layout as common_ngram_cache_save, so common_ngram_cache_load reads it
+    std::ofstream file(tmp_path, std::ios::binary | std::ios::trunc);
+    for (const auto& [ngram, token_counts] : cache) {
+        const int32_t n_tokens = (int32_t)token_counts.size();
+        file.write(reinterpret_cast<const char*>(&ngram), sizeof(common_ngram));
+        file.write(reinterpret_cast<const char*>(&n_tokens), sizeof(int32_t));
+        for (const auto& [token, count] : token_counts) {
+            file.write(reinterpret_cast<const char*>(&token), sizeof(llama_token));
+            file.write(reinterpret_cast<const char*>(&count), sizeof(int32_t));
+        }
+    }
+    file.close();
+
+    if (!file || std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+        LOG_WRN("%s: failed to save lookup cache to %s\n", __func__, path.c_str());
+        std::remove(tmp_path.c_str());
+        // Retried after the next interval
+        rn_ctx_->lookup_cache_dirty = true;
+    }
+}
+
+int rn_completion_scheduler::n_slots() const {
+    return (int)slots_.size();
+}
+
+CompletionResult rn_completion_scheduler::submit(
+    const CompletionOptions& options,
+    std::function<bool(const CompletionChunk&, bool)> callback,
+    std::shared_ptr<rn_cancel_token> cancel) {
+
+    CompletionResult result;
+    auto task = std::make_shared<completion_task>();
+    task->options = options;
+    task->stream = callback != nullptr;
+    task->cancel = cancel ? std::move(cancel) : std::make_shared<rn_cancel_token>();
+
     try {
-        // Initialize state with context values
-        state.rn_ctx = rn_ctx;
-        state.model = rn_ctx->model;
-        state.ctx = rn_ctx->ctx;
-        state.params = (struct llama_model_params *)&rn_ctx->params.model;
-        state.prompt = options.prompt;
-        state.chat_format = rn_ctx->params.chat_format;
+        // Tokenize the prompt on the calling thread
+        json prompt = options.prompt;
+        auto tokenized_prompts = tokenize_input_prompts(rn_ctx_->vocab, prompt, true, true);
+        if (tokenized_prompts.empty() || tokenized_prompts[0].empty()) {
+            result.success = false;
+            result.error_msg = "Empty prompt";
+            result.error_type = RN_ERROR_INVALID_PARAM;
+            return result;
+        }
+        task->prompt_tokens = std::move(tokenized_prompts[0]);
 
-        // Convert CompletionOptions to JSON for processing
-        json data = options.to_json();
-        // Prepare the sampling parameters
-        const auto& params = rn_ctx->params;
-
-        // Set the prompt
-        if (data.contains("prompt")) {
-            // Tokenize the prompt
-            const auto& tokenized_prompts = tokenize_input_prompts(rn_ctx->vocab, data["prompt"], true, true);
-            if (tokenized_prompts.empty() || tokenized_prompts[0].empty()) {
+        // Parse the grammar here rather than on the scheduler thread, where it
+        // would hold up every other sequence
+        if (!options.grammar.empty()) {
+            CompletionResult& task_result = task->result;
+            task->grammar = rn_ctx_->grammar_cache.acquire(rn_ctx_->vocab, options.grammar,
+                options.grammar_lazy, options.grammar_triggers,
+                task_result.grammar_cache_hit, task_result.grammar_ms);
+            if (!task->grammar) {
                 result.success = false;
-                result.error_msg = "Empty prompt";
+                result.error_msg = "Failed to parse grammar or its triggers";
                 result.error_type = RN_ERROR_INVALID_PARAM;
                 return result;
             }
-            state.prompt_tokens = std::move(tokenized_prompts[0]);
-        } else {
+            task_result.has_grammar = true;
+        }
+    } catch (const std::exception& e) {
+        result.success = false;
+        result.error_msg = e.what();
+        result.error_type = RN_ERROR_INVALID_PARAM;
+        return result;
+    }
+
+    // The ring is claimed for the whole request and released once it is done
+    const auto& ring = options.token_ring;
+    if (ring && !ring->begin()) {
+        result.success = false;
+        result.error_msg = "Token stream is already used by another completion";
+        result.error_type = RN_ERROR_INVALID_PARAM;
+        return result;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (stopping_) {
+            if (ring) {
+                ring->end(false);
+            }
             result.success = false;
-            result.error_msg = "No prompt provided";
-            result.error_type = RN_ERROR_INVALID_PARAM;
+            result.error_msg = "Model has been released";
+            result.error_type = RN_ERROR_CONTEXT;
             return result;
         }
+        pending_.push_back(task);
+    }
+    cv_.notify_one();
+
+    // Deliver streamed text on this thread while the scheduler thread decodes
+    std::unique_lock<std::mutex> lock(task->mutex);
+    while (true) {
+        task->cv.wait(lock, [&] { return task->done || !task->chunks.empty(); });
+
+        while (!task->chunks.empty()) {
+            CompletionChunk chunk = std::move(task->chunks.front());
+            task->chunks.pop_front();
+
+            lock.unlock();
+            if (!callback(chunk, false)) {
+                // Callback returned false, stop generation
+                task->cancel->cancel();
+            }
+            lock.lock();
+        }
+
+        if (task->done && task->chunks.empty()) {
+            break;
+        }
+    }
+
+    result = std::move(task->result);
+    lock.unlock();
+
+    if (ring) {
+        ring->end(result.success);
+    }
+
+    // Final callback with is_done=true
+    if (callback && result.success) {
+        CompletionChunk chunk;
+        chunk.text = result.content;
+        callback(chunk, true);
+    }
+
+    return result;
+}
+
+void rn_completion_scheduler::run_exclusive(std::function<bool()> op) {
+    auto entry = std::make_shared<exclusive_op>();
+    entry->fn = std::move(op);
+    std::future<void> done = entry->done.get_future();
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (stopping_) {
+            throw std::runtime_error("Model has been released");
+        }
+        ops_.push_back(entry);
+    }
+    cv_.notify_one();
+    done.get();
+}
+
+size_t rn_completion_scheduler::save_session(const std::string& path, int slot) {
+    size_t n_tokens = 0;
+    run_exclusive([&] {
+        // Between steps the KV cache of a busy slot matches its cached tokens too
+        n_tokens = rn_session_save(rn_ctx_, path, slot >= 0 ? slot : last_slot_);
+        return true;
+    });
+    return n_tokens;
+}
+
+int rn_completion_scheduler::load_session(const std::string& path, int slot) {
+    if (slot >= (int)slots_.size()) {
+        throw std::runtime_error("Invalid session slot " + std::to_string(slot));
+    }
+
+    int loaded = -1;
+    run_exclusive([&] {
+        completion_slot* target = nullptr;
+        if (slot >= 0) {
+            target = slots_[slot].task ? nullptr : &slots_[slot];
+        } else {
+            for (auto& candidate : slots_) {
+                if (!candidate.task && (!target || candidate.t_last_used < target->t_last_used)) {
+                    target = &candidate;
+                }
+            }
+        }
+        if (!target) {
+            return false;
+        }
+
+        rn_session_load(rn_ctx_, path, target->id);
+        // Keep the restored conversation from being the next slot evicted
+        target->t_last_used = ggml_time_us();
+        last_slot_ = target->id;
+        loaded = target->id;
+        return true;
+    });
+    return loaded;
+}
+
+void rn_completion_scheduler::run_ops() {
+    std::deque<std::shared_ptr<exclusive_op>> ops;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        ops.swap(ops_);
+    }
+
+    std::deque<std::shared_ptr<exclusive_op>> retry;
+    for (auto& op : ops) {
+        try {
+            if (!op->fn()) {
+                retry.push_back(op);
+                continue;
+            }
+            op->done.set_value();
+        } catch (...) {
+            op->done.set_exception(std::current_exception());
+        }
+    }
+
+    if (!retry.empty()) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        ops_.insert(ops_.begin(), retry.begin(), retry.end());
+    }
+}
+
+void rn_completion_scheduler::loop() {
+    while (true) {
+        bool has_active = std::any_of(slots_.begin(), slots_.end(),
+            [](const completion_slot& slot) { return slot.task != nullptr; });
+
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            auto ready = [&] { return stopping_ || has_active || !pending_.empty() || !ops_.empty(); };
+            if (rn_ctx_->lookup_cache_dirty && !rn_ctx_->params.lookup_cache_dynamic.empty()) {
+                // Wake up to save the lookup cache once the save interval has passed
+                const int64_t t_save_us = t_lookup_saved_us_ + RN_LOOKUP_CACHE_SAVE_INTERVAL_MS * 1000LL;
+                cv_.wait_for(lock, std::chrono::microseconds(std::max<int64_t>(0, t_save_us - ggml_time_us())), ready);
+            } else {
+                cv_.wait(lock, ready);
+            }
+
+            if (stopping_) {
+                break;
+            }
+        }
 
-        // Configure state
-        state.n_ctx = llama_n_ctx(rn_ctx->ctx);
+        // The context is held for one step at a time, so other users of it get
+        // a turn between steps instead of waiting for the queue to drain
+        std::unique_lock<std::mutex> ctx_lock(rn_ctx_->mutex);
+
+        run_ops();
+
+        std::vector<completion_slot*> launched;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+
+            // Requests cancelled while waiting for a slot finish without output
+            for (auto it = pending_.begin(); it != pending_.end();) {
+                completion_task& task = **it;
+                if (!task.cancel->cancelled) {
+                    ++it;
+                    continue;
+                }
+                std::lock_guard<std::mutex> task_lock(task.mutex);
+                task.result.cancelled = true;
+                task.result.cancel_ms = (ggml_time_us() - task.cancel->t_cancel_us) / 1000.0;
+                task.done = true;
+                task.cv.notify_one();
+                it = pending_.erase(it);
+            }
+
+            // Admit queued requests into idle slots, preferring the slot whose
+            // cached tokens share the longest prefix with the request's prompt,
+            // then the least recently used one
+            while (!pending_.empty()) {
+                const auto& prompt_tokens = pending_.front()->prompt_tokens;
+                completion_slot* best_slot = nullptr;
+                size_t best_lcp = 0;
+                for (auto& slot : slots_) {
+                    if (slot.task) {
+                        continue;
+                    }
+                    const size_t lcp = common_lcp(rn_ctx_->cache_tokens[slot.id], prompt_tokens);
+                    if (!best_slot || lcp > best_lcp || (lcp == best_lcp && slot.t_last_used < best_slot->t_last_used)) {
+                        best_slot = &slot;
+                        best_lcp = lcp;
+                    }
+                }
+                if (!best_slot) {
+                    break;
+                }
+
+                best_slot->task = std::move(pending_.front());
+                pending_.pop_front();
+                launched.push_back(best_slot);
+            }
+        }
+
+        for (completion_slot* slot : launched) {
+            launch_slot(*slot);
+        }
+
+        has_active = std::any_of(slots_.begin(), slots_.end(),
+            [](const completion_slot& slot) { return slot.task != nullptr; });
+
+        if (!has_active) {
+            common_ngram_cache snapshot;
+            const bool save = snapshot_lookup_cache(snapshot, false);
+            ctx_lock.unlock();
+            if (save) {
+                save_lookup_cache(snapshot);
+            }
+            continue;
+        }
+
+        update_slots();
+    }
+
+    // Fail everything that is still queued or running
+    for (auto& slot : slots_) {
+        if (slot.task) {
+            fail_slot(slot, "Model has been released", RN_ERROR_CONTEXT);
+        }
+    }
+
+    std::deque<std::shared_ptr<completion_task>> pending;
+    std::deque<std::shared_ptr<exclusive_op>> ops;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        pending.swap(pending_);
+        ops.swap(ops_);
+    }
+    for (auto& op : ops) {
+        op->done.set_exception(std::make_exception_ptr(std::runtime_error("Model has been released")));
+    }
+    for (auto& task : pending) {
+        std::lock_guard<std::mutex> lock(task->mutex);
+        task->result.success = false;
+        task->result.error_msg = "Model has been released";
+        task->result.error_type = RN_ERROR_CONTEXT;
+        task->done = true;
+        task->cv.notify_one();
+    }
+
+    common_ngram_cache snapshot;
+    bool save = false;
+    {
+        std::lock_guard<std::mutex> ctx_lock(rn_ctx_->mutex);
+        save = snapshot_lookup_cache(snapshot, true);
+    }
+    if (save) {
+        save_lookup_cache(snapshot);
+    }
+}
+
+void rn_completion_scheduler::launch_slot(completion_slot& slot) {
+    completion_task& task = *slot.task;
+    const CompletionOptions& options = task.options;
+    const auto& params = rn_ctx_->params;
+
+    try {
+        // Initialize state with context values
+        task.state = std::make_unique<completion_state>();
+        completion_state& state = *task.state;
+        state.rn_ctx = rn_ctx_;
+        state.model = rn_ctx_->model;
+        state.ctx = rn_ctx_->ctx;
+        state.params = (struct llama_model_params *)&rn_ctx_->params.model;
+        state.prompt = options.prompt;
+        state.chat_format = params.chat_format;
+        state.stream = task.stream;
+        state.ignore_eos = options.ignore_eos;
+        state.n_probs = options.n_probs;
+        state.post_sampling_probs = options.post_sampling_probs;
+        state.flush_tokens = options.stream_flush_tokens;
+        state.flush_us = (int64_t)options.stream_flush_ms * 1000;
+        state.flush_boundary = options.stream_flush_boundary;
+        state.ring = options.token_ring.get();
+        state.seq_id = slot.id;
+        state.t_start_prompt = ggml_time_us();
+
+        state.prompt_tokens = std::move(task.prompt_tokens);
+
+        // Convert CompletionOptions to JSON for processing
+        json data = options.to_json();
+
+        // Configure state; the context is shared evenly between the slots
+        state.n_ctx = llama_n_ctx(rn_ctx_->ctx) / n_slots();
         state.n_predict = options.n_predict > 0 ? options.n_predict : params.n_predict;
-        state.n_remaining = state.n_predict;
+        state.n_remaining = state.n_predict > 0 ? state.n_predict : state.n_ctx;
+        state.ctx_shift = params.ctx_shift && llama_kv_self_can_shift(rn_ctx_->ctx);
+
+        // Tokens protected from context shifts; a negative value keeps the whole prompt.
+        // The BOS token is always kept.
+        const int n_prompt = (int)state.prompt_tokens.size();
+        state.n_keep = options.n_keep != 0 ? options.n_keep : params.n_keep;
+        if (state.n_keep < 0 || state.n_keep > n_prompt) {
+            state.n_keep = n_prompt;
+        }
+        if (llama_vocab_get_add_bos(rn_ctx_->vocab)) {
+            state.n_keep = std::max(state.n_keep, 1);
+        }
+        // Leave at least a quarter of the context free for the shifted tokens
+        state.n_keep = std::min(state.n_keep, state.n_ctx - state.n_ctx / 4);
+
+        if (n_prompt >= state.n_ctx) {
+            if (!state.ctx_shift) {
+                fail_slot(slot, "Prompt is longer than the context size", RN_ERROR_CONTEXT);
+                return;
+            }
+
+            // Keep the first n_keep tokens and drop whole blocks from the middle of
+            // the prompt, the same way the context is shifted during generation
+            const int n_block_size = (state.n_ctx - state.n_keep) / 2;
+            const int n_erased_blocks = (n_prompt - state.n_keep - n_block_size) / n_block_size;
+
+            state.prompt_tokens.erase(
+                state.prompt_tokens.begin() + state.n_keep,
+                state.prompt_tokens.begin() + state.n_keep + n_erased_blocks * n_block_size);
+            state.truncated = true;
+        }
 
         // Parse tool_choice
         if (options.tool_choice == "auto") {
@@ -176,14 +1082,30 @@ CompletionResult run_completion(
         } else if (options.tool_choice == "required") {
             state.tool_choice = COMMON_CHAT_TOOL_CHOICE_REQUIRED;
         }
-        // Initialize the sampler
-        state.sampler = common_sampler_init(rn_ctx->model, params.sampling);
+
+        // Initialize the sampler with the request's sampling parameters
+        common_params_sampling sparams = params.sampling;
+        sparams.temp = options.temperature;
+        sparams.top_p = options.top_p;
+        sparams.top_k = options.top_k;
+        sparams.min_p = options.min_p;
+        sparams.n_probs = options.n_probs;
+        if (options.seed >= 0) {
+            sparams.seed = options.seed;
+        }
+
+        state.sampler = common_sampler_init(rn_ctx_->model, sparams);
         if (!state.sampler) {
-            result.success = false;
-            result.error_msg = "Failed to initialize sampler";
-            result.error_type = RN_ERROR_INFERENCE;
-            return result;
+            fail_slot(slot, "Failed to initialize sampler", RN_ERROR_INFERENCE);
+            return;
+        }
+
+        // Prompt tokens only feed the sampler's penalty history; the grammar
+        // constrains the generated text alone
+        for (llama_token token : state.prompt_tokens) {
+            common_sampler_accept(state.sampler, token, false);
         }
+        state.grammar = std::move(task.grammar);
 
         // Process stop words
         if (data.contains("stop")) {
@@ -198,130 +1120,389 @@ CompletionResult run_completion(
             }
         }
 
-        // Process the prompt
-        for (int i = 0; i < (int)state.prompt_tokens.size(); ++i) {
-            llama_token token = state.prompt_tokens[i];
+        state.stop_matcher = rn_stop_matcher(state.antiprompt);
 
-            llama_batch batch = {
-                /* n_tokens    */ 1,
-                /* token       */ &token,
-                /* embd        */ nullptr,
-                /* pos         */ &i,
-                /* n_seq_id    */ nullptr,
-                /* seq_id      */ nullptr,
-                /* logits      */ nullptr
-            };
+        // Index the prompt for prompt lookup decoding
+        if (rn_ctx_->lookup_decoding) {
+            state.lookup_tokens = state.prompt_tokens;
+            common_ngram_cache_update(state.lookup_context, LLAMA_NGRAM_MIN, LLAMA_NGRAM_MAX,
+                state.lookup_tokens, state.lookup_tokens.size(), false);
+        }
 
-            if (llama_decode(rn_ctx->ctx, batch) != 0) {
-                result.success = false;
-                result.error_msg = "Failed to process prompt";
-                result.error_type = RN_ERROR_INFERENCE;
-                return result;
-            }
+        // Reuse the part of the KV cache that matches the new prompt
+        state.n_past = reuse_cached_prefix(rn_ctx_, slot.id, state.prompt_tokens);
+        task.result.n_cached_tokens = state.n_past;
+    } catch (const std::exception& e) {
+        fail_slot(slot, e.what(), RN_ERROR_GENERAL);
+    }
+}
+
+void rn_completion_scheduler::update_slots() {
+    llama_context* ctx = rn_ctx_->ctx;
 
-            common_sampler_accept(state.sampler, token, true);
-            state.n_past++;
+    common_batch_clear(batch_);
+
+    // Stop requests that were cancelled by their token or callback
+    for (auto& slot : slots_) {
+        if (slot.task && slot.task->cancel->cancelled) {
+            slot.task->state->has_next_token = false;
+            finish_slot(slot);
         }
+    }
 
-        result.n_prompt_tokens = state.prompt_tokens.size();
+    // First add the sampled token of every generating sequence, followed by the
+    // tokens drafted for it so they are verified by the same decode
+    int n_generating = 0;
+    for (const auto& slot : slots_) {
+        n_generating += slot.task && slot.task->state->prompt_done;
+    }
 
-        // Start generating tokens
-        const int64_t t_start_generation = ggml_time_us();
+    for (auto& slot : slots_) {
+        if (!slot.task || !slot.task->state->prompt_done) {
+            continue;
+        }
+        completion_state& state = *slot.task->state;
 
-        while (state.has_next_token && state.n_remaining > 0) {
-            // Sample the next token
-            llama_token token_id = common_sampler_sample(state.sampler, rn_ctx->ctx, -1);
+        // The sampled token would not fit, shift the context to make room for it
+        if (state.ctx_shift && state.n_past + 1 >= state.n_ctx) {
+            shift_context(rn_ctx_, slot.id, state);
+        }
 
-            // Extract the token text
-            std::string token_text = common_token_to_piece(rn_ctx->vocab, token_id);
+        // Tokens forced by the grammar follow without sampling, as many as the
+        // batch has room for; logits are only needed once all of them are in
+        const int n_forced = std::min((int)state.forced.size(),
+            std::max(0, n_batch_ - batch_.n_tokens - n_generating));
+        const bool sample = n_forced == (int)state.forced.size();
 
-            // Add to generated text
-            state.generated_text += token_text;
-            state.generated_tokens.push_back(token_id);
+        common_batch_add(batch_, state.next_token, state.n_past, { slot.id }, sample && n_forced == 0);
+        for (int i = 0; i < n_forced; ++i) {
+            common_batch_add(batch_, state.forced[i], state.n_past + 1 + i, { slot.id }, sample && i == n_forced - 1);
+        }
+        state.i_batch = sample ? batch_.n_tokens - 1 : -1;
+        state.n_batch_tokens = 1 + n_forced;
+        state.n_batch_forced = n_forced;
+        n_generating--;
+
+        if (state.forced.empty() && (slot.spec || rn_ctx_->lookup_decoding)) {
+            const auto& spec_params = rn_ctx_->params.speculative;
+
+            // Never draft past the request's budget, the context or the batch
+            int n_draft_max = std::min({
+                spec_params.n_max,
+                state.n_remaining - 1,
+                state.n_ctx - state.n_past - 2,
+                n_batch_ - batch_.n_tokens - n_generating,
+            });
+
+            if (n_draft_max >= std::max(1, spec_params.n_min)) {
+                if (slot.spec) {
+                    common_speculative_params draft_params;
+                    draft_params.n_draft = n_draft_max;
+                    draft_params.p_min = spec_params.p_min;
+
+                    state.draft = common_speculative_gen_draft(slot.spec, draft_params,
+                        rn_ctx_->cache_tokens[slot.id], state.next_token);
+                } else {
+                    // The draft starts with the last sampled token, which is dropped afterwards
+                    state.draft = { state.next_token };
+                    common_ngram_cache_draft(state.lookup_tokens, state.draft, n_draft_max,
+                        LLAMA_NGRAM_MIN, LLAMA_NGRAM_MAX, state.lookup_context,
+                        rn_ctx_->lookup_cache_dynamic, rn_ctx_->lookup_cache_static);
+                    state.draft.erase(state.draft.begin());
+                }
 
-            // Update state
-            state.n_decoded++;
-            state.n_remaining--;
+                if ((int)state.draft.size() > n_draft_max) {
+                    state.draft.resize(n_draft_max);
+                }
+                if ((int)state.draft.size() < spec_params.n_min) {
+                    state.draft.clear();
+                }
+            }
 
-            // Accept the new token
-            common_sampler_accept(state.sampler, token_id, true);
+            for (size_t i = 0; i < state.draft.size(); ++i) {
+                common_batch_add(batch_, state.draft[i], state.n_past + 1 + i, { slot.id }, true);
+            }
+            state.n_batch_tokens += state.draft.size();
+        }
+    }
 
-            // Prepare for next token
-            llama_batch batch = {
-                /* n_tokens    */ 1,
-                /* token       */ &token_id,
-                /* embd        */ nullptr,
-                /* pos         */ &state.n_past,
-                /* n_seq_id    */ nullptr,
-                /* seq_id      */ nullptr,
-                /* logits      */ nullptr
-            };
+    // Then fill the rest of the batch with pending prompt tokens, requesting
+    // logits only for the last prompt position of each sequence
+    for (auto& slot : slots_) {
+        if (!slot.task || slot.task->state->prompt_done) {
+            continue;
+        }
+        completion_state& state = *slot.task->state;
+        const int n_prompt = (int)state.prompt_tokens.size();
+
+        state.i_batch = -1;
+        state.n_batch_tokens = 0;
+        for (int pos = state.n_past; pos < n_prompt && batch_.n_tokens < n_batch_; ++pos) {
+            const bool is_last = pos == n_prompt - 1;
+            if (is_last) {
+                state.i_batch = batch_.n_tokens;
+            }
+            common_batch_add(batch_, state.prompt_tokens[pos], pos, { slot.id }, is_last);
+            state.n_batch_tokens++;
+        }
+    }
 
-            if (llama_decode(rn_ctx->ctx, batch) != 0) {
-                result.success = false;
-                result.error_msg = "Failed to decode generated token";
-                result.error_type = RN_ERROR_INFERENCE;
-                return result;
+    if (batch_.n_tokens == 0) {
+        return;
+    }
+
+    aborted_ = false;
+    const int ret = llama_decode(ctx, batch_);
+    if (aborted_ || ret == 2) {
+        // Aborted by abort_callback: every request in the batch was cancelled. Drop
+        // whatever part of the batch reached the KV cache; the requests are finished
+        // at the start of the next update.
+        for (auto& slot : slots_) {
+            if (slot.task && slot.task->state->n_batch_tokens > 0) {
+                completion_state& state = *slot.task->state;
+                llama_kv_self_seq_rm(ctx, slot.id, rn_ctx_->cache_tokens[slot.id].size(), -1);
+                state.n_batch_tokens = 0;
+                state.n_batch_forced = 0;
+                state.i_batch = -1;
+                state.draft.clear();
             }
+        }
+        return;
+    }
 
-            state.n_past++;
+    if (ret != 0) {
+        for (auto& slot : slots_) {
+            if (slot.task && slot.task->state->n_batch_tokens > 0) {
+                llama_kv_self_seq_rm(ctx, slot.id, -1, -1);
+                rn_ctx_->cache_tokens[slot.id].clear();
+                fail_slot(slot,
+                    slot.task->state->prompt_done ? "Failed to decode generated token" : "Failed to process prompt",
+                    RN_ERROR_INFERENCE);
+            }
+        }
+        return;
+    }
 
-            // Check stopping conditions
-            bool should_stop = check_stop_conditions(state, state.antiprompt, token_text, options.ignore_eos);
+    for (auto& slot : slots_) {
+        if (!slot.task) {
+            continue;
+        }
+        completion_state& state = *slot.task->state;
+        auto& cache_tokens = rn_ctx_->cache_tokens[slot.id];
 
-            // Handle stream mode
-            if (callback && !should_stop) {
-                std::string text_to_send = state.generated_text.substr(state.n_sent_text);
-                state.n_sent_text = state.generated_text.size();
+        if (state.n_batch_tokens == 0) {
+            continue;
+        }
 
-                // Send the token
-                if (!callback(text_to_send, false)) {
-                    // Callback returned false, stop generation
-                    state.has_next_token = false;
-                    break;
-                }
+        if (state.prompt_done) {
+            // Drafted tokens are only kept once they have been verified below,
+            // forced tokens were accepted when they were added
+            const int n_forced = state.n_batch_forced;
+            cache_tokens.push_back(state.next_token);
+            cache_tokens.insert(cache_tokens.end(), state.forced.begin(), state.forced.begin() + n_forced);
+            state.n_past += 1 + n_forced;
+
+            if (n_forced < (int)state.forced.size()) {
+                // The rest of the forced tokens go in the next batch
+                state.next_token = state.forced[n_forced];
+                state.forced.erase(state.forced.begin(), state.forced.begin() + n_forced + 1);
+            } else {
+                state.forced.clear();
             }
+            state.n_batch_forced = 0;
+        } else {
+            cache_tokens.insert(cache_tokens.end(),
+                state.prompt_tokens.begin() + state.n_past,
+                state.prompt_tokens.begin() + state.n_past + state.n_batch_tokens);
+            state.n_past += state.n_batch_tokens;
+        }
+        state.n_batch_tokens = 0;
+
+        if (state.i_batch < 0) {
+            // Prompt still in progress
+            continue;
+        }
+
+        if (!state.prompt_done) {
+            state.prompt_done = true;
+            state.t_start_generation = ggml_time_us();
+            state.t_last_flush = state.t_start_generation;
+        }
+
+        // Sample and accept the next token. With a draft, this samples at every
+        // drafted position and stops at the first disagreement, so the result is
+        // the longest accepted draft prefix plus one token from the target model
+        std::vector<CompletionTokenProbs> probs;
+        std::vector<llama_token> ids = sample_and_accept_n(state, ctx, state.i_batch, state.draft, probs);
+        state.i_batch = -1;
+
+        if (!state.draft.empty()) {
+            // Accepted drafted tokens are already in the KV cache, drop the rejected ones
+            const int n_accepted = (int)ids.size() - 1;
+            cache_tokens.insert(cache_tokens.end(), state.draft.begin(), state.draft.begin() + n_accepted);
+            state.n_past += n_accepted;
+            llama_kv_self_seq_rm(ctx, slot.id, state.n_past, -1);
+
+            state.n_draft_total += state.draft.size();
+            state.n_draft_accepted += n_accepted;
+            state.draft.clear();
+        }
+
+        bool finished = false;
+        for (size_t i = 0; i < ids.size(); ++i) {
+            const llama_token token_id = ids[i];
+            if (rn_ctx_->lookup_decoding) {
+                state.lookup_tokens.push_back(token_id);
+                common_ngram_cache_update(state.lookup_context, LLAMA_NGRAM_MIN, LLAMA_NGRAM_MAX,
+                    state.lookup_tokens, 1, false);
+            }
+
+            if (!process_token(state, *slot.task, token_id, probs.empty() ? nullptr : &probs[i])) {
+                finished = true;
+                break;
+            }
+        }
+
+        if (finished) {
+            finish_slot(slot);
+            continue;
+        }
 
-            // Check if should stop (after streaming so we don't miss the last token)
-            if (should_stop) {
+        state.next_token = ids.back();
+
+        // Jump forward over text the grammar allows only one way: its tokens are
+        // accepted and streamed now, and decoded along with next_token
+        const int n_forced_max = std::min(state.n_remaining, state.n_ctx - state.n_past - 2);
+        for (llama_token token_id : grammar_forced_tokens(state, n_forced_max)) {
+            if (!grammar_accepts(state, token_id)) {
                 break;
             }
+            accept_token(state, token_id);
+            state.forced.push_back(token_id);
+            state.n_forced_total++;
+
+            if (rn_ctx_->lookup_decoding) {
+                state.lookup_tokens.push_back(token_id);
+                common_ngram_cache_update(state.lookup_context, LLAMA_NGRAM_MIN, LLAMA_NGRAM_MAX,
+                    state.lookup_tokens, 1, false);
+            }
 
-            // Check for EOS token if not ignoring
-            if (!options.ignore_eos && token_id == llama_vocab_eos(rn_ctx->vocab)) {
-                state.has_next_token = false;
+            if (!process_token(state, *slot.task, token_id)) {
+                finished = true;
                 break;
             }
         }
 
-        const int64_t t_end_generation = ggml_time_us();
-        const double generation_time_ms = (t_end_generation - t_start_generation) / 1000.0;
+        if (finished) {
+            finish_slot(slot);
+        }
+    }
+}
+
+void rn_completion_scheduler::finish_slot(completion_slot& slot) {
+    completion_task& task = *slot.task;
+    completion_state& state = *task.state;
+    const int64_t t_end = ggml_time_us();
+
+    {
+        std::lock_guard<std::mutex> lock(task.mutex);
 
         // Set the result
+        CompletionResult& result = task.result;
+        result.slot_id = slot.id;
         result.content = state.generated_text;
         result.tokens = state.generated_tokens;
         result.n_prompt_tokens = state.prompt_tokens.size();
         result.n_predicted_tokens = state.n_decoded;
+        result.n_draft_tokens = state.n_draft_total;
+        result.n_draft_accepted = state.n_draft_accepted;
+        result.n_forced_tokens = state.n_forced_total;
+        result.truncated = state.truncated;
+        result.n_grammar_masks = state.n_grammar_masks;
+        result.grammar_mask_ms = state.t_grammar_mask_us / 1000.0;
+
+        // Stream the text that was held back as a possible stop string prefix
+        if (state.ring && state.generated_text.size() > state.n_sent_text) {
+            state.ring->write_text(state.generated_text.data() + state.n_sent_text, state.generated_text.size() - state.n_sent_text);
+            state.n_sent_text = state.generated_text.size();
+        }
+        if (task.stream && (state.generated_text.size() > state.n_sent_text || state.generated_tokens.size() > state.n_sent_tokens)) {
+            task.chunks.push_back(take_chunk(state, state.generated_text.size()));
+        }
 
-        // Final callback with is_done=true
-        if (callback) {
-            callback(state.generated_text, true);
+        // Tokens past a stop string were generated but are not part of the output
+        state.probs.resize(std::min(state.probs.size(), state.generated_tokens.size()));
+        result.probs = std::move(state.probs);
+        result.post_sampling_probs = state.post_sampling_probs;
+
+        // Report how long it took to honour the cancellation
+        if (task.cancel->cancelled) {
+            result.cancelled = true;
+            result.cancel_ms = (t_end - task.cancel->t_cancel_us) / 1000.0;
         }
 
-        return result;
+        // Remember this request's n-grams for future lookups
+        if (rn_ctx_->lookup_decoding) {
+            common_ngram_cache_merge(rn_ctx_->lookup_cache_dynamic, state.lookup_context);
+            rn_ctx_->lookup_cache_dirty = true;
+        }
+        if (state.prompt_done) {
+            result.prompt_ms = (state.t_start_generation - state.t_start_prompt) / 1000.0;
+            result.predicted_ms = (t_end - state.t_start_generation) / 1000.0;
+        } else {
+            result.prompt_ms = (t_end - state.t_start_prompt) / 1000.0;
+        }
 
-    } catch (const std::exception& e) {
+        task.state.reset();
+        task.done = true;
+        task.cv.notify_one();
+    }
+
+    // The sequence keeps its KV cache so that a later request can reuse it
+    slot.task.reset();
+    slot.t_last_used = t_end;
+    last_slot_ = slot.id;
+}
+
+void rn_completion_scheduler::fail_slot(completion_slot& slot, const std::string& error_msg, rn_error_type error_type) {
+    completion_task& task = *slot.task;
+
+    {
+        std::lock_guard<std::mutex> lock(task.mutex);
+        task.result.success = false;
+        task.result.error_msg = error_msg;
+        task.result.error_type = error_type;
+        task.state.reset();
+        task.done = true;
+        task.cv.notify_one();
+    }
+
+    slot.task.reset();
+    slot.t_last_used = ggml_time_us();
+}
+
+CompletionResult run_completion(
+    rn_llama_context* rn_ctx,
+    const CompletionOptions& options,
+    std::function<bool(const CompletionChunk&, bool)> callback,
+    std::shared_ptr<rn_cancel_token> cancel) {
+
+    if (!rn_ctx || !rn_ctx->model || !rn_ctx->ctx || !rn_ctx->scheduler) {
+        CompletionResult result;
         result.success = false;
-        result.error_msg = e.what();
-        result.error_type = RN_ERROR_GENERAL;
+        result.error_msg = "Model not initialized";
+        result.error_type = RN_ERROR_MODEL_LOAD;
         return result;
     }
+
+    return rn_ctx->scheduler->submit(options, callback, std::move(cancel));
 }
 
 CompletionResult run_chat_completion(
     rn_llama_context* rn_ctx,
     const CompletionOptions& options,
-    std::function<bool(const std::string&, bool)> callback) {
+    std::function<bool(const CompletionChunk&, bool)> callback,
+    std::shared_ptr<rn_cancel_token> cancel) {
 
     CompletionResult result;
 
@@ -377,13 +1558,17 @@ CompletionResult run_chat_completion(
         CompletionOptions cmpl_options = options;
         cmpl_options.prompt = chat_params.prompt;
 
-        // Apply grammar if needed
+        // Apply grammar if needed. Tool-call grammars are usually lazy: they only
+        // apply once the model starts a tool call, so plain text turns are sampled
+        // without grammar overhead.
         if (!chat_params.grammar.empty()) {
             cmpl_options.grammar = chat_params.grammar;
+            cmpl_options.grammar_lazy = chat_params.grammar_lazy;
+            cmpl_options.grammar_triggers = chat_params.grammar_triggers;
         }
 
         // Run standard completion with the processed prompt
-        result = run_completion(rn_ctx, cmpl_options, callback);
+        result = run_completion(rn_ctx, cmpl_options, callback, std::move(cancel));
 
         if (result.success) {
             // Create OpenAI-compatible response
@@ -413,6 +1598,11 @@ CompletionResult run_chat_completion(
                 {"completion_tokens", result.n_predicted_tokens},
                 {"total_tokens", result.n_prompt_tokens + result.n_predicted_tokens}
             };
+            response["timings"] = result.timings_to_json();
+            response["truncated"] = result.truncated;
+            if (!result.probs.empty()) {
+                response["completion_probabilities"] = token_probs_to_json(result.probs, result.post_sampling_probs);
+            }
 
             // Store the response in the result
             result.chat_response = response;
@@ -0,0 +1,227 @@
+#include "rn-embedding-cache.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+namespace facebook::react {
+
+// FNV-1a, stable across runs and platforms unlike std::hash
+static uint64_t fnv1a(const void* data, size_t size, uint64_t hash) {
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+static uint64_t model_identity(const llama_model* model) {
+    char desc[256] = {};
+    llama_model_desc(model, desc, sizeof(desc));
+
+    const uint64_t values[] = {
+        llama_model_n_params(model),
+        llama_model_size(model),
+        (uint64_t)llama_vocab_n_tokens(llama_model_get_vocab(model)),
+        (uint64_t)llama_model_n_embd(model),
+        (uint64_t)llama_model_n_layer(model),
+    };
+    uint64_t hash = fnv1a(desc, strlen(desc), 0xcbf29ce484222325ULL);
+    return fnv1a(values, sizeof(values), hash);
+}
+
+rn_embedding_cache::rn_embedding_cache(size_t capacity)
+    : capacity_(capacity) {}
+
+void rn_embedding_cache::open(const llama_model* model, const std::string& dir,
+                              size_t capacity, size_t file_entries) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    entries_.clear();
+    index_.clear();
+    file_.reset();
+    stats_ = {};
+
+    model_ = model;
+    n_embd_ = llama_model_n_embd(model);
+    capacity_ = capacity;
+
+    if (dir.empty() || file_entries == 0) {
+        return;
+    }
+
+    const uint64_t model_id = model_identity(model);
+    char name[64];
+    snprintf(name, sizeof(name), "embeddings-%016llx.bin", (unsigned long long)model_id);
+    const std::string path = dir + (dir.back() == '/' ? "" : "/") + name;
+
+    const size_t size = sizeof(rn_embedding_cache_header) +
+                        file_entries * (sizeof(file_slot) + n_embd_ * sizeof(float));
+    file_ = std::make_unique<rn_mapped_file>(path, size);
+
+    // Start over when the file belongs to another layout
+    auto* header = file_header();
+    const bool valid = file_->initial_size() == size &&
+                       header->magic == RN_EMBEDDING_CACHE_MAGIC &&
+                       header->version == RN_EMBEDDING_CACHE_VERSION &&
+                       header->model_id == model_id &&
+                       header->n_embd == (uint32_t)n_embd_ &&
+                       header->n_entries == (uint32_t)file_entries;
+    if (!valid) {
+        file_->reset(size);
+        header = file_header();
+        header->magic = RN_EMBEDDING_CACHE_MAGIC;
+        header->version = RN_EMBEDDING_CACHE_VERSION;
+        header->model_id = model_id;
+        header->n_embd = n_embd_;
+        header->n_entries = file_entries;
+        header->clock = 0;
+        return;
+    }
+
+    for (size_t i = 0; i < file_entries; ++i) {
+        const auto& slot = file_slots()[i];
+        stats_.n_file += (slot.key.hi | slot.key.lo) != 0;
+    }
+}
+
+rn_embedding_key rn_embedding_cache::make_key(const std::string& text, enum llama_pooling_type pooling,
+                                              bool add_bos) {
+    const int32_t options[] = { (int32_t)pooling, add_bos };
+
+    rn_embedding_key key;
+    key.hi = fnv1a(text.data(), text.size(), fnv1a(options, sizeof(options), 0xcbf29ce484222325ULL));
+    key.lo = fnv1a(text.data(), text.size(), fnv1a(options, sizeof(options), 0x84222325cbf29ce4ULL));
+    // All-zero keys mark free file slots
+    key.lo |= 1;
+    return key;
+}
+
+rn_embedding_cache_header* rn_embedding_cache::file_header() {
+    return reinterpret_cast<rn_embedding_cache_header*>(file_->data());
+}
+
+rn_embedding_cache::file_slot* rn_embedding_cache::file_slots() {
+    return reinterpret_cast<file_slot*>(file_->data() + sizeof(rn_embedding_cache_header));
+}
+
+float* rn_embedding_cache::file_vector(size_t slot) {
+    const size_t n_entries = file_header()->n_entries;
+    return reinterpret_cast<float*>(file_slots() + n_entries) + slot * n_embd_;
+}
+
+bool rn_embedding_cache::get(const rn_embedding_key& key, float* out) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    if (!model_) {
+        return false;
+    }
+
+    auto it = index_.find(key);
+    if (it != index_.end()) {
+        entries_.splice(entries_.begin(), entries_, it->second);
+        std::copy(it->second->embd.begin(), it->second->embd.end(), out);
+        stats_.hits++;
+        return true;
+    }
+
+    if (file_) {
+        auto* header = file_header();
+        const size_t n_entries = header->n_entries;
+        for (size_t p = 0; p < RN_EMBEDDING_CACHE_PROBES && p < n_entries; ++p) {
+            const size_t i = (key.hi + p) % n_entries;
+            auto& slot = file_slots()[i];
+            if (slot.key == key) {
+                slot.last_used = ++header->clock;
+                const float* embd = file_vector(i);
+                std::copy(embd, embd + n_embd_, out);
+                put_memory(key, embd);
+                stats_.hits++;
+                stats_.file_hits++;
+                return true;
+            }
+        }
+    }
+
+    stats_.misses++;
+    return false;
+}
+
+void rn_embedding_cache::put(const rn_embedding_key& key, const float* embd) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    if (!model_) {
+        return;
+    }
+
+    put_memory(key, embd);
+
+    if (!file_) {
+        return;
+    }
+
+    // Take the key's own slot, else a free one, else the least recently used
+    auto* header = file_header();
+    const size_t n_entries = header->n_entries;
+    size_t target = key.hi % n_entries;
+    for (size_t p = 0; p < RN_EMBEDDING_CACHE_PROBES && p < n_entries; ++p) {
+        const size_t i = (key.hi + p) % n_entries;
+        const auto& slot = file_slots()[i];
+        if (slot.key == key || (slot.key.hi | slot.key.lo) == 0) {
+            target = i;
+            break;
+        }
+        if (slot.last_used < file_slots()[target].last_used) {
+            target = i;
+        }
+    }
+
+    auto& slot = file_slots()[target];
+    if ((slot.key.hi | slot.key.lo) == 0) {
+        stats_.n_file++;
+    }
+    // Write the vector before the key so an interrupted write leaves no valid entry
+    slot.key = {};
+    std::copy(embd, embd + n_embd_, file_vector(target));
+    slot.last_used = ++header->clock;
+    slot.key = key;
+}
+
+void rn_embedding_cache::put_memory(const rn_embedding_key& key, const float* embd) {
+    if (capacity_ == 0) {
+        return;
+    }
+
+    auto it = index_.find(key);
+    if (it != index_.end()) {
+        entries_.splice(entries_.begin(), entries_, it->second);
+        return;
+    }
+
+    entries_.push_front({ key, std::vector<float>(embd, embd + n_embd_) });
+    index_[key] = entries_.begin();
+    if (entries_.size() > capacity_) {
+        index_.erase(entries_.back().key);
+        entries_.pop_back();
+    }
+}
+
+rn_embedding_cache_stats rn_embedding_cache::stats() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    rn_embedding_cache_stats stats = stats_;
+    stats.n_memory = entries_.size();
+    return stats;
+}
+
+void rn_embedding_cache::close() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    entries_.clear();
+    index_.clear();
+    file_.reset();
+    model_ = nullptr;
+    n_embd_ = 0;
+}
+
+} // namespace facebook::react
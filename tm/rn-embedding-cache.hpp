@@ -0,0 +1,120 @@
+#pragma once
+
+#include "llama.h"
+#include "rn-mapped-file.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace facebook::react {
+
+#define RN_EMBEDDING_CACHE_SIZE         1024  // vectors kept in memory
+#define RN_EMBEDDING_CACHE_FILE_ENTRIES 16384 // vectors kept in the cache file
+#define RN_EMBEDDING_CACHE_PROBES       8     // file slots checked per key
+
+#define RN_EMBEDDING_CACHE_MAGIC   0x43454E52u // 'RNEC'
+#define RN_EMBEDDING_CACHE_VERSION 2
+
+// The cache file starts with this header, followed by n_entries slots and then
+// n_entries vectors of n_embd floats. A file written for another model or
+// layout is reset when opened.
+struct rn_embedding_cache_header {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t model_id;
+    uint32_t n_embd;
+    uint32_t n_entries;
+    uint64_t clock;      // last use stamp handed out
+};
+
+// Content address of an embedding: a 128-bit hash of the text and of every
+// option that changes the model output. Vectors are cached before truncation,
+// normalization and quantization, so one entry serves every output format.
+struct rn_embedding_key {
+    uint64_t hi;
+    uint64_t lo;
+
+    bool operator==(const rn_embedding_key& other) const { return hi == other.hi && lo == other.lo; }
+};
+
+struct rn_embedding_cache_stats {
+    uint64_t hits = 0;       // found in memory or in the file
+    uint64_t file_hits = 0;  // of which were read from the file
+    uint64_t misses = 0;
+    size_t n_memory = 0;     // vectors in memory
+    size_t n_file = 0;       // vectors in the file
+};
+
+// Embedding vectors by content, so unchanged documents are not embedded again.
+//
+// Vectors are kept in an in-memory LRU and, when a directory is configured, in
+// a memory-mapped file named after the model. The file is an open-addressing
+// table: a key is stored in one of RN_EMBEDDING_CACHE_PROBES slots from its
+// hash, replacing the least recently used of them when they are all taken, so
+// lookups and inserts touch a few slots however large the file is. Thread-safe.
+class rn_embedding_cache {
+public:
+    explicit rn_embedding_cache(size_t capacity = RN_EMBEDDING_CACHE_SIZE);
+
+    rn_embedding_cache(const rn_embedding_cache&) = delete;
+    rn_embedding_cache& operator=(const rn_embedding_cache&) = delete;
+
+    // Set up the cache for a model; persist to a file in dir when dir is not
+    // empty. Drops the cached vectors of another model.
+    // Throws std::runtime_error if the file cannot be opened.
+    void open(const llama_model* model, const std::string& dir,
+              size_t capacity = RN_EMBEDDING_CACHE_SIZE,
+              size_t file_entries = RN_EMBEDDING_CACHE_FILE_ENTRIES);
+
+    static rn_embedding_key make_key(const std::string& text, enum llama_pooling_type pooling, bool add_bos);
+
+    // Copy the cached vector of key to out (n_embd floats); false on a miss
+    bool get(const rn_embedding_key& key, float* out);
+
+    void put(const rn_embedding_key& key, const float* embd);
+
+    rn_embedding_cache_stats stats();
+
+    // Write the file and drop everything; must be called before the model is freed
+    void close();
+
+private:
+    struct entry {
+        rn_embedding_key key;
+        std::vector<float> embd;
+    };
+
+    struct key_hash {
+        size_t operator()(const rn_embedding_key& key) const { return (size_t)(key.hi ^ key.lo); }
+    };
+
+    // File slot of a vector; an all-zero key marks a free slot
+    struct file_slot {
+        rn_embedding_key key;
+        uint64_t last_used;
+    };
+
+    void put_memory(const rn_embedding_key& key, const float* embd);
+
+    rn_embedding_cache_header* file_header();
+    file_slot* file_slots();
+    float* file_vector(size_t slot);
+
+    const llama_model* model_ = nullptr; // null until open()
+    int n_embd_ = 0;
+    size_t capacity_;
+    std::list<entry> entries_;  // most recently used first
+    std::unordered_map<rn_embedding_key, std::list<entry>::iterator, key_hash> index_;
+
+    std::unique_ptr<rn_mapped_file> file_;
+    rn_embedding_cache_stats stats_;
+    std::mutex mutex_;
+};
+
+} // namespace facebook::react
@@ -0,0 +1,284 @@
+#include "rn-embedding.hpp"
+#include "rn-quantize.hpp"
+
+#include <algorithm>
+#include <functional>
+#include <stdexcept>
+
+namespace facebook::react {
+
+enum llama_pooling_type rn_parse_pooling(const std::string& name) {
+    if (name == "mean") {
+        return LLAMA_POOLING_TYPE_MEAN;
+    }
+    if (name == "cls" || name == "first") {
+        return LLAMA_POOLING_TYPE_CLS;
+    }
+    if (name == "last") {
+        return LLAMA_POOLING_TYPE_LAST;
+    }
+    if (name == "none") {
+        return LLAMA_POOLING_TYPE_NONE;
+    }
+    if (name == "rank") {
+        return LLAMA_POOLING_TYPE_RANK;
+    }
+    throw std::runtime_error("Unknown pooling type: " + name);
+}
+
+enum llama_pooling_type rn_resolve_pooling(llama_context* ctx, enum llama_pooling_type pooling) {
+    const enum llama_pooling_type ctx_pooling = llama_pooling_type(ctx);
+    if (ctx_pooling != LLAMA_POOLING_TYPE_NONE) {
+        if (pooling != LLAMA_POOLING_TYPE_UNSPECIFIED && pooling != ctx_pooling) {
+            throw std::runtime_error("Requested pooling differs from the pooling the model was loaded with");
+        }
+        return ctx_pooling;
+    }
+    return pooling == LLAMA_POOLING_TYPE_UNSPECIFIED ? LLAMA_POOLING_TYPE_MEAN : pooling;
+}
+
+// Whether the model attends causally; BERT-style models declare otherwise in
+// their metadata, and encoders never do
+static bool uses_causal_attention(const llama_model* model) {
+    if (llama_model_has_encoder(model)) {
+        return false;
+    }
+    char arch[64] = {};
+    if (llama_model_meta_val_str(model, "general.architecture", arch, sizeof(arch)) < 0) {
+        return true;
+    }
+    char causal[16] = {};
+    const std::string key = std::string(arch) + ".attention.causal";
+    if (llama_model_meta_val_str(model, key.c_str(), causal, sizeof(causal)) < 0) {
+        return true;
+    }
+    return std::string(causal) != "false";
+}
+
+llama_context* rn_embedding_context(rn_llama_context* rn_ctx) {
+    if (rn_ctx->embd_ctx) {
+        return rn_ctx->embd_ctx;
+    }
+
+    const auto& params = rn_ctx->params;
+    int n_ctx = params.embd_n_ctx;
+    if (n_ctx <= 0) {
+        n_ctx = llama_model_n_ctx_train(rn_ctx->model);
+        if (rn_ctx->ctx) {
+            n_ctx = std::min(n_ctx, (int)llama_n_ctx(rn_ctx->ctx));
+        }
+    }
+    const int n_threads = params.embd_n_threads > 0 ? params.embd_n_threads
+                                                    : std::max(1, params.cpuparams.n_threads / 2);
+
+    llama_context_params cparams = common_context_params_to_llama(params);
+    cparams.n_ctx = n_ctx;
+    cparams.n_batch = n_ctx;
+    cparams.n_ubatch = n_ctx;
+    cparams.n_seq_max = RN_EMBEDDING_N_SEQ;
+    cparams.n_threads = n_threads;
+    cparams.n_threads_batch = n_threads;
+    cparams.embeddings = true;
+
+    rn_ctx->embd_ctx = llama_init_from_model(rn_ctx->model, cparams);
+    if (!rn_ctx->embd_ctx) {
+        throw std::runtime_error("Failed to create the embedding context");
+    }
+    return rn_ctx->embd_ctx;
+}
+
+// Run inputs packed as parallel sequences through the model in as few calls as
+// possible. output(pos, n) tells whether position pos of an n-token input needs
+// its output; collect(i, seq, idx) reads the outputs of input i, run as
+// sequence seq with its first token at batch index idx.
+//
+// Encoder models (T5-style) go through llama_encode, which takes a batch in a
+// single micro-batch. Models without causal attention (BERT-style) also need
+// every sequence whole in one micro-batch: llama.cpp keeps pooled sequences
+// whole, but without pooling the whole batch has to fit in n_ubatch.
+static void decode_packed(
+    rn_llama_context* rn_ctx,
+    const std::vector<std::vector<llama_token>>& inputs,
+    const std::function<bool(int, int)>& output,
+    const std::function<void(size_t, llama_seq_id, int)>& collect) {
+
+    llama_context* ctx = rn_embedding_context(rn_ctx);
+    const llama_model* model = rn_ctx->model;
+    const bool encoder = llama_model_has_encoder(model);
+    if (encoder && llama_model_has_decoder(model)) {
+        throw std::runtime_error("Embeddings are not supported for encoder-decoder models");
+    }
+
+    const bool pooled = llama_pooling_type(ctx) != LLAMA_POOLING_TYPE_NONE;
+    const bool causal = uses_causal_attention(model);
+    const int n_batch = (int)llama_n_batch(ctx);
+    const int n_ubatch = std::min(n_batch, (int)llama_n_ubatch(ctx));
+    const int n_max_tokens = encoder || pooled || !causal ? n_ubatch : n_batch;
+    const int n_batch_tokens = encoder || (!pooled && !causal) ? n_ubatch : n_batch;
+    const int n_seq_max = std::max(1, (int)llama_n_seq_max(ctx));
+
+    for (size_t i = 0; i < inputs.size(); ++i) {
+        if (inputs[i].empty()) {
+            throw std::runtime_error("Input " + std::to_string(i) + " has no tokens");
+        }
+        if ((int)inputs[i].size() > n_max_tokens) {
+            throw std::runtime_error("Input " + std::to_string(i) + " has " + std::to_string(inputs[i].size()) +
+                                     " tokens, more than the batch size of " + std::to_string(n_max_tokens));
+        }
+    }
+
+    llama_batch batch = llama_batch_init(n_batch, 0, 1);
+
+    try {
+        size_t next = 0;
+        while (next < inputs.size()) {
+            // Fill the batch with whole inputs, one sequence each
+            common_batch_clear(batch);
+            const size_t first = next;
+            while (next < inputs.size() && (int)(next - first) < n_seq_max &&
+                   batch.n_tokens + (int)inputs[next].size() <= n_batch_tokens) {
+                const auto& tokens = inputs[next];
+                const llama_seq_id seq = (llama_seq_id)(next - first);
+                const int n = (int)tokens.size();
+                for (int pos = 0; pos < n; ++pos) {
+                    common_batch_add(batch, tokens[pos], pos, { seq }, output(pos, n));
+                }
+                next++;
+            }
+
+            llama_kv_self_clear(ctx);
+            if (encoder) {
+                if (llama_encode(ctx, batch) != 0) {
+                    throw std::runtime_error("Failed to encode embedding batch");
+                }
+            } else if (llama_decode(ctx, batch) != 0) {
+                throw std::runtime_error("Failed to decode embedding batch");
+            }
+
+            int idx = 0;
+            for (size_t i = first; i < next; ++i) {
+                collect(i, (llama_seq_id)(i - first), idx);
+                idx += (int)inputs[i].size();
+            }
+        }
+    } catch (...) {
+        llama_kv_self_clear(ctx);
+        llama_batch_free(batch);
+        throw;
+    }
+
+    llama_kv_self_clear(ctx);
+    llama_batch_free(batch);
+}
+
+std::vector<float> rn_embed(
+    rn_llama_context* rn_ctx,
+    const std::vector<std::vector<llama_token>>& inputs,
+    enum llama_pooling_type pooling,
+    bool normalize) {
+
+    llama_context* ctx = rn_embedding_context(rn_ctx);
+    const int n_embd = llama_model_n_embd(rn_ctx->model);
+    if (n_embd <= 0) {
+        throw std::runtime_error("Invalid embedding dimension");
+    }
+
+    // Pooling configured on the context is done by llama.cpp; otherwise the
+    // requested pooling is applied to the token embeddings
+    const bool pooled = llama_pooling_type(ctx) != LLAMA_POOLING_TYPE_NONE;
+    pooling = rn_resolve_pooling(ctx, pooling);
+    if (pooling == LLAMA_POOLING_TYPE_NONE || pooling == LLAMA_POOLING_TYPE_RANK) {
+        throw std::runtime_error("Embeddings require mean, cls or last pooling");
+    }
+
+    std::vector<float> result(inputs.size() * n_embd, 0.0f);
+
+    const auto output = [&](int pos, int n) {
+        return pooled || pooling == LLAMA_POOLING_TYPE_MEAN ||
+               (pooling == LLAMA_POOLING_TYPE_CLS && pos == 0) ||
+               (pooling == LLAMA_POOLING_TYPE_LAST && pos == n - 1);
+    };
+
+    const auto collect = [&](size_t i, llama_seq_id seq, int idx) {
+        float* out = result.data() + i * n_embd;
+        const int n = (int)inputs[i].size();
+
+        if (pooled) {
+            const float* embd = llama_get_embeddings_seq(ctx, seq);
+            if (!embd) {
+                throw std::runtime_error("Failed to extract embeddings");
+            }
+            std::copy(embd, embd + n_embd, out);
+        } else {
+            // Batch positions of the token embeddings to pool
+            const int begin = pooling == LLAMA_POOLING_TYPE_LAST ? idx + n - 1 : idx;
+            const int end = pooling == LLAMA_POOLING_TYPE_MEAN ? idx + n : begin + 1;
+            for (int k = begin; k < end; ++k) {
+                const float* embd = llama_get_embeddings_ith(ctx, k);
+                if (!embd) {
+                    throw std::runtime_error("Failed to extract embeddings");
+                }
+                for (int j = 0; j < n_embd; ++j) {
+                    out[j] += embd[j];
+                }
+            }
+            for (int j = 0; j < n_embd; ++j) {
+                out[j] /= (float)(end - begin);
+            }
+        }
+
+        if (normalize) {
+            rn_normalize_f32(out, n_embd);
+        }
+    };
+
+    decode_packed(rn_ctx, inputs, output, collect);
+    return result;
+}
+
+std::vector<float> rn_rerank(
+    rn_llama_context* rn_ctx,
+    const std::string& query,
+    const std::vector<std::string>& documents) {
+
+    llama_context* ctx = rn_embedding_context(rn_ctx);
+    if (llama_pooling_type(ctx) != LLAMA_POOLING_TYPE_RANK) {
+        throw std::runtime_error("Reranking requires a reranker model loaded with rank pooling");
+    }
+
+    // Pairs are laid out as the reranker was trained, the same as llama.cpp's
+    // server: [BOS] query [EOS] [SEP] document [EOS]
+    const llama_vocab* vocab = rn_ctx->vocab;
+    const auto query_tokens = common_tokenize(vocab, query, false, false);
+    std::vector<std::vector<llama_token>> inputs;
+    inputs.reserve(documents.size());
+    for (const auto& document : documents) {
+        const auto doc_tokens = common_tokenize(vocab, document, false, false);
+        std::vector<llama_token> tokens;
+        tokens.reserve(query_tokens.size() + doc_tokens.size() + 4);
+        tokens.push_back(llama_vocab_bos(vocab));
+        tokens.insert(tokens.end(), query_tokens.begin(), query_tokens.end());
+        tokens.push_back(llama_vocab_eos(vocab));
+        tokens.push_back(llama_vocab_sep(vocab));
+        tokens.insert(tokens.end(), doc_tokens.begin(), doc_tokens.end());
+        tokens.push_back(llama_vocab_eos(vocab));
+        inputs.push_back(std::move(tokens));
+    }
+
+    std::vector<float> scores(documents.size(), 0.0f);
+
+    // The classification head scores each pooled sequence
+    const auto output = [](int, int) { return true; };
+    const auto collect = [&](size_t i, llama_seq_id seq, int) {
+        const float* score = llama_get_embeddings_seq(ctx, seq);
+        if (!score) {
+            throw std::runtime_error("Failed to extract rerank score");
+        }
+        scores[i] = score[0];
+    };
+
+    decode_packed(rn_ctx, inputs, output, collect);
+    return scores;
+}
+
+} // namespace facebook::react
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "rn-llama.hpp"
+
+#include <string>
+#include <vector>
+
+namespace facebook::react {
+
+#define RN_EMBEDDING_N_SEQ 16  // inputs packed into one embedding batch
+
+// Pooling named by the options: "mean", "cls" (or "first"), "last", "none" or
+// "rank". Throws std::runtime_error on an unknown name.
+enum llama_pooling_type rn_parse_pooling(const std::string& name);
+
+// Pooling an embedding request gets on ctx: the context's own pooling if it
+// has one, else pooling, with LLAMA_POOLING_TYPE_UNSPECIFIED meaning mean.
+// Throws std::runtime_error if pooling contradicts the context's.
+enum llama_pooling_type rn_resolve_pooling(llama_context* ctx, enum llama_pooling_type pooling);
+
+// The embedding context of rn_ctx, created from its model on first use with
+// embeddings enabled and n_batch = n_ubatch = n_ctx, so an input as long as the
+// context is processed in one pass. n_ctx is params.embd_n_ctx if set, else the
+// smaller of the model's training context and the main context, so every input
+// the main context takes can be embedded. It uses half the generation threads
+// unless configured. The caller must hold rn_ctx->embd_mutex.
+// Throws std::runtime_error if the context cannot be created.
+llama_context* rn_embedding_context(rn_llama_context* rn_ctx);
+
+// Embed several inputs with as few decode calls as possible. The inputs are
+// packed as separate sequences into batches of up to n_batch tokens and one
+// sequence per context slot. When the context was created with a pooling type,
+// llama.cpp pools each sequence and pooling must match it (or be
+// LLAMA_POOLING_TYPE_UNSPECIFIED); otherwise the token embeddings are pooled
+// here. Encoder models run through llama_encode and, like other models without
+// causal attention, take each input in one micro-batch, so inputs must fit in
+// n_ubatch. Returns n_inputs rows of n_embd floats, L2-normalized if normalize.
+//
+// Runs on the embedding context; the caller must hold rn_ctx->embd_mutex.
+// Throws std::runtime_error on failure.
+std::vector<float> rn_embed(
+    rn_llama_context* rn_ctx,
+    const std::vector<std::vector<llama_token>>& inputs,
+    enum llama_pooling_type pooling,
+    bool normalize = true);
+
+// Score how relevant each document is to query with a cross-encoder. Every
+// (query, document) pair is a sequence of its own, packed into as few decode
+// calls as rn_embed packs inputs, and scored by the model's classification
+// head; higher is more relevant. Requires a context with rank pooling, and
+// each pair must fit in n_ubatch tokens.
+//
+// Runs on the embedding context; the caller must hold rn_ctx->embd_mutex.
+// Throws std::runtime_error on failure.
+std::vector<float> rn_rerank(
+    rn_llama_context* rn_ctx,
+    const std::string& query,
+    const std::vector<std::string>& documents);
+
+} // namespace facebook::react
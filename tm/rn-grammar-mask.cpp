@@ -0,0 +1,249 @@
+#include "rn-grammar-mask.hpp"
+#include "rn-simd.hpp"
+#include "common.h"
+#include "llama-cpp.h"
+
+#include <algorithm>
+#include <cmath>
+#include <string>
+
+namespace facebook::react {
+
+void rn_grammar_mask::build_trie(const llama_vocab* vocab) {
+    vocab_ = vocab;
+    n_vocab_ = llama_vocab_n_tokens(vocab);
+
+    order_.clear();
+    eog_tokens_.clear();
+    roots_.clear();
+    root_bytes_.clear();
+    first_bytes_.assign(n_vocab_, -1);
+    std::fill(std::begin(byte_tokens_), std::end(byte_tokens_), LLAMA_TOKEN_NULL);
+
+    // Same text as the grammar sampler sees: the piece with special tokens rendered
+    std::vector<std::string> pieces(n_vocab_);
+    for (llama_token token = 0; token < n_vocab_; ++token) {
+        if (llama_vocab_is_eog(vocab, token)) {
+            eog_tokens_.push_back(token);
+            continue;
+        }
+        pieces[token] = common_token_to_piece(vocab, token, true);
+        // The grammar always rejects empty pieces, leave them out of the mask
+        if (!pieces[token].empty() && pieces[token][0] != '\0') {
+            order_.push_back(token);
+        }
+    }
+
+    std::sort(order_.begin(), order_.end(), [&pieces](llama_token a, llama_token b) {
+        return pieces[a] < pieces[b];
+    });
+
+    // Every token is followed by the tokens its text is a prefix of; close the
+    // subtrees of the open tokens that are not a prefix of the next one
+    subtree_end_.assign(order_.size(), (int32_t)order_.size());
+    std::vector<int32_t> open;
+    for (int32_t i = 0; i < (int32_t)order_.size(); ++i) {
+        const std::string& piece = pieces[order_[i]];
+        while (!open.empty()) {
+            const std::string& prefix = pieces[order_[open.back()]];
+            if (piece.compare(0, prefix.size(), prefix) == 0) {
+                break;
+            }
+            subtree_end_[open.back()] = i;
+            open.pop_back();
+        }
+        open.push_back(i);
+    }
+
+    for (int32_t i = 0; i < (int32_t)order_.size(); i = subtree_end_[i]) {
+        roots_.push_back(i);
+        root_bytes_.push_back((uint8_t)pieces[order_[i]][0]);
+    }
+    for (llama_token token : order_) {
+        const std::string& piece = pieces[token];
+        first_bytes_[token] = (uint8_t)piece[0];
+        if (piece.size() == 1 && byte_tokens_[(uint8_t)piece[0]] == LLAMA_TOKEN_NULL) {
+            byte_tokens_[(uint8_t)piece[0]] = token;
+        }
+    }
+}
+
+void rn_grammar_mask::compute(const llama_vocab* vocab, llama_sampler* grammar, std::vector<uint64_t>& mask) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    if (vocab_ != vocab) {
+        build_trie(vocab);
+    }
+
+    mask.assign((n_vocab_ + 63) / 64, 0);
+
+    auto probe = [&]() {
+        llama_token_data_array cur_p = { probe_.data(), probe_.size(), -1, false };
+        llama_sampler_apply(grammar, &cur_p);
+    };
+    auto set_bit = [&mask](llama_token token) {
+        mask[token / 64] |= 1ULL << (token % 64);
+    };
+
+    // End-of-generation tokens only depend on whether the grammar can end here
+    probe_.clear();
+    for (llama_token token : eog_tokens_) {
+        probe_.push_back({ token, 0.0f, 0.0f });
+    }
+    probe();
+    for (const auto& data : probe_) {
+        if (data.logit != -INFINITY) {
+            set_bit(data.id);
+        }
+    }
+
+    // Walk the trie one level per grammar call, descending into accepted tokens only
+    frontier_ = roots_;
+
+    while (!frontier_.empty()) {
+        probe_.clear();
+        for (int32_t i : frontier_) {
+            probe_.push_back({ order_[i], 0.0f, 0.0f });
+        }
+        probe();
+
+        next_frontier_.clear();
+        for (size_t k = 0; k < frontier_.size(); ++k) {
+            if (probe_[k].logit == -INFINITY) {
+                continue;
+            }
+            set_bit(probe_[k].id);
+
+            const int32_t i = frontier_[k];
+            for (int32_t child = i + 1; child < subtree_end_[i]; child = subtree_end_[child]) {
+                next_frontier_.push_back(child);
+            }
+        }
+        frontier_.swap(next_frontier_);
+    }
+}
+
+std::string rn_grammar_mask::forced_text(const llama_vocab* vocab, llama_sampler* grammar, size_t max_bytes) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    if (vocab_ != vocab) {
+        build_trie(vocab);
+    }
+
+    // Every accepted token starts with the first byte of an accepted root, so
+    // checking the roots tells which bytes can come next. The grammar is only
+    // copied once a byte turns out to be forced.
+    std::string text;
+    llama_sampler_ptr copy;
+    llama_sampler* current = grammar;
+
+    while (text.size() < max_bytes) {
+        probe_.clear();
+        for (llama_token token : eog_tokens_) {
+            probe_.push_back({ token, 0.0f, 0.0f });
+        }
+        for (int32_t i : roots_) {
+            probe_.push_back({ order_[i], 0.0f, 0.0f });
+        }
+        llama_token_data_array cur_p = { probe_.data(), probe_.size(), -1, false };
+        llama_sampler_apply(current, &cur_p);
+
+        bool forced = true;
+        for (size_t k = 0; k < eog_tokens_.size(); ++k) {
+            forced = forced && probe_[k].logit == -INFINITY;
+        }
+
+        int byte = -1;
+        for (size_t k = 0; forced && k < roots_.size(); ++k) {
+            if (probe_[eog_tokens_.size() + k].logit == -INFINITY) {
+                continue;
+            }
+            if (byte >= 0 && byte != root_bytes_[k]) {
+                forced = false;
+            }
+            byte = root_bytes_[k];
+        }
+
+        if (!forced || byte < 0 || byte_tokens_[byte] == LLAMA_TOKEN_NULL) {
+            break;
+        }
+
+        if (!copy) {
+            copy.reset(llama_sampler_clone(grammar));
+            current = copy.get();
+        }
+        llama_sampler_accept(current, byte_tokens_[byte]);
+        text += (char)byte;
+    }
+
+    // Drop a trailing incomplete UTF-8 sequence
+    size_t n_cont = 0;
+    while (n_cont < text.size() && n_cont < 3 && ((uint8_t)text[text.size() - 1 - n_cont] & 0xC0) == 0x80) {
+        n_cont++;
+    }
+    if (n_cont < text.size()) {
+        const uint8_t lead = (uint8_t)text[text.size() - 1 - n_cont];
+        const size_t n_len = lead < 0x80 ? 1 : (lead >> 5) == 0x6 ? 2 : (lead >> 4) == 0xE ? 3 : 4;
+        if (n_cont + 1 < n_len) {
+            text.resize(text.size() - 1 - n_cont);
+        }
+    }
+
+    return text;
+}
+
+bool rn_grammar_mask::single_prefix(const std::vector<uint64_t>& mask) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    // Stops at the second distinct byte, so free text costs a couple of tokens
+    int byte = -1;
+    for (size_t w = 0; w < mask.size(); ++w) {
+        for (uint64_t bits = mask[w]; bits != 0; bits &= bits - 1) {
+            const size_t token = w * 64 + __builtin_ctzll(bits);
+            if (token >= first_bytes_.size() || first_bytes_[token] < 0) {
+                return false;
+            }
+            if (byte >= 0 && byte != first_bytes_[token]) {
+                return false;
+            }
+            byte = first_bytes_[token];
+        }
+    }
+    return byte >= 0;
+}
+
+void rn_grammar_mask::apply(const std::vector<uint64_t>& mask, float* logits, int n_vocab) {
+    // Whole words of accepted tokens are skipped, which is most of the vocab
+    // inside free text and none of it in the structural parts of a schema
+    for (size_t w = 0; w < mask.size(); ++w) {
+        const uint64_t bits = mask[w];
+        if (bits == ~0ULL) {
+            continue;
+        }
+        const int base = (int)(w * 64);
+        const int end = std::min(base + 64, n_vocab);
+        if (end - base == 64) {
+            rn_mask_f32_64(logits + base, bits);
+            continue;
+        }
+        for (int token = base; token < end; ++token) {
+            if (!((bits >> (token - base)) & 1)) {
+                logits[token] = -INFINITY;
+            }
+        }
+    }
+}
+
+void rn_grammar_mask::clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    vocab_ = nullptr;
+    n_vocab_ = 0;
+    order_.clear();
+    subtree_end_.clear();
+    eog_tokens_.clear();
+    roots_.clear();
+    root_bytes_.clear();
+    first_bytes_.clear();
+}
+
+} // namespace facebook::react
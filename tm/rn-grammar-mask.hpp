@@ -0,0 +1,76 @@
+#pragma once
+
+#include "llama.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace facebook::react {
+
+#define RN_GRAMMAR_FORCED_MAX_BYTES 256
+
+// Computes the set of tokens a grammar accepts next as a bitset over the vocab.
+//
+// The grammar's stacks are private to llama.cpp, so tokens can only be checked
+// through the grammar sampler. Instead of checking every token, the vocab is
+// arranged as a trie of token texts: a token whose text is rejected rules out
+// every token that starts with that text, so only the children of accepted
+// tokens are checked, one trie level per grammar call. In the structural parts
+// of a JSON schema, where only a few bytes can come next, this checks a few
+// hundred tokens instead of the whole vocab.
+//
+// Masks are not cached: the grammar's stacks are not exposed, and a hash of
+// the accepted tokens almost never repeats, so a cache would not be hit.
+class rn_grammar_mask {
+public:
+    rn_grammar_mask() = default;
+
+    rn_grammar_mask(const rn_grammar_mask&) = delete;
+    rn_grammar_mask& operator=(const rn_grammar_mask&) = delete;
+
+    // Fill mask with one bit per token, set if the grammar accepts the token next
+    void compute(const llama_vocab* vocab, llama_sampler* grammar, std::vector<uint64_t>& mask);
+
+    // Text the grammar forces next: the bytes that follow while exactly one
+    // byte can come next and the grammar cannot end, up to max_bytes and
+    // without a trailing incomplete UTF-8 sequence. The grammar is not modified.
+    std::string forced_text(const llama_vocab* vocab, llama_sampler* grammar, size_t max_bytes);
+
+    // True if every token in a mask computed by compute starts with the same
+    // byte and no end-of-generation token is in it. The grammar then allowed a
+    // single prefix, so the text after the sampled token is likely forced too.
+    bool single_prefix(const std::vector<uint64_t>& mask);
+
+    // Set the logits of the tokens missing from mask to -INFINITY
+    static void apply(const std::vector<uint64_t>& mask, float* logits, int n_vocab);
+
+    // Drop the trie; must be called before the vocab is freed
+    void clear();
+
+private:
+    void build_trie(const llama_vocab* vocab);
+
+    // Tokens sorted by text, so that the tokens starting with a token's text
+    // follow it: subtree_end_[i] is one past the last of them
+    const llama_vocab* vocab_ = nullptr;
+    int n_vocab_ = 0;
+    std::vector<llama_token> order_;
+    std::vector<int32_t> subtree_end_;
+    std::vector<llama_token> eog_tokens_; // end-of-generation tokens, accepted or not regardless of their text
+    std::vector<int32_t> roots_;          // tokens no other token's text is a prefix of
+    std::vector<uint8_t> root_bytes_;     // first byte of each root
+    std::vector<int16_t> first_bytes_;    // first byte of each token's text, -1 if it is not in the trie
+    llama_token byte_tokens_[256];        // token whose text is the single byte, or LLAMA_TOKEN_NULL
+
+    // Scratch buffers of the trie walk
+    std::vector<int32_t> frontier_;
+    std::vector<int32_t> next_frontier_;
+    std::vector<llama_token_data> probe_;
+
+    std::mutex mutex_;
+};
+
+} // namespace facebook::react
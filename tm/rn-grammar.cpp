@@ -0,0 +1,131 @@
+#include "rn-grammar.hpp"
+#include "ggml.h"
+
+#include <algorithm>
+#include <functional>
+
+namespace facebook::react {
+
+rn_grammar_cache::rn_grammar_cache(size_t capacity)
+    : capacity_(std::max<size_t>(1, capacity)) {}
+
+// Build a lazy grammar sampler the same way common_sampler_init does. Trigger
+// words are always matched as text, since the model may produce them merged
+// with the text around them; only token triggers are matched by id.
+static llama_sampler* init_lazy_grammar(
+    const llama_vocab* vocab, const std::string& grammar, const std::vector<common_grammar_trigger>& triggers) {
+
+    std::vector<std::string> patterns_at_start;
+    std::vector<std::string> patterns_anywhere;
+    std::vector<llama_token> trigger_tokens;
+
+    for (const auto& trigger : triggers) {
+        switch (trigger.type) {
+            case COMMON_GRAMMAR_TRIGGER_TYPE_WORD:
+                patterns_anywhere.push_back(regex_escape(trigger.value));
+                break;
+            case COMMON_GRAMMAR_TRIGGER_TYPE_PATTERN:
+                patterns_anywhere.push_back(trigger.value);
+                break;
+            case COMMON_GRAMMAR_TRIGGER_TYPE_PATTERN_START:
+                patterns_at_start.push_back(trigger.value);
+                break;
+            case COMMON_GRAMMAR_TRIGGER_TYPE_TOKEN: {
+                if (trigger.token != LLAMA_TOKEN_NULL) {
+                    trigger_tokens.push_back(trigger.token);
+                    break;
+                }
+                const auto ids = common_tokenize(vocab, trigger.value, false, true);
+                if (ids.size() != 1) {
+                    return nullptr;
+                }
+                trigger_tokens.push_back(ids[0]);
+                break;
+            }
+        }
+    }
+
+    std::vector<std::string> trigger_patterns;
+    if (!patterns_at_start.empty()) {
+        trigger_patterns.push_back("^(" + string_join(patterns_at_start, "|") + ")[\\s\\S]*");
+    }
+    if (!patterns_anywhere.empty()) {
+        trigger_patterns.push_back("^[\\s\\S]*?(" + string_join(patterns_anywhere, "|") + ")[\\s\\S]*");
+    }
+
+    std::vector<const char*> trigger_patterns_c;
+    trigger_patterns_c.reserve(trigger_patterns.size());
+    for (const auto& pattern : trigger_patterns) {
+        trigger_patterns_c.push_back(pattern.c_str());
+    }
+
+    return llama_sampler_init_grammar_lazy_patterns(vocab, grammar.c_str(), "root",
+        trigger_patterns_c.data(), trigger_patterns_c.size(),
+        trigger_tokens.data(), trigger_tokens.size());
+}
+
+llama_sampler_ptr rn_grammar_cache::acquire(
+    const llama_vocab* vocab,
+    const std::string& grammar,
+    bool lazy,
+    const std::vector<common_grammar_trigger>& triggers,
+    bool& cache_hit,
+    double& build_ms) {
+
+    const int64_t t_start = ggml_time_us();
+
+    std::string key = grammar;
+    if (lazy) {
+        key += '\0';
+        for (const auto& trigger : triggers) {
+            key += std::to_string((int)trigger.type) + ':' + std::to_string(trigger.token) + ':' + trigger.value + '\0';
+        }
+    }
+    const size_t hash = std::hash<std::string>{}(key);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto it = index_.find(hash);
+    if (it != index_.end() && it->second->key == key) {
+        // Move the entry to the front and hand out a copy of its parsed grammar
+        entries_.splice(entries_.begin(), entries_, it->second);
+        llama_sampler_ptr sampler(llama_sampler_clone(entries_.front().sampler.get()));
+
+        cache_hit = true;
+        build_ms = (ggml_time_us() - t_start) / 1000.0;
+        return sampler;
+    }
+
+    llama_sampler_ptr parsed(lazy
+        ? init_lazy_grammar(vocab, grammar, triggers)
+        : llama_sampler_init_grammar(vocab, grammar.c_str(), "root"));
+    if (!parsed) {
+        return nullptr;
+    }
+    llama_sampler_ptr sampler(llama_sampler_clone(parsed.get()));
+
+    // A different grammar with the same hash is replaced
+    if (it != index_.end()) {
+        entries_.erase(it->second);
+        index_.erase(it);
+    }
+    entries_.push_front({ hash, std::move(key), std::move(parsed) });
+    index_[hash] = entries_.begin();
+
+    if (entries_.size() > capacity_) {
+        index_.erase(entries_.back().hash);
+        entries_.pop_back();
+    }
+
+    cache_hit = false;
+    build_ms = (ggml_time_us() - t_start) / 1000.0;
+    return sampler;
+}
+
+void rn_grammar_cache::clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    index_.clear();
+    entries_.clear();
+}
+
+} // namespace facebook::react
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "common.h"
+#include "llama.h"
+#include "llama-cpp.h"
+
+#include <cstddef>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace facebook::react {
+
+#define RN_GRAMMAR_CACHE_SIZE 16
+
+// LRU cache of parsed grammars. Parsing GBNF and building the grammar stacks
+// happens once per distinct grammar text; requests get a clone of the cached
+// grammar sampler, which copies the parsed rules and stacks without parsing
+// again. Entries are keyed by the hash of the grammar text and, for lazy
+// grammars, of their triggers.
+class rn_grammar_cache {
+public:
+    explicit rn_grammar_cache(size_t capacity = RN_GRAMMAR_CACHE_SIZE);
+
+    rn_grammar_cache(const rn_grammar_cache&) = delete;
+    rn_grammar_cache& operator=(const rn_grammar_cache&) = delete;
+
+    // Return a grammar sampler for the grammar, owned by the caller. Returns
+    // null if the grammar does not parse. cache_hit tells whether parsing was
+    // skipped and build_ms how long it took to get the sampler.
+    //
+    // A lazy grammar leaves sampling unconstrained until one of the triggers
+    // appears in the output, and constrains the text from the trigger on.
+    llama_sampler_ptr acquire(
+        const llama_vocab* vocab,
+        const std::string& grammar,
+        bool lazy,
+        const std::vector<common_grammar_trigger>& triggers,
+        bool& cache_hit,
+        double& build_ms);
+
+    // Drop all entries; must be called before the vocab they were built with is freed
+    void clear();
+
+private:
+    struct entry {
+        size_t hash;
+        std::string key;  // grammar text followed by the triggers of a lazy grammar
+        llama_sampler_ptr sampler;
+    };
+
+    size_t capacity_;
+    std::list<entry> entries_;  // most recently used first
+    std::unordered_map<size_t, std::list<entry>::iterator> index_;
+    std::mutex mutex_;
+};
+
+} // namespace facebook::react
@@ -5,11 +5,21 @@
 #include "chat.h"
 #include "chat-template.hpp"
 #include "json-schema-to-grammar.h"
+#include "ngram-cache.h"
 #include "rn-utils.hpp"
+#include "rn-grammar.hpp"
+#include "rn-grammar-mask.hpp"
+#include "rn-embedding-cache.hpp"
 
+#include <atomic>
+#include <condition_variable>
+#include <deque>
 #include <functional>
+#include <future>
+#include <memory>
 #include <mutex>
 #include <string>
+#include <thread>
 #include <vector>
 
 // Forward declarations
@@ -19,12 +29,110 @@ struct llama_vocab;
 
 namespace facebook::react {
 
+// Minimum time between two saves of the dynamic lookup cache
+#define RN_LOOKUP_CACHE_SAVE_INTERVAL_MS 30000
+
 // Extend common_params with additional fields needed by our implementation
 struct rn_common_params : common_params {
     bool debug = false;
     common_chat_format chat_format = COMMON_CHAT_FORMAT_CONTENT_ONLY;
     common_reasoning_format reasoning_format = COMMON_REASONING_FORMAT_NONE;
     bool use_jinja = false;
+
+    // Embedding context, 0 for the defaults of rn-embedding.hpp
+    int32_t embd_n_ctx = 0;
+    int32_t embd_n_threads = 0;
+};
+
+struct rn_llama_context;
+struct completion_task;
+struct completion_slot;
+
+// Cancellation handle of one completion request, shared between the caller and
+// the scheduler. The scheduler checks it between decode steps and from the
+// context's abort callback, so a cancelled prompt stops in the middle of a batch.
+struct rn_cancel_token {
+    std::atomic<bool> cancelled{false};
+    std::atomic<int64_t> t_cancel_us{0};  // when cancel() was first called
+
+    void cancel() {
+        int64_t expected = 0;
+        t_cancel_us.compare_exchange_strong(expected, ggml_time_us());
+        cancelled = true;
+    }
+};
+
+// Runs completion requests on a shared llama_context. Every in-flight request
+// is assigned a slot, which owns one sequence id of the context; each iteration
+// of the scheduler thread decodes one step of every active sequence in a single
+// llama_batch, so requests can join and leave between steps.
+class rn_completion_scheduler {
+public:
+    explicit rn_completion_scheduler(rn_llama_context* rn_ctx);
+    ~rn_completion_scheduler();
+
+    // Queue a request and block until it is done. Streamed text is passed to the
+    // callback on the calling thread; returning false from it or cancelling the
+    // token stops the request.
+    CompletionResult submit(
+        const CompletionOptions& options,
+        std::function<bool(const CompletionChunk&, bool)> callback,
+        std::shared_ptr<rn_cancel_token> cancel = nullptr);
+
+    // Run op on the scheduler thread between two decode steps, with exclusive
+    // use of the context, and wait for it. op returns false to be run again
+    // after the next step. Rethrows what op throws.
+    void run_exclusive(std::function<bool()> op);
+
+    // Save the sequence of a slot to a session file; slot -1 is the slot of
+    // the completion that finished last. Returns the number of tokens saved.
+    size_t save_session(const std::string& path, int slot = -1);
+
+    // Restore a session file into a slot, waiting for it to be idle; slot -1
+    // is the least recently used idle slot. The slot's cached tokens become
+    // the session's, so the next prompt that continues them is given that
+    // slot. Returns the slot.
+    int load_session(const std::string& path, int slot = -1);
+
+    // Stop the scheduler thread, failing any queued or running request
+    void stop();
+
+    int n_slots() const;
+
+private:
+    void loop();
+    void run_ops();
+    void launch_slot(completion_slot& slot);
+    void update_slots();
+    void finish_slot(completion_slot& slot);
+    void fail_slot(completion_slot& slot, const std::string& error_msg, rn_error_type error_type);
+    void free_draft_contexts();
+    bool snapshot_lookup_cache(common_ngram_cache& snapshot, bool force);
+    void save_lookup_cache(const common_ngram_cache& cache);
+
+    // llama_set_abort_callback hook: aborts a decode once every request in the batch is cancelled
+    static bool abort_callback(void* data);
+
+    rn_llama_context* rn_ctx_;
+    std::vector<completion_slot> slots_;
+    int last_slot_ = 0; // slot of the completion that finished last
+    int64_t t_lookup_saved_us_ = 0;
+    llama_batch batch_ = {};
+    int n_batch_ = 0;
+    bool aborted_ = false; // set by abort_callback when it stops the current decode
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::deque<std::shared_ptr<completion_task>> pending_;
+
+    // Operations waiting for the context, such as session saves and loads
+    struct exclusive_op {
+        std::function<bool()> fn;
+        std::promise<void> done;
+    };
+    std::deque<std::shared_ptr<exclusive_op>> ops_;
+    std::atomic<bool> stopping_{false};
+    std::thread thread_;
 };
 
 // Main context structure for React Native integration
@@ -37,12 +145,51 @@ struct rn_llama_context {
     llama_context* ctx = nullptr;
     const llama_vocab* vocab = nullptr;
 
+    // Optional draft model for speculative decoding; every scheduler slot
+    // creates its own draft context from it
+    llama_model* model_dft = nullptr;
+
+    // Prompt lookup decoding drafts tokens from n-gram statistics instead of a
+    // draft model. The static cache is built offline from a text corpus, the
+    // dynamic one accumulates previous requests and is saved to
+    // params.lookup_cache_dynamic when the scheduler is idle, at most every
+    // RN_LOOKUP_CACHE_SAVE_INTERVAL_MS, and when it stops.
+    bool lookup_decoding = false;
+    common_ngram_cache lookup_cache_static;
+    common_ngram_cache lookup_cache_dynamic;
+    bool lookup_cache_dirty = false;
+
+    // Parsed grammars shared by the requests, so that repeated constrained
+    // requests (e.g. JSON mode with the same schema) skip GBNF parsing
+    rn_grammar_cache grammar_cache;
+
+    // Token trie that computes allowed-token masks, for the sampled tokens the grammar rejects
+    rn_grammar_mask grammar_mask;
+
+    // Context of embedding and rerank requests, created from the same model on
+    // first use so they never touch the KV cache of completions. Guarded by
+    // embd_mutex rather than mutex, so embeddings run alongside generation.
+    llama_context* embd_ctx = nullptr;
+    std::mutex embd_mutex;
+
+    // Embedding vectors by content, optionally persisted next to other caches
+    rn_embedding_cache embedding_cache;
+
     // Extensions
     std::vector<common_adapter_lora_info> lora_adapters;
     common_chat_templates_ptr chat_templates;
 
+    // Tokens currently held in the KV cache, indexed by sequence id, used to reuse
+    // the longest common prefix between consecutive completions on a sequence
+    std::vector<std::vector<llama_token>> cache_tokens;
+
+    // Completion scheduler, created once the context is ready
+    std::unique_ptr<rn_completion_scheduler> scheduler;
+
     // State
     bool model_loaded = false;
+
+    // Guards exclusive use of ctx; held by the scheduler thread for each decode step
     std::mutex mutex;
 };
 
@@ -50,11 +197,13 @@ struct rn_llama_context {
 CompletionResult run_completion(
     rn_llama_context* rn_ctx,
     const CompletionOptions& options,
-    std::function<bool(const std::string&, bool)> callback);
+    std::function<bool(const CompletionChunk&, bool)> callback,
+    std::shared_ptr<rn_cancel_token> cancel = nullptr);
 
 CompletionResult run_chat_completion(
     rn_llama_context* rn_ctx,
     const CompletionOptions& options,
-    std::function<bool(const std::string&, bool)> callback);
+    std::function<bool(const CompletionChunk&, bool)> callback,
+    std::shared_ptr<rn_cancel_token> cancel = nullptr);
 
 } // namespace facebook::react
\ No newline at end of file
@@ -0,0 +1,131 @@
+#include "rn-mapped-file.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
+
+#if defined(__APPLE__) || defined(__ANDROID__) || defined(__linux__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define RN_MAPPED_FILE_USE_MMAP 1
+#endif
+
+namespace facebook::react {
+
+rn_mapped_file::rn_mapped_file(const std::string& path, size_t size) : path_(path) {
+#ifdef RN_MAPPED_FILE_USE_MMAP
+    fd_ = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd_ < 0) {
+        throw std::runtime_error("Failed to open file: " + path);
+    }
+    struct stat st;
+    if (fstat(fd_, &st) != 0) {
+        close(fd_);
+        throw std::runtime_error("Failed to stat file: " + path);
+    }
+    initial_size_ = st.st_size;
+#else
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (file) {
+        buffer_.resize(file.tellg());
+        file.seekg(0);
+        if (!file.read(reinterpret_cast<char*>(buffer_.data()), buffer_.size())) {
+            throw std::runtime_error("Failed to read file: " + path);
+        }
+    }
+    initial_size_ = buffer_.size();
+#endif
+    try {
+        map(std::max(size, initial_size_));
+    } catch (...) {
+        unmap();
+        throw;
+    }
+}
+
+rn_mapped_file::~rn_mapped_file() {
+    try {
+        sync();
+    } catch (const std::exception& e) {
+        fprintf(stderr, "Warning: %s\n", e.what());
+    }
+    unmap();
+}
+
+void rn_mapped_file::map(size_t size) {
+#ifdef RN_MAPPED_FILE_USE_MMAP
+    if (data_) {
+        munmap(data_, size_);
+        data_ = nullptr;
+    }
+    if (ftruncate(fd_, (off_t)size) != 0) {
+        throw std::runtime_error("Failed to resize file: " + path_);
+    }
+    size_ = size;
+    if (size == 0) {
+        return;
+    }
+    void* addr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+    if (addr == MAP_FAILED) {
+        size_ = 0;
+        throw std::runtime_error("Failed to map file: " + path_);
+    }
+    data_ = static_cast<uint8_t*>(addr);
+#else
+    buffer_.resize(size, 0);
+    data_ = buffer_.data();
+    size_ = size;
+#endif
+}
+
+void rn_mapped_file::unmap() {
+#ifdef RN_MAPPED_FILE_USE_MMAP
+    if (data_) {
+        munmap(data_, size_);
+        data_ = nullptr;
+    }
+    if (fd_ >= 0) {
+        close(fd_);
+        fd_ = -1;
+    }
+#endif
+}
+
+void rn_mapped_file::resize(size_t size) {
+    map(size);
+}
+
+void rn_mapped_file::reset(size_t size) {
+#ifdef RN_MAPPED_FILE_USE_MMAP
+    if (data_) {
+        munmap(data_, size_);
+        data_ = nullptr;
+    }
+    if (ftruncate(fd_, 0) != 0) {
+        size_ = 0;
+        throw std::runtime_error("Failed to resize file: " + path_);
+    }
+    size_ = 0;
+#else
+    buffer_.clear();
+#endif
+    map(size);
+}
+
+void rn_mapped_file::sync() {
+#ifdef RN_MAPPED_FILE_USE_MMAP
+    if (data_ && msync(data_, size_, MS_SYNC) != 0) {
+        throw std::runtime_error("Failed to sync file: " + path_);
+    }
+#else
+    std::ofstream file(path_, std::ios::binary | std::ios::trunc);
+    if (!file.write(reinterpret_cast<const char*>(buffer_.data()), buffer_.size())) {
+        throw std::runtime_error("Failed to write file: " + path_);
+    }
+#endif
+}
+
+} // namespace facebook::react
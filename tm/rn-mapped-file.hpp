@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace facebook::react {
+
+// Read-write view of a file, memory-mapped and shared with the file where the
+// platform supports it, so writes reach the file without an explicit save and
+// large files open without being read. Elsewhere the file is read into a heap
+// buffer that sync() writes back.
+class rn_mapped_file {
+public:
+    // Open path, creating it if needed, and grow it to at least size bytes;
+    // bytes past the previous end of the file are zero.
+    // Throws std::runtime_error on failure.
+    rn_mapped_file(const std::string& path, size_t size);
+    ~rn_mapped_file();
+
+    rn_mapped_file(const rn_mapped_file&) = delete;
+    rn_mapped_file& operator=(const rn_mapped_file&) = delete;
+
+    uint8_t* data() { return data_; }
+    const uint8_t* data() const { return data_; }
+    size_t size() const { return size_; }
+
+    // Size of the file before it was opened, 0 if it was created
+    size_t initial_size() const { return initial_size_; }
+
+    // Grow or shrink the file; the data pointer changes
+    void resize(size_t size);
+
+    // Discard the contents and leave size zero bytes; the data pointer changes.
+    // Where the file is mapped this truncates it instead of writing the zeros,
+    // so no page is touched until it is used.
+    void reset(size_t size);
+
+    // Write pending changes to storage
+    void sync();
+
+private:
+    void map(size_t size);
+    void unmap();
+
+    std::string path_;
+    uint8_t* data_ = nullptr;
+    size_t size_ = 0;
+    size_t initial_size_ = 0;
+    int fd_ = -1;
+    std::vector<uint8_t> buffer_;
+};
+
+} // namespace facebook::react
@@ -0,0 +1,47 @@
+#include "rn-quantize.hpp"
+#include "rn-simd.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace facebook::react {
+
+void rn_normalize_f32(float* vec, size_t n) {
+    const float norm = std::sqrt(rn_dot_f32(vec, vec, n));
+    if (norm > 0.0f) {
+        const float scale = 1.0f / norm;
+        for (size_t i = 0; i < n; ++i) {
+            vec[i] *= scale;
+        }
+    }
+}
+
+float rn_quantize_int8(const float* vec, size_t n, int8_t* out) {
+    float max_abs = 0.0f;
+    for (size_t i = 0; i < n; ++i) {
+        max_abs = std::max(max_abs, std::fabs(vec[i]));
+    }
+    if (max_abs == 0.0f) {
+        std::memset(out, 0, n);
+        return 0.0f;
+    }
+
+    const float scale = max_abs / 127.0f;
+    const float inv = 1.0f / scale;
+    for (size_t i = 0; i < n; ++i) {
+        out[i] = (int8_t)std::clamp(std::lround(vec[i] * inv), -127L, 127L);
+    }
+    return scale;
+}
+
+void rn_quantize_binary(const float* vec, size_t n, uint8_t* out) {
+    std::memset(out, 0, rn_binary_size(n));
+    for (size_t i = 0; i < n; ++i) {
+        if (vec[i] > 0.0f) {
+            out[i / 8] |= (uint8_t)(0x80u >> (i % 8));
+        }
+    }
+}
+
+} // namespace facebook::react
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace facebook::react {
+
+// Compact encodings of embedding vectors, shared by the embedding outputs and
+// the vector index. Search over them uses rn_dot_i8 and rn_hamming of rn-simd.hpp.
+
+// Scale vec to unit L2 norm; a zero vector is left as is
+void rn_normalize_f32(float* vec, size_t n);
+
+// Symmetric scalar quantization with one scale per vector: out[i] is vec[i] / scale
+// rounded to [-127, 127]. Returns the scale, 0 for a zero vector.
+float rn_quantize_int8(const float* vec, size_t n, int8_t* out);
+
+// One bit per dimension, set when the value is positive, packed most significant
+// bit first into rn_binary_size(n) bytes with the unused low bits cleared
+void rn_quantize_binary(const float* vec, size_t n, uint8_t* out);
+
+inline size_t rn_binary_size(size_t n) { return (n + 7) / 8; }
+
+} // namespace facebook::react
@@ -0,0 +1,197 @@
+#include "rn-session.hpp"
+#include "llama.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#if defined(__APPLE__) || defined(__ANDROID__) || defined(__linux__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define RN_SESSION_USE_MMAP 1
+#endif
+
+namespace facebook::react {
+
+// Read-only view of a session file, memory-mapped when the platform supports it
+// and read into a heap buffer otherwise
+struct session_file_view {
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+
+    explicit session_file_view(const std::string& path) {
+#ifdef RN_SESSION_USE_MMAP
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd >= 0) {
+            struct stat st;
+            if (fstat(fd, &st) == 0 && st.st_size > 0) {
+                void* addr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (addr != MAP_FAILED) {
+                    mapped_ = addr;
+                    data = static_cast<const uint8_t*>(addr);
+                    size = st.st_size;
+                }
+            }
+            close(fd);
+            if (mapped_) {
+                return;
+            }
+        }
+#endif
+        std::ifstream file(path, std::ios::binary | std::ios::ate);
+        if (!file) {
+            throw std::runtime_error("Failed to open session file: " + path);
+        }
+        buffer_.resize(file.tellg());
+        file.seekg(0);
+        if (!file.read(reinterpret_cast<char*>(buffer_.data()), buffer_.size())) {
+            throw std::runtime_error("Failed to read session file: " + path);
+        }
+        data = buffer_.data();
+        size = buffer_.size();
+    }
+
+    ~session_file_view() {
+#ifdef RN_SESSION_USE_MMAP
+        if (mapped_) {
+            munmap(mapped_, size);
+        }
+#endif
+    }
+
+    session_file_view(const session_file_view&) = delete;
+    session_file_view& operator=(const session_file_view&) = delete;
+
+private:
+    void* mapped_ = nullptr;
+    std::vector<uint8_t> buffer_;
+};
+
+static rn_session_header make_session_header(const rn_llama_context* rn_ctx) {
+    rn_session_header header = {};
+    header.magic = RN_SESSION_MAGIC;
+    header.version = RN_SESSION_VERSION;
+    header.model_n_params = llama_model_n_params(rn_ctx->model);
+    header.model_size = llama_model_size(rn_ctx->model);
+    header.n_vocab = llama_vocab_n_tokens(rn_ctx->vocab);
+    header.n_embd = llama_model_n_embd(rn_ctx->model);
+    header.n_layer = llama_model_n_layer(rn_ctx->model);
+    header.n_ctx = llama_n_ctx(rn_ctx->ctx) / std::max(1u, llama_n_seq_max(rn_ctx->ctx));
+    return header;
+}
+
+static void check_seq_id(const rn_llama_context* rn_ctx, llama_seq_id seq_id) {
+    if (seq_id < 0 || (size_t)seq_id >= rn_ctx->cache_tokens.size()) {
+        throw std::runtime_error("Invalid session slot " + std::to_string(seq_id));
+    }
+}
+
+size_t rn_session_save(rn_llama_context* rn_ctx, const std::string& path, llama_seq_id seq_id) {
+    if (!rn_ctx || !rn_ctx->model || !rn_ctx->ctx) {
+        throw std::runtime_error("Model not initialized");
+    }
+    check_seq_id(rn_ctx, seq_id);
+
+    const auto& tokens = rn_ctx->cache_tokens[seq_id];
+
+    std::vector<uint8_t> state(llama_state_seq_get_size(rn_ctx->ctx, seq_id));
+    const size_t n_state = llama_state_seq_get_data(rn_ctx->ctx, state.data(), state.size(), seq_id);
+    if (n_state == 0 && !tokens.empty()) {
+        throw std::runtime_error("Failed to copy sequence state");
+    }
+
+    rn_session_header header = make_session_header(rn_ctx);
+    header.n_tokens = tokens.size();
+    header.state_size = n_state;
+
+    // Write to a temporary file first so that a failed save never leaves a truncated session behind
+    const std::string tmp_path = path + ".tmp";
+    {
+        std::ofstream file(tmp_path, std::ios::binary | std::ios::trunc);
+        if (!file) {
+            throw std::runtime_error("Failed to create session file: " + path);
+        }
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char*>(tokens.data()), tokens.size() * sizeof(llama_token));
+        file.write(reinterpret_cast<const char*>(state.data()), n_state);
+        if (!file) {
+            file.close();
+            std::remove(tmp_path.c_str());
+            throw std::runtime_error("Failed to write session file: " + path);
+        }
+    }
+
+    if (std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+        std::remove(tmp_path.c_str());
+        throw std::runtime_error("Failed to move session file into place: " + path);
+    }
+
+    return tokens.size();
+}
+
+size_t rn_session_load(rn_llama_context* rn_ctx, const std::string& path, llama_seq_id seq_id) {
+    if (!rn_ctx || !rn_ctx->model || !rn_ctx->ctx) {
+        throw std::runtime_error("Model not initialized");
+    }
+    check_seq_id(rn_ctx, seq_id);
+
+    session_file_view view(path);
+
+    rn_session_header header;
+    if (view.size < sizeof(header)) {
+        throw std::runtime_error("Invalid session file: too small");
+    }
+    std::memcpy(&header, view.data, sizeof(header));
+
+    if (header.magic != RN_SESSION_MAGIC) {
+        throw std::runtime_error("Invalid session file: bad magic");
+    }
+    if (header.version != RN_SESSION_VERSION) {
+        throw std::runtime_error("Unsupported session file version " + std::to_string(header.version));
+    }
+
+    const rn_session_header expected = make_session_header(rn_ctx);
+    if (header.model_n_params != expected.model_n_params ||
+        header.model_size != expected.model_size ||
+        header.n_vocab != expected.n_vocab ||
+        header.n_embd != expected.n_embd ||
+        header.n_layer != expected.n_layer) {
+        throw std::runtime_error("Session file was created with a different model");
+    }
+    if ((int32_t)header.n_tokens > expected.n_ctx) {
+        throw std::runtime_error("Session holds " + std::to_string(header.n_tokens) +
+                                 " tokens, more than the context size " + std::to_string(expected.n_ctx));
+    }
+
+    const size_t tokens_size = (size_t)header.n_tokens * sizeof(llama_token);
+    if (view.size != sizeof(header) + tokens_size + header.state_size) {
+        throw std::runtime_error("Invalid session file: unexpected size");
+    }
+
+    std::vector<llama_token> tokens(header.n_tokens);
+    std::memcpy(tokens.data(), view.data + sizeof(header), tokens_size);
+
+    const uint8_t* state = view.data + sizeof(header) + tokens_size;
+
+    auto& cache_tokens = rn_ctx->cache_tokens[seq_id];
+
+    llama_kv_self_seq_rm(rn_ctx->ctx, seq_id, -1, -1);
+    cache_tokens.clear();
+
+    if (header.state_size > 0 &&
+        llama_state_seq_set_data(rn_ctx->ctx, state, header.state_size, seq_id) == 0) {
+        llama_kv_self_seq_rm(rn_ctx->ctx, seq_id, -1, -1);
+        throw std::runtime_error("Failed to restore sequence state");
+    }
+
+    cache_tokens = std::move(tokens);
+    return cache_tokens.size();
+}
+
+} // namespace facebook::react
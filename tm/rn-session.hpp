@@ -0,0 +1,46 @@
+#pragma once
+
+#include "rn-llama.hpp"
+
+#include <cstdint>
+#include <string>
+
+namespace facebook::react {
+
+// Session files start with this header, followed by n_tokens llama_token values
+// and state_size bytes of sequence state as produced by llama_state_seq_get_data.
+#define RN_SESSION_MAGIC   0x53534E52u // 'RNSS'
+#define RN_SESSION_VERSION 1
+
+struct rn_session_header {
+    uint32_t magic;
+    uint32_t version;
+
+    // Identity of the model that produced the state
+    uint64_t model_n_params;
+    uint64_t model_size;
+    int32_t  n_vocab;
+    int32_t  n_embd;
+    int32_t  n_layer;
+
+    int32_t  n_ctx;       // per-sequence context size the state was saved with
+    uint32_t n_tokens;    // number of tokens held in the KV cache
+    uint32_t reserved;
+    uint64_t state_size;  // size of the sequence state blob in bytes
+};
+
+// Save the KV cache of sequence seq_id together with the tokens it holds
+// (rn_llama_context::cache_tokens[seq_id]). Returns the number of tokens saved.
+// The caller must have exclusive use of the context.
+// Throws std::runtime_error on failure.
+size_t rn_session_save(rn_llama_context* rn_ctx, const std::string& path, llama_seq_id seq_id);
+
+// Restore a session written by rn_session_save into sequence seq_id, replacing
+// what it held. The file is validated against the loaded model and
+// memory-mapped where supported, so the state is fed to llama.cpp without an
+// intermediate copy. Returns the number of tokens restored.
+// The caller must have exclusive use of the context.
+// Throws std::runtime_error on failure.
+size_t rn_session_load(rn_llama_context* rn_ctx, const std::string& path, llama_seq_id seq_id);
+
+} // namespace facebook::react
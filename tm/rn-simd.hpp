@@ -0,0 +1,228 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define RN_SIMD_NEON 1
+#elif defined(__AVX2__) && defined(__FMA__)
+#include <immintrin.h>
+#define RN_SIMD_AVX2 1
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define RN_SIMD_SSE2 1
+#endif
+
+namespace facebook::react {
+
+// Distance kernels used by the vector index. Each has a NEON path for the
+// arm64 devices the library mostly runs on, an x86 path for simulators and
+// emulators, and a scalar loop for the tail and other targets.
+
+#if defined(RN_SIMD_AVX2)
+static inline float rn_hsum256(__m256 v) {
+    __m128 lo = _mm256_castps256_ps128(v);
+    __m128 hi = _mm256_extractf128_ps(v, 1);
+    lo = _mm_add_ps(lo, hi);
+    lo = _mm_add_ps(lo, _mm_movehl_ps(lo, lo));
+    lo = _mm_add_ss(lo, _mm_shuffle_ps(lo, lo, 1));
+    return _mm_cvtss_f32(lo);
+}
+#elif defined(RN_SIMD_SSE2)
+static inline float rn_hsum128(__m128 v) {
+    v = _mm_add_ps(v, _mm_movehl_ps(v, v));
+    v = _mm_add_ss(v, _mm_shuffle_ps(v, v, 1));
+    return _mm_cvtss_f32(v);
+}
+#endif
+
+#if defined(RN_SIMD_AVX2) || defined(RN_SIMD_SSE2)
+static inline int32_t rn_hsum128_i32(__m128i v) {
+    v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2)));
+    v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(v);
+}
+#endif
+
+static inline float rn_dot_f32(const float* a, const float* b, size_t n) {
+    size_t i = 0;
+    float sum = 0.0f;
+#if defined(RN_SIMD_NEON)
+    float32x4_t acc0 = vdupq_n_f32(0.0f);
+    float32x4_t acc1 = vdupq_n_f32(0.0f);
+    for (; i + 8 <= n; i += 8) {
+        acc0 = vfmaq_f32(acc0, vld1q_f32(a + i), vld1q_f32(b + i));
+        acc1 = vfmaq_f32(acc1, vld1q_f32(a + i + 4), vld1q_f32(b + i + 4));
+    }
+    sum = vaddvq_f32(vaddq_f32(acc0, acc1));
+#elif defined(RN_SIMD_AVX2)
+    __m256 acc0 = _mm256_setzero_ps();
+    __m256 acc1 = _mm256_setzero_ps();
+    for (; i + 16 <= n; i += 16) {
+        acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), acc0);
+        acc1 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8), acc1);
+    }
+    sum = rn_hsum256(_mm256_add_ps(acc0, acc1));
+#elif defined(RN_SIMD_SSE2)
+    __m128 acc0 = _mm_setzero_ps();
+    __m128 acc1 = _mm_setzero_ps();
+    for (; i + 8 <= n; i += 8) {
+        acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+        acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4)));
+    }
+    sum = rn_hsum128(_mm_add_ps(acc0, acc1));
+#endif
+    for (; i < n; ++i) {
+        sum += a[i] * b[i];
+    }
+    return sum;
+}
+
+static inline float rn_l2sq_f32(const float* a, const float* b, size_t n) {
+    size_t i = 0;
+    float sum = 0.0f;
+#if defined(RN_SIMD_NEON)
+    float32x4_t acc0 = vdupq_n_f32(0.0f);
+    float32x4_t acc1 = vdupq_n_f32(0.0f);
+    for (; i + 8 <= n; i += 8) {
+        float32x4_t d0 = vsubq_f32(vld1q_f32(a + i), vld1q_f32(b + i));
+        float32x4_t d1 = vsubq_f32(vld1q_f32(a + i + 4), vld1q_f32(b + i + 4));
+        acc0 = vfmaq_f32(acc0, d0, d0);
+        acc1 = vfmaq_f32(acc1, d1, d1);
+    }
+    sum = vaddvq_f32(vaddq_f32(acc0, acc1));
+#elif defined(RN_SIMD_AVX2)
+    __m256 acc0 = _mm256_setzero_ps();
+    __m256 acc1 = _mm256_setzero_ps();
+    for (; i + 16 <= n; i += 16) {
+        __m256 d0 = _mm256_sub_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i));
+        __m256 d1 = _mm256_sub_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8));
+        acc0 = _mm256_fmadd_ps(d0, d0, acc0);
+        acc1 = _mm256_fmadd_ps(d1, d1, acc1);
+    }
+    sum = rn_hsum256(_mm256_add_ps(acc0, acc1));
+#elif defined(RN_SIMD_SSE2)
+    __m128 acc0 = _mm_setzero_ps();
+    __m128 acc1 = _mm_setzero_ps();
+    for (; i + 8 <= n; i += 8) {
+        __m128 d0 = _mm_sub_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i));
+        __m128 d1 = _mm_sub_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4));
+        acc0 = _mm_add_ps(acc0, _mm_mul_ps(d0, d0));
+        acc1 = _mm_add_ps(acc1, _mm_mul_ps(d1, d1));
+    }
+    sum = rn_hsum128(_mm_add_ps(acc0, acc1));
+#endif
+    for (; i < n; ++i) {
+        const float d = a[i] - b[i];
+        sum += d * d;
+    }
+    return sum;
+}
+
+// Dot product of int8 vectors, exact in 32 bits for any embedding size
+static inline int32_t rn_dot_i8(const int8_t* a, const int8_t* b, size_t n) {
+    size_t i = 0;
+    int32_t sum = 0;
+#if defined(RN_SIMD_NEON)
+    int32x4_t acc0 = vdupq_n_s32(0);
+    int32x4_t acc1 = vdupq_n_s32(0);
+    for (; i + 16 <= n; i += 16) {
+        const int8x16_t va = vld1q_s8(a + i);
+        const int8x16_t vb = vld1q_s8(b + i);
+        acc0 = vpadalq_s16(acc0, vmull_s8(vget_low_s8(va), vget_low_s8(vb)));
+        acc1 = vpadalq_s16(acc1, vmull_s8(vget_high_s8(va), vget_high_s8(vb)));
+    }
+    sum = vaddvq_s32(vaddq_s32(acc0, acc1));
+#elif defined(RN_SIMD_AVX2)
+    __m256i acc = _mm256_setzero_si256();
+    for (; i + 16 <= n; i += 16) {
+        const __m256i va = _mm256_cvtepi8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i)));
+        const __m256i vb = _mm256_cvtepi8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i)));
+        acc = _mm256_add_epi32(acc, _mm256_madd_epi16(va, vb));
+    }
+    sum = rn_hsum128_i32(_mm_add_epi32(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1)));
+#elif defined(RN_SIMD_SSE2)
+    __m128i acc = _mm_setzero_si128();
+    for (; i + 16 <= n; i += 16) {
+        const __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+        const __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+        // Sign-extend to 16 bits by shifting each byte down from the top half
+        const __m128i a_lo = _mm_srai_epi16(_mm_unpacklo_epi8(va, va), 8);
+        const __m128i a_hi = _mm_srai_epi16(_mm_unpackhi_epi8(va, va), 8);
+        const __m128i b_lo = _mm_srai_epi16(_mm_unpacklo_epi8(vb, vb), 8);
+        const __m128i b_hi = _mm_srai_epi16(_mm_unpackhi_epi8(vb, vb), 8);
+        acc = _mm_add_epi32(acc, _mm_madd_epi16(a_lo, b_lo));
+        acc = _mm_add_epi32(acc, _mm_madd_epi16(a_hi, b_hi));
+    }
+    sum = rn_hsum128_i32(acc);
+#endif
+    for (; i < n; ++i) {
+        sum += (int32_t)a[i] * b[i];
+    }
+    return sum;
+}
+
+// Number of differing bits between two bit vectors of n bytes
+static inline uint32_t rn_hamming(const uint8_t* a, const uint8_t* b, size_t n) {
+    size_t i = 0;
+    uint32_t sum = 0;
+#if defined(RN_SIMD_NEON)
+    uint32x4_t acc = vdupq_n_u32(0);
+    for (; i + 16 <= n; i += 16) {
+        const uint8x16_t bits = vcntq_u8(veorq_u8(vld1q_u8(a + i), vld1q_u8(b + i)));
+        acc = vpadalq_u16(acc, vpaddlq_u8(bits));
+    }
+    sum = vaddvq_u32(acc);
+#endif
+    for (; i + 8 <= n; i += 8) {
+        uint64_t wa;
+        uint64_t wb;
+        std::memcpy(&wa, a + i, sizeof(wa));
+        std::memcpy(&wb, b + i, sizeof(wb));
+        sum += (uint32_t)__builtin_popcountll(wa ^ wb);
+    }
+    for (; i < n; ++i) {
+        sum += (uint32_t)__builtin_popcount((unsigned)(a[i] ^ b[i]));
+    }
+    return sum;
+}
+
+// Set x[i] to -INFINITY for each of the 64 floats whose bit i of bits is clear.
+// Groups of bits are widened into lane masks that select between x and -INFINITY.
+static inline void rn_mask_f32_64(float* x, uint64_t bits) {
+    size_t i = 0;
+#if defined(RN_SIMD_NEON)
+    const uint32x4_t sel = { 1, 2, 4, 8 };
+    const float32x4_t neg_inf = vdupq_n_f32(-INFINITY);
+    for (; i < 64; i += 4) {
+        const uint32x4_t keep = vtstq_u32(vdupq_n_u32((uint32_t)(bits >> i) & 0xF), sel);
+        vst1q_f32(x + i, vbslq_f32(keep, vld1q_f32(x + i), neg_inf));
+    }
+#elif defined(RN_SIMD_AVX2)
+    const __m256i sel = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+    const __m256 neg_inf = _mm256_set1_ps(-INFINITY);
+    for (; i < 64; i += 8) {
+        const __m256i group = _mm256_and_si256(_mm256_set1_epi32((int)((bits >> i) & 0xFF)), sel);
+        const __m256 keep = _mm256_castsi256_ps(_mm256_cmpeq_epi32(group, sel));
+        _mm256_storeu_ps(x + i, _mm256_blendv_ps(neg_inf, _mm256_loadu_ps(x + i), keep));
+    }
+#elif defined(RN_SIMD_SSE2)
+    const __m128i sel = _mm_setr_epi32(1, 2, 4, 8);
+    const __m128 neg_inf = _mm_set1_ps(-INFINITY);
+    for (; i < 64; i += 4) {
+        const __m128i group = _mm_and_si128(_mm_set1_epi32((int)((bits >> i) & 0xF)), sel);
+        const __m128 keep = _mm_castsi128_ps(_mm_cmpeq_epi32(group, sel));
+        _mm_storeu_ps(x + i, _mm_or_ps(_mm_and_ps(keep, _mm_loadu_ps(x + i)), _mm_andnot_ps(keep, neg_inf)));
+    }
+#endif
+    for (; i < 64; ++i) {
+        if (!((bits >> i) & 1)) {
+            x[i] = -INFINITY;
+        }
+    }
+}
+
+} // namespace facebook::react
@@ -0,0 +1,107 @@
+#include "rn-stop-matcher.hpp"
+
+#include <algorithm>
+#include <deque>
+
+namespace facebook::react {
+
+rn_stop_matcher::rn_stop_matcher(const std::vector<std::string>& words) {
+    for (const auto& word : words) {
+        if (!word.empty()) {
+            words_.push_back(word);
+        }
+    }
+    if (words_.empty()) {
+        return;
+    }
+
+    auto new_node = [this](int32_t depth) {
+        nodes_.emplace_back();
+        std::fill(std::begin(nodes_.back().next), std::end(nodes_.back().next), -1);
+        nodes_.back().depth = depth;
+        return (int32_t)nodes_.size() - 1;
+    };
+
+    // Build the trie of all stop strings
+    new_node(0);
+    for (size_t w = 0; w < words_.size(); ++w) {
+        int32_t cur = 0;
+        for (unsigned char c : words_[w]) {
+            if (nodes_[cur].next[c] < 0) {
+                const int32_t child = new_node(nodes_[cur].depth + 1);
+                nodes_[cur].next[c] = child;
+            }
+            cur = nodes_[cur].next[c];
+        }
+        // A stop string listed twice keeps its first index
+        if (nodes_[cur].out_word < 0) {
+            nodes_[cur].out_word = (int32_t)w;
+        }
+    }
+
+    // Breadth-first pass computing failure links, folding them into a complete
+    // transition table and propagating outputs along the failure chain
+    std::deque<int32_t> queue;
+    for (int c = 0; c < 256; ++c) {
+        int32_t& child = nodes_[0].next[c];
+        if (child < 0) {
+            child = 0;
+        } else {
+            nodes_[child].fail = 0;
+            queue.push_back(child);
+        }
+    }
+
+    while (!queue.empty()) {
+        const int32_t cur = queue.front();
+        queue.pop_front();
+
+        const int32_t fail_out = nodes_[nodes_[cur].fail].out_word;
+        if (nodes_[cur].out_word < 0) {
+            nodes_[cur].out_word = fail_out;
+        } else if (fail_out >= 0 && words_[fail_out].size() > words_[nodes_[cur].out_word].size()) {
+            nodes_[cur].out_word = fail_out;
+        }
+
+        for (int c = 0; c < 256; ++c) {
+            const int32_t child = nodes_[cur].next[c];
+            const int32_t fail_next = nodes_[nodes_[cur].fail].next[c];
+            if (child < 0) {
+                nodes_[cur].next[c] = fail_next;
+            } else {
+                nodes_[child].fail = fail_next;
+                queue.push_back(child);
+            }
+        }
+    }
+}
+
+bool rn_stop_matcher::feed(const char* data, size_t size, size_t& match_pos, size_t& match_word) {
+    if (nodes_.empty()) {
+        n_fed_ += size;
+        return false;
+    }
+
+    // A later match can still start earlier than the first one found (e.g. "abcd"
+    // and "c" in "abcd"), so scan all the new bytes and keep the earliest start
+    bool found = false;
+    for (size_t i = 0; i < size; ++i) {
+        state_ = nodes_[state_].next[(unsigned char)data[i]];
+
+        const int32_t out = nodes_[state_].out_word;
+        if (out >= 0) {
+            const size_t end = n_fed_ + i + 1;
+            const size_t pos = end - words_[out].size();
+            if (!found || pos < match_pos) {
+                match_pos = pos;
+                match_word = out;
+                found = true;
+            }
+        }
+    }
+
+    n_fed_ += size;
+    return found;
+}
+
+} // namespace facebook::react
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace facebook::react {
+
+// Aho-Corasick automaton over a set of stop strings. It is built once per
+// request and fed only the bytes generated since the previous call, so each
+// token costs O(new bytes) regardless of the number of stop strings, and no
+// allocation happens after construction.
+class rn_stop_matcher {
+public:
+    rn_stop_matcher() = default;
+    explicit rn_stop_matcher(const std::vector<std::string>& words);
+
+    bool empty() const { return words_.empty(); }
+
+    // Consume the next bytes of the text. Returns true if a stop string ends
+    // inside them; match_pos is then the offset of the earliest matching stop
+    // string in the whole text fed so far and match_word its index.
+    bool feed(const char* data, size_t size, size_t& match_pos, size_t& match_word);
+
+    // Length of the longest suffix of the text fed so far that is the start of
+    // a stop string. Those bytes must be held back from streaming until more
+    // text arrives.
+    size_t partial_length() const { return nodes_.empty() ? 0 : nodes_[state_].depth; }
+
+    const std::string& word(size_t index) const { return words_[index]; }
+
+private:
+    struct node {
+        int32_t next[256];     // complete transition table (goto + failure links folded in)
+        int32_t fail = 0;
+        int32_t depth = 0;     // length of the prefix this node represents
+        int32_t out_word = -1; // longest stop string ending at this node, including via failure links
+    };
+
+    std::vector<std::string> words_;
+    std::vector<node> nodes_;
+    int32_t state_ = 0;
+    size_t n_fed_ = 0;
+};
+
+} // namespace facebook::react
@@ -0,0 +1,74 @@
+#include "rn-token-ring.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <new>
+
+namespace facebook::react {
+
+rn_token_ring::rn_token_ring(uint32_t token_capacity, uint32_t byte_capacity)
+    : token_capacity_(std::max<uint32_t>(1, token_capacity)),
+      byte_capacity_(std::max<uint32_t>(1, byte_capacity)) {
+
+    size_ = sizeof(rn_token_ring_header)
+        + (size_t)token_capacity_ * (sizeof(int32_t) + sizeof(uint32_t))
+        + byte_capacity_;
+    data_.reset(new uint8_t[size_]());
+
+    auto* h = new (data_.get()) rn_token_ring_header();
+    h->magic = RN_TOKEN_RING_MAGIC;
+    h->version = RN_TOKEN_RING_VERSION;
+    h->token_capacity = token_capacity_;
+    h->byte_capacity = byte_capacity_;
+    h->token_write.store(0);
+    h->byte_write.store(0);
+    h->state.store(RN_TOKEN_RING_IDLE);
+    h->sequence.store(0);
+}
+
+bool rn_token_ring::begin() {
+    bool expected = false;
+    if (!in_use_.compare_exchange_strong(expected, true)) {
+        return false;
+    }
+
+    auto* h = header();
+    h->token_write.store(0, std::memory_order_relaxed);
+    h->byte_write.store(0, std::memory_order_relaxed);
+    h->sequence.fetch_add(1, std::memory_order_relaxed);
+    h->state.store(RN_TOKEN_RING_RUNNING, std::memory_order_release);
+    return true;
+}
+
+void rn_token_ring::write_token(llama_token token) {
+    auto* h = header();
+    const uint32_t n = h->token_write.load(std::memory_order_relaxed);
+
+    tokens()[n % token_capacity_] = token;
+    token_byte_ends()[n % token_capacity_] = h->byte_write.load(std::memory_order_relaxed);
+    h->token_write.store(n + 1, std::memory_order_release);
+}
+
+void rn_token_ring::write_text(const char* text, size_t size) {
+    auto* h = header();
+    const uint32_t n = h->byte_write.load(std::memory_order_relaxed);
+
+    // Copy in at most two pieces around the end of the ring; only the last
+    // byte_capacity bytes of an oversized write can be kept
+    const size_t skip = size > byte_capacity_ ? size - byte_capacity_ : 0;
+    size_t pos = (n + skip) % byte_capacity_;
+    for (size_t i = skip; i < size;) {
+        const size_t len = std::min(size - i, (size_t)byte_capacity_ - pos);
+        std::memcpy(bytes() + pos, text + i, len);
+        i += len;
+        pos = 0;
+    }
+    h->byte_write.store(n + (uint32_t)size, std::memory_order_release);
+}
+
+void rn_token_ring::end(bool success) {
+    header()->state.store(success ? RN_TOKEN_RING_DONE : RN_TOKEN_RING_FAILED, std::memory_order_release);
+    in_use_ = false;
+}
+
+} // namespace facebook::react
@@ -0,0 +1,84 @@
+#pragma once
+
+#include "llama.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace facebook::react {
+
+#define RN_TOKEN_RING_MAGIC   0x52544E52u // 'RNTR'
+#define RN_TOKEN_RING_VERSION 1
+#define RN_TOKEN_RING_DEFAULT_TOKENS 4096
+#define RN_TOKEN_RING_DEFAULT_BYTES  65536
+
+// Streaming state published in the ring header
+enum rn_token_ring_state : uint32_t {
+    RN_TOKEN_RING_IDLE = 0,
+    RN_TOKEN_RING_RUNNING = 1,
+    RN_TOKEN_RING_DONE = 2,
+    RN_TOKEN_RING_FAILED = 3,
+};
+
+// Header at the start of the ring memory. All fields are 32-bit little-endian,
+// so JS reads them through a Uint32Array over the first 8 entries.
+struct rn_token_ring_header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t token_capacity;
+    uint32_t byte_capacity;
+    std::atomic<uint32_t> token_write; // tokens written by the current request
+    std::atomic<uint32_t> byte_write;  // text bytes written by the current request
+    std::atomic<uint32_t> state;       // rn_token_ring_state
+    std::atomic<uint32_t> sequence;    // incremented when a request starts writing
+};
+
+static_assert(sizeof(rn_token_ring_header) == 32, "ring header must stay 32 bytes");
+
+// Single-producer ring buffer a completion streams into without allocating.
+//
+// The memory is laid out as the header, then token_capacity token ids (int32),
+// then for each token the value of byte_write after it (uint32), then the
+// byte_capacity bytes of the UTF-8 text. Token i lives at index
+// i % token_capacity and text byte b at b % byte_capacity. The writer never
+// waits for the reader: data is written before the cursor that covers it is
+// published, and a reader that falls more than a capacity behind finds its
+// entries overwritten and has to skip ahead. Text held back as a possible
+// stop string prefix is written once it is known not to be one, so byte_write
+// can lag behind the last token.
+class rn_token_ring {
+public:
+    rn_token_ring(uint32_t token_capacity, uint32_t byte_capacity);
+
+    rn_token_ring(const rn_token_ring&) = delete;
+    rn_token_ring& operator=(const rn_token_ring&) = delete;
+
+    uint8_t* data() { return data_.get(); }
+    size_t size() const { return size_; }
+
+    // Claim the ring for a request and reset its cursors. Returns false if
+    // another request is streaming into it.
+    bool begin();
+
+    void write_token(llama_token token);
+    void write_text(const char* text, size_t size);
+
+    // Publish the final state and release the ring
+    void end(bool success);
+
+private:
+    rn_token_ring_header* header() { return reinterpret_cast<rn_token_ring_header*>(data_.get()); }
+    int32_t* tokens() { return reinterpret_cast<int32_t*>(data_.get() + sizeof(rn_token_ring_header)); }
+    uint32_t* token_byte_ends() { return reinterpret_cast<uint32_t*>(tokens() + token_capacity_); }
+    uint8_t* bytes() { return reinterpret_cast<uint8_t*>(token_byte_ends() + token_capacity_); }
+
+    uint32_t token_capacity_;
+    uint32_t byte_capacity_;
+    size_t size_;
+    std::unique_ptr<uint8_t[]> data_;
+    std::atomic<bool> in_use_{false};
+};
+
+} // namespace facebook::react
@@ -10,6 +10,7 @@
 #include "json.hpp"
 #include "base64.hpp"
 #include "chat.h"
+#include "rn-token-ring.hpp"
 
 #include <random>
 #include <sstream>
@@ -33,6 +34,13 @@ enum rn_error_type {
     RN_ERROR_GENERAL         // General errors
 };
 
+// Text boundaries that end a coalesced streaming frame
+enum rn_stream_boundary {
+    RN_STREAM_BOUNDARY_NONE,
+    RN_STREAM_BOUNDARY_NEWLINE,   // a token containing '\n'
+    RN_STREAM_BOUNDARY_SENTENCE,  // a newline or sentence-ending punctuation
+};
+
 // Forward declaration
 struct common_sampler;
 
@@ -46,6 +54,14 @@ struct CompletionOptions {
     std::string model;   // model identifier
     json messages;       // for chat completions
     bool stream = false;
+    // Streaming frames: a frame is sent once any enabled condition holds; with
+    // none enabled every token is its own frame
+    int stream_flush_tokens = 0;  // tokens per frame
+    int stream_flush_ms = 0;      // time since the previous frame
+    rn_stream_boundary stream_flush_boundary = RN_STREAM_BOUNDARY_NONE;
+    // Ring buffer the tokens and text are written to instead of the streaming
+    // frames, which then only notify that new data is there
+    std::shared_ptr<facebook::react::rn_token_ring> token_ring;
     int n_predict = -1;
     float temperature = 0.8f;
     float top_p = 0.9f;
@@ -57,6 +73,7 @@ struct CompletionOptions {
     std::vector<std::string> stop;
     std::string grammar;
     bool grammar_lazy = false;
+    std::vector<common_grammar_trigger> grammar_triggers; // activate a lazy grammar
     bool ignore_eos = false;
     std::string chat_template;
     bool use_jinja = false;
@@ -158,15 +175,123 @@ struct CompletionOptions {
     }
 };
 
+// Probability of one candidate token at a generated position
+struct TokenProbability {
+    llama_token id = LLAMA_TOKEN_NULL;
+    std::string text;
+    float value = 0.0f;  // log-probability, or probability with post_sampling_probs
+
+    json to_json(bool post_sampling_probs) const {
+        json bytes = json::array();
+        for (unsigned char c : text) {
+            bytes.push_back(c);
+        }
+        return json {
+            {"id", id},
+            {"token", text},
+            {"bytes", bytes},
+            {post_sampling_probs ? "prob" : "logprob", value}
+        };
+    }
+};
+
+// The token generated at one position and the n_probs most likely candidates there
+struct CompletionTokenProbs {
+    TokenProbability token;
+    std::vector<TokenProbability> top;
+
+    json to_json(bool post_sampling_probs) const {
+        json j = token.to_json(post_sampling_probs);
+        json top_json = json::array();
+        for (const auto& candidate : top) {
+            top_json.push_back(candidate.to_json(post_sampling_probs));
+        }
+        j[post_sampling_probs ? "top_probs" : "top_logprobs"] = std::move(top_json);
+        return j;
+    }
+};
+
+static json token_probs_to_json(const std::vector<CompletionTokenProbs>& probs, bool post_sampling_probs) {
+    json j = json::array();
+    for (const auto& p : probs) {
+        j.push_back(p.to_json(post_sampling_probs));
+    }
+    return j;
+}
+
+// One streaming frame passed to the partial callback: the text and tokens
+// generated since the previous frame, and their probabilities when n_probs is set
+struct CompletionChunk {
+    std::string text;
+    std::vector<llama_token> tokens;
+    std::vector<CompletionTokenProbs> probs;
+    double t_ms = 0.0;  // generation time when the frame was sent
+};
+
 // CompletionResult struct to hold completion response data
 struct CompletionResult {
     std::string content;
     bool success = true;
     std::string error_msg;
     rn_error_type error_type = RN_ERROR_GENERAL;
+    int slot_id = -1;         // scheduler slot, and sequence id, the request ran in
     int n_prompt_tokens = 0;
     int n_predicted_tokens = 0;
+    int n_cached_tokens = 0;  // prompt tokens reused from the KV cache
+    int n_draft_tokens = 0;   // tokens proposed by speculative decoding
+    int n_draft_accepted = 0; // drafted tokens accepted by the target model
+    int n_forced_tokens = 0;  // tokens forced by the grammar and decoded without sampling
+    bool truncated = false;   // the prompt or the context was shifted to fit n_ctx
+    bool cancelled = false;   // stopped by its cancellation token or callback
+    double cancel_ms = 0.0;   // time from the cancel request until the request stopped
+    bool has_grammar = false; // sampling was constrained by a grammar
+    bool grammar_cache_hit = false; // the grammar was already parsed by an earlier request
+    double grammar_ms = 0.0;  // time spent parsing or copying the grammar
+    int n_grammar_masks = 0;  // sampled tokens the grammar rejected, resampled with its mask
+    double grammar_mask_ms = 0.0; // time spent computing and applying those masks
     std::vector<llama_token> tokens;
+    std::vector<CompletionTokenProbs> probs;  // one entry per generated token when n_probs is set
+    bool post_sampling_probs = false;
+
+    // Timings in milliseconds
+    double prompt_ms = 0.0;
+    double predicted_ms = 0.0;
+
+    json timings_to_json() const {
+        json timings = {
+            {"cache_n", n_cached_tokens},
+            {"prompt_n", n_prompt_tokens - n_cached_tokens},
+            {"prompt_ms", prompt_ms},
+            {"prompt_per_second", prompt_ms > 0 ? 1e3 * (n_prompt_tokens - n_cached_tokens) / prompt_ms : 0.0},
+            {"predicted_n", n_predicted_tokens},
+            {"predicted_ms", predicted_ms},
+            {"predicted_per_second", predicted_ms > 0 ? 1e3 * n_predicted_tokens / predicted_ms : 0.0},
+            {"total_ms", prompt_ms + predicted_ms}
+        };
+
+        if (n_draft_tokens > 0) {
+            timings["draft_n"] = n_draft_tokens;
+            timings["draft_n_accepted"] = n_draft_accepted;
+            timings["draft_acceptance_rate"] = (double)n_draft_accepted / n_draft_tokens;
+        }
+
+        if (n_forced_tokens > 0) {
+            timings["forced_n"] = n_forced_tokens;
+        }
+
+        if (cancelled) {
+            timings["cancel_ms"] = cancel_ms;
+        }
+
+        if (has_grammar) {
+            timings["grammar_ms"] = grammar_ms;
+            timings["grammar_cache_hit"] = grammar_cache_hit;
+            timings["grammar_mask_n"] = n_grammar_masks;
+            timings["grammar_mask_ms"] = grammar_mask_ms;
+        }
+
+        return timings;
+    }
 
     // For chat completions, store the parsed OAI-compatible response
     json chat_response;
@@ -199,26 +324,6 @@ static std::string gen_chatcmplid() {
     return "chatcmpl-" + result;
 }
 
-static bool ends_with(const std::string & str, const std::string & suffix) {
-    return str.size() >= suffix.size() && 0 == str.compare(str.size() - suffix.size(), suffix.size(), suffix);
-}
-
-static size_t find_partial_stop_string(const std::string &stop, const std::string &text) {
-    if (!text.empty() && !stop.empty()) {
-        const char text_last_char = text.back();
-        for (int64_t char_index = stop.size() - 1; char_index >= 0; char_index--) {
-            if (stop[char_index] == text_last_char) {
-                const std::string current_partial = stop.substr(0, char_index + 1);
-                if (ends_with(text, current_partial)) {
-                    return text.size() - char_index - 1;
-                }
-            }
-        }
-    }
-
-    return std::string::npos;
-}
-
 static bool json_is_array_of_numbers(const json & data) {
     if (data.is_array()) {
         for (const auto & e : data) {
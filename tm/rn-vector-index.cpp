@@ -0,0 +1,489 @@
+#include "rn-vector-index.hpp"
+#include "rn-quantize.hpp"
+#include "rn-simd.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <queue>
+#include <stdexcept>
+
+namespace facebook::react {
+
+static const uint32_t RN_NO_NODE = UINT32_MAX;
+
+// An int8 vector is stored after its scale and the squared norm it stands for
+struct int8_code {
+    float scale;
+    float norm_sq;
+};
+
+static size_t code_size(rn_vector_encoding encoding, size_t dim) {
+    size_t size = dim * sizeof(float);
+    if (encoding == RN_VECTOR_ENCODING_INT8) {
+        size = sizeof(int8_code) + dim;
+    } else if (encoding == RN_VECTOR_ENCODING_BINARY) {
+        size = rn_binary_size(dim);
+    }
+    // Keeps the links that follow aligned
+    return (size + 3) & ~(size_t)3;
+}
+
+rn_vector_index::rn_vector_index(const rn_vector_index_params& params, const std::string& path)
+    : params_(params), rng_(RN_VECTOR_INDEX_MAGIC) {
+
+    if (!path.empty()) {
+        file_ = std::make_unique<rn_mapped_file>(path, sizeof(rn_vector_index_header));
+
+        if (file_->initial_size() > 0) {
+            const auto* h = header();
+            if (file_->initial_size() < sizeof(rn_vector_index_header) || h->magic != RN_VECTOR_INDEX_MAGIC) {
+                throw std::runtime_error("Not a vector index file: " + path);
+            }
+            if (h->version != RN_VECTOR_INDEX_VERSION) {
+                throw std::runtime_error("Unsupported vector index version: " + std::to_string(h->version));
+            }
+            if (h->encoding > RN_VECTOR_ENCODING_BINARY) {
+                throw std::runtime_error("Unsupported vector index encoding: " + std::to_string(h->encoding));
+            }
+            if (params.dim != 0 && params.dim != h->dim) {
+                throw std::runtime_error("Vector index has dimension " + std::to_string(h->dim) +
+                                         ", expected " + std::to_string(params.dim));
+            }
+            if (file_->size() < sizeof(rn_vector_index_header) + (size_t)h->capacity * h->record_size) {
+                throw std::runtime_error("Vector index file is truncated: " + path);
+            }
+
+            params_.type = (rn_vector_index_type)h->type;
+            params_.metric = (rn_vector_metric)h->metric;
+            params_.encoding = (rn_vector_encoding)h->encoding;
+            params_.dim = h->dim;
+            params_.M = h->M;
+            params_.ef_construction = h->ef_construction;
+
+            code_size_ = code_size(params_.encoding, params_.dim);
+
+            // Only the record headers are read to find the live ids
+            for (uint32_t node = 0; node < h->count; ++node) {
+                const auto* nh = reinterpret_cast<const node_header*>(record(node));
+                if (!nh->deleted) {
+                    nodes_[nh->id] = node;
+                }
+            }
+            n_live_ = nodes_.size();
+            visited_.assign(h->capacity, 0);
+            return;
+        }
+    } else {
+        buffer_.resize(sizeof(rn_vector_index_header));
+    }
+
+    if (params_.dim == 0) {
+        throw std::runtime_error("Vector index dimension must be set");
+    }
+    if (params_.encoding == RN_VECTOR_ENCODING_BINARY && params_.metric == RN_VECTOR_METRIC_L2) {
+        throw std::runtime_error("Binary vector index supports cosine and dot metrics");
+    }
+    params_.M = std::max<uint32_t>(2, params_.M);
+    code_size_ = code_size(params_.encoding, params_.dim);
+
+    size_t record_size = sizeof(node_header) + code_size_;
+    if (params_.type == RN_VECTOR_INDEX_HNSW) {
+        record_size += (1 + 2 * params_.M) * sizeof(uint32_t);
+        record_size += (RN_HNSW_MAX_LEVELS - 1) * (1 + params_.M) * sizeof(uint32_t);
+    }
+    record_size = (record_size + 15) & ~(size_t)15;
+
+    auto* h = header();
+    std::memset(h, 0, sizeof(rn_vector_index_header));
+    h->magic = RN_VECTOR_INDEX_MAGIC;
+    h->version = RN_VECTOR_INDEX_VERSION;
+    h->type = params_.type;
+    h->metric = params_.metric;
+    h->encoding = params_.encoding;
+    h->dim = params_.dim;
+    h->M = params_.M;
+    h->ef_construction = params_.ef_construction;
+    h->record_size = (uint32_t)record_size;
+    h->entry_point = RN_NO_NODE;
+}
+
+rn_vector_index_header* rn_vector_index::header() {
+    return reinterpret_cast<rn_vector_index_header*>(file_ ? file_->data() : buffer_.data());
+}
+
+uint8_t* rn_vector_index::record(uint32_t node) {
+    uint8_t* base = file_ ? file_->data() : buffer_.data();
+    return base + sizeof(rn_vector_index_header) + (size_t)node * header()->record_size;
+}
+
+uint32_t* rn_vector_index::links(uint32_t node, uint32_t level) {
+    uint32_t* list = reinterpret_cast<uint32_t*>(code(node) + code_size_);
+    if (level > 0) {
+        list += 1 + 2 * params_.M + (level - 1) * (1 + params_.M);
+    }
+    return list;
+}
+
+void rn_vector_index::reserve(uint32_t capacity) {
+    auto* h = header();
+    if (capacity <= h->capacity) {
+        return;
+    }
+    capacity = std::max({ capacity, 2 * h->capacity, 64u });
+
+    const size_t size = sizeof(rn_vector_index_header) + (size_t)capacity * h->record_size;
+    if (file_) {
+        file_->resize(size);
+    } else {
+        buffer_.resize(size, 0);
+    }
+    header()->capacity = capacity;
+    visited_.resize(capacity, 0);
+}
+
+void rn_vector_index::encode(const float* vec, uint8_t* out) {
+    const size_t dim = params_.dim;
+    if (params_.metric == RN_VECTOR_METRIC_COSINE) {
+        scratch_.assign(vec, vec + dim);
+        rn_normalize_f32(scratch_.data(), dim);
+        vec = scratch_.data();
+    }
+
+    switch (params_.encoding) {
+        case RN_VECTOR_ENCODING_INT8: {
+            auto* head = reinterpret_cast<int8_code*>(out);
+            auto* values = reinterpret_cast<int8_t*>(out + sizeof(int8_code));
+            head->scale = rn_quantize_int8(vec, dim, values);
+            head->norm_sq = head->scale * head->scale * (float)rn_dot_i8(values, values, dim);
+            break;
+        }
+        case RN_VECTOR_ENCODING_BINARY:
+            rn_quantize_binary(vec, dim, out);
+            break;
+        default:
+            std::memcpy(out, vec, dim * sizeof(float));
+            break;
+    }
+}
+
+float rn_vector_index::distance(const uint8_t* a, const uint8_t* b) const {
+    const size_t dim = params_.dim;
+    switch (params_.encoding) {
+        case RN_VECTOR_ENCODING_INT8: {
+            const auto* ha = reinterpret_cast<const int8_code*>(a);
+            const auto* hb = reinterpret_cast<const int8_code*>(b);
+            const float dot = ha->scale * hb->scale *
+                              (float)rn_dot_i8(reinterpret_cast<const int8_t*>(a + sizeof(int8_code)),
+                                               reinterpret_cast<const int8_t*>(b + sizeof(int8_code)), dim);
+            if (params_.metric == RN_VECTOR_METRIC_L2) {
+                return std::max(0.0f, ha->norm_sq + hb->norm_sq - 2.0f * dot);
+            }
+            return -dot;
+        }
+        case RN_VECTOR_ENCODING_BINARY:
+            return (float)rn_hamming(a, b, rn_binary_size(dim));
+        default: {
+            const auto* fa = reinterpret_cast<const float*>(a);
+            const auto* fb = reinterpret_cast<const float*>(b);
+            if (params_.metric == RN_VECTOR_METRIC_L2) {
+                return rn_l2sq_f32(fa, fb, dim);
+            }
+            return -rn_dot_f32(fa, fb, dim);
+        }
+    }
+}
+
+float rn_vector_index::score(float distance) const {
+    if (params_.encoding == RN_VECTOR_ENCODING_BINARY) {
+        // Matching minus differing bits, over the dimension
+        return 1.0f - 2.0f * distance / (float)params_.dim;
+    }
+    return params_.metric == RN_VECTOR_METRIC_L2 ? std::sqrt(distance) : -distance;
+}
+
+void rn_vector_index::add(const int64_t* ids, const float* vectors, size_t n) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    reserve(header()->count + (uint32_t)n);
+    for (size_t i = 0; i < n; ++i) {
+        auto it = nodes_.find(ids[i]);
+        if (it != nodes_.end()) {
+            reinterpret_cast<node_header*>(record(it->second))->deleted = 1;
+            header()->n_deleted++;
+            nodes_.erase(it);
+        }
+        insert(ids[i], vectors + i * params_.dim);
+    }
+    n_live_ = nodes_.size();
+}
+
+void rn_vector_index::insert(int64_t id, const float* vec) {
+    auto* h = header();
+    const uint32_t node = h->count;
+
+    uint32_t level = 0;
+    if (params_.type == RN_VECTOR_INDEX_HNSW) {
+        // Levels are geometric with ratio 1/M, as in the HNSW paper
+        std::uniform_real_distribution<double> uniform(0.0, 1.0);
+        const double u = std::max(uniform(rng_), 1e-12);
+        level = std::min<uint32_t>((uint32_t)(-std::log(u) / std::log((double)params_.M)), RN_HNSW_MAX_LEVELS - 1);
+    }
+
+    uint8_t* rec = record(node);
+    std::memset(rec, 0, h->record_size);
+    auto* nh = reinterpret_cast<node_header*>(rec);
+    nh->id = id;
+    nh->level = level;
+    uint8_t* v = code(node);
+    encode(vec, v);
+
+    h->count++;
+    nodes_[id] = node;
+
+    if (params_.type != RN_VECTOR_INDEX_HNSW) {
+        return;
+    }
+
+    if (h->entry_point == RN_NO_NODE) {
+        h->entry_point = node;
+        h->top_level = level;
+        return;
+    }
+
+    // Descend to the node's level, then link it on every level it is part of
+    uint32_t entry = h->entry_point;
+    for (uint32_t l = h->top_level; l > level; --l) {
+        entry = search_greedy(v, entry, l);
+    }
+    for (int l = (int)std::min(level, h->top_level); l >= 0; --l) {
+        auto candidates = search_level(v, entry, params_.ef_construction, l);
+        for (uint32_t neighbor : select_neighbors(candidates, params_.M)) {
+            link(node, neighbor, l);
+            link(neighbor, node, l);
+        }
+        entry = candidates.front().second;
+    }
+
+    if (level > h->top_level) {
+        h->entry_point = node;
+        h->top_level = level;
+    }
+}
+
+void rn_vector_index::link(uint32_t from, uint32_t to, uint32_t level) {
+    uint32_t* list = links(from, level);
+    const uint32_t m = max_links(level);
+    if (list[0] < m) {
+        list[1 + list[0]++] = to;
+        return;
+    }
+
+    // Full: keep the best diverse subset of the current links and the new one
+    const uint8_t* base = code(from);
+    std::vector<candidate> candidates;
+    candidates.reserve(m + 1);
+    for (uint32_t i = 0; i < list[0]; ++i) {
+        candidates.push_back({ distance(base, code(list[1 + i])), list[1 + i] });
+    }
+    candidates.push_back({ distance(base, code(to)), to });
+    std::sort(candidates.begin(), candidates.end());
+
+    const auto selected = select_neighbors(candidates, m);
+    list[0] = (uint32_t)selected.size();
+    std::copy(selected.begin(), selected.end(), list + 1);
+}
+
+std::vector<uint32_t> rn_vector_index::select_neighbors(const std::vector<candidate>& candidates, uint32_t m) {
+    // A candidate is skipped when it is closer to an already selected neighbour
+    // than to the base node, which keeps links spread out in every direction
+    std::vector<uint32_t> selected;
+    for (const auto& [dist, node] : candidates) {
+        if (selected.size() >= m) {
+            break;
+        }
+        bool keep = true;
+        for (uint32_t other : selected) {
+            if (distance(code(node), code(other)) < dist) {
+                keep = false;
+                break;
+            }
+        }
+        if (keep) {
+            selected.push_back(node);
+        }
+    }
+    // Fill up with the closest skipped candidates so sparse regions stay connected
+    for (const auto& [dist, node] : candidates) {
+        if (selected.size() >= m) {
+            break;
+        }
+        if (std::find(selected.begin(), selected.end(), node) == selected.end()) {
+            selected.push_back(node);
+        }
+    }
+    return selected;
+}
+
+uint32_t rn_vector_index::search_greedy(const uint8_t* query, uint32_t entry, uint32_t level) {
+    float best = distance(query, code(entry));
+    bool improved = true;
+    while (improved) {
+        improved = false;
+        const uint32_t* list = links(entry, level);
+        for (uint32_t i = 0; i < list[0]; ++i) {
+            const float d = distance(query, code(list[1 + i]));
+            if (d < best) {
+                best = d;
+                entry = list[1 + i];
+                improved = true;
+            }
+        }
+    }
+    return entry;
+}
+
+std::vector<rn_vector_index::candidate> rn_vector_index::search_level(
+    const uint8_t* query, uint32_t entry, size_t ef, uint32_t level) {
+
+    if (++visited_tag_ == 0) {
+        std::fill(visited_.begin(), visited_.end(), 0);
+        visited_tag_ = 1;
+    }
+
+    // Closest unexpanded candidates first, and the ef best found so far with the worst on top
+    std::priority_queue<candidate, std::vector<candidate>, std::greater<candidate>> frontier;
+    std::priority_queue<candidate> best;
+
+    const float d0 = distance(query, code(entry));
+    frontier.push({ d0, entry });
+    best.push({ d0, entry });
+    visited_[entry] = visited_tag_;
+
+    while (!frontier.empty()) {
+        const auto [dist, node] = frontier.top();
+        if (dist > best.top().first && best.size() >= ef) {
+            break;
+        }
+        frontier.pop();
+
+        const uint32_t* list = links(node, level);
+        for (uint32_t i = 0; i < list[0]; ++i) {
+            const uint32_t next = list[1 + i];
+            if (visited_[next] == visited_tag_) {
+                continue;
+            }
+            visited_[next] = visited_tag_;
+
+            const float d = distance(query, code(next));
+            if (best.size() < ef || d < best.top().first) {
+                frontier.push({ d, next });
+                best.push({ d, next });
+                if (best.size() > ef) {
+                    best.pop();
+                }
+            }
+        }
+    }
+
+    std::vector<candidate> result(best.size());
+    for (size_t i = result.size(); i-- > 0;) {
+        result[i] = best.top();
+        best.pop();
+    }
+    return result;
+}
+
+std::vector<rn_vector_match> rn_vector_index::search(const float* query, size_t k, size_t ef) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    if (k == 0 || nodes_.empty()) {
+        return {};
+    }
+
+    query_.resize(code_size_);
+    encode(query, query_.data());
+
+    if (params_.type == RN_VECTOR_INDEX_HNSW) {
+        return search_hnsw(query_.data(), k, ef > 0 ? ef : params_.ef_search);
+    }
+    return search_flat(query_.data(), k);
+}
+
+std::vector<rn_vector_match> rn_vector_index::search_flat(const uint8_t* query, size_t k) {
+    // Worst of the k best on top
+    std::priority_queue<candidate> best;
+    const uint32_t count = header()->count;
+    for (uint32_t node = 0; node < count; ++node) {
+        if (reinterpret_cast<const node_header*>(record(node))->deleted) {
+            continue;
+        }
+        const float d = distance(query, code(node));
+        if (best.size() < k) {
+            best.push({ d, node });
+        } else if (d < best.top().first) {
+            best.pop();
+            best.push({ d, node });
+        }
+    }
+
+    std::vector<rn_vector_match> result(best.size());
+    for (size_t i = result.size(); i-- > 0;) {
+        const auto [dist, node] = best.top();
+        result[i] = { reinterpret_cast<const node_header*>(record(node))->id, score(dist) };
+        best.pop();
+    }
+    return result;
+}
+
+std::vector<rn_vector_match> rn_vector_index::search_hnsw(const uint8_t* query, size_t k, size_t ef) {
+    const auto* h = header();
+    uint32_t entry = h->entry_point;
+    for (uint32_t l = h->top_level; l > 0; --l) {
+        entry = search_greedy(query, entry, l);
+    }
+
+    // Deleted nodes are walked through but not returned, so look a bit further
+    const size_t n_extra = std::min<size_t>(h->n_deleted, k);
+    const auto candidates = search_level(query, entry, std::max(ef, k + n_extra), 0);
+
+    std::vector<rn_vector_match> result;
+    for (const auto& [dist, node] : candidates) {
+        const auto* nh = reinterpret_cast<const node_header*>(record(node));
+        if (nh->deleted) {
+            continue;
+        }
+        result.push_back({ nh->id, score(dist) });
+        if (result.size() == k) {
+            break;
+        }
+    }
+    return result;
+}
+
+size_t rn_vector_index::remove(const int64_t* ids, size_t n) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    size_t n_removed = 0;
+    for (size_t i = 0; i < n; ++i) {
+        auto it = nodes_.find(ids[i]);
+        if (it == nodes_.end()) {
+            continue;
+        }
+        reinterpret_cast<node_header*>(record(it->second))->deleted = 1;
+        header()->n_deleted++;
+        nodes_.erase(it);
+        n_removed++;
+    }
+    n_live_ = nodes_.size();
+    return n_removed;
+}
+
+void rn_vector_index::sync() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (file_) {
+        file_->sync();
+    }
+}
+
+} // namespace facebook::react
@@ -0,0 +1,179 @@
+#pragma once
+
+#include "rn-mapped-file.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace facebook::react {
+
+#define RN_VECTOR_INDEX_MAGIC   0x49564E52u // 'RNVI'
+#define RN_VECTOR_INDEX_VERSION 1
+
+#define RN_HNSW_M               16  // links per node above level 0, twice that at level 0
+#define RN_HNSW_EF_CONSTRUCTION 200 // candidates considered when linking a new node
+#define RN_HNSW_EF_SEARCH       64  // candidates considered by a search, at least k
+#define RN_HNSW_MAX_LEVELS      5   // graph levels, node levels are capped to fit
+
+enum rn_vector_index_type : uint32_t {
+    RN_VECTOR_INDEX_FLAT = 0, // exact scan of every vector
+    RN_VECTOR_INDEX_HNSW = 1, // approximate search over a navigable small-world graph
+};
+
+enum rn_vector_metric : uint32_t {
+    RN_VECTOR_METRIC_COSINE = 0, // vectors are normalized when added
+    RN_VECTOR_METRIC_DOT = 1,
+    RN_VECTOR_METRIC_L2 = 2,
+};
+
+// How the index stores vectors, see rn-quantize.hpp
+enum rn_vector_encoding : uint32_t {
+    RN_VECTOR_ENCODING_FLOAT32 = 0, // 4 bytes per dimension
+    RN_VECTOR_ENCODING_INT8 = 1,    // 1 byte per dimension and a scale
+    RN_VECTOR_ENCODING_BINARY = 2,  // 1 bit per dimension, compared by Hamming distance
+};
+
+struct rn_vector_index_params {
+    rn_vector_index_type type = RN_VECTOR_INDEX_FLAT;
+    rn_vector_metric metric = RN_VECTOR_METRIC_COSINE;
+    rn_vector_encoding encoding = RN_VECTOR_ENCODING_FLOAT32;
+    uint32_t dim = 0;
+    uint32_t M = RN_HNSW_M;
+    uint32_t ef_construction = RN_HNSW_EF_CONSTRUCTION;
+    uint32_t ef_search = RN_HNSW_EF_SEARCH;
+};
+
+// The index file starts with this header, followed by capacity fixed-size node
+// records. A record holds the node's id, level and deletion flag, its encoded
+// vector, and for HNSW its links: 2 * M at level 0 and M at each level above, each list
+// prefixed by its length. Nodes are only appended, so growing the file never
+// moves existing records.
+struct rn_vector_index_header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t type;        // rn_vector_index_type
+    uint32_t metric;      // rn_vector_metric
+    uint32_t dim;
+    uint32_t M;
+    uint32_t ef_construction;
+    uint32_t record_size;
+    uint32_t capacity;    // records the file has room for
+    uint32_t count;       // records in use, including deleted ones
+    uint32_t n_deleted;
+    uint32_t entry_point; // HNSW node searches start from, UINT32_MAX when empty
+    uint32_t top_level;   // level of the entry point
+    uint32_t encoding;    // rn_vector_encoding
+    uint32_t reserved[2];
+};
+
+static_assert(sizeof(rn_vector_index_header) == 64, "index header must stay 64 bytes");
+
+struct rn_vector_match {
+    int64_t id;
+    // Similarity for cosine and dot, distance for l2. A binary index scores
+    // the agreement of the sign bits, from -1 to 1.
+    float score;
+};
+
+// Vector index searched by similarity to a query vector.
+//
+// The flat index compares the query with every vector using the SIMD kernels of
+// rn-simd.hpp, which is exact and fast enough for tens of thousands of vectors.
+// The HNSW index links every vector to its nearest neighbours on a hierarchy of
+// graph levels and searches by walking the graph from the top, visiting a few
+// thousand vectors out of hundreds of thousands.
+//
+// Vectors are stored as floats, or quantized to int8 or to sign bits to cut
+// the memory of the vectors by 4 or 32 times at some cost in recall; queries
+// are quantized the same way and compared with rn_dot_i8 and rn_hamming.
+//
+// With a path, the index lives in a memory-mapped file, so it opens without
+// being read and persists as it is modified. Removed vectors are only marked
+// deleted, so the graph stays connected. Thread-safe.
+class rn_vector_index {
+public:
+    // Create an index, or open the one stored at path. An existing file keeps
+    // its own type, metric and graph parameters; its dimension must match
+    // params.dim unless that is 0. Throws std::runtime_error on failure.
+    explicit rn_vector_index(const rn_vector_index_params& params, const std::string& path = "");
+
+    rn_vector_index(const rn_vector_index&) = delete;
+    rn_vector_index& operator=(const rn_vector_index&) = delete;
+
+    // Add n vectors of dim floats, encoded as the index stores them; a vector
+    // whose id is already in the index replaces it
+    void add(const int64_t* ids, const float* vectors, size_t n);
+
+    // Remove vectors by id; returns how many were found
+    size_t remove(const int64_t* ids, size_t n);
+
+    // The k vectors closest to query, best first. ef overrides the HNSW
+    // search breadth.
+    std::vector<rn_vector_match> search(const float* query, size_t k, size_t ef = 0);
+
+    // Number of live vectors; does not wait for a running add or search
+    size_t size() const { return n_live_; }
+    const rn_vector_index_params& params() const { return params_; }
+
+    // Write pending changes of a file-backed index to storage
+    void sync();
+
+private:
+    struct node_header {
+        int64_t id;
+        uint32_t level;
+        uint32_t deleted;
+    };
+
+    using candidate = std::pair<float, uint32_t>; // distance, node
+
+    rn_vector_index_header* header();
+    uint8_t* record(uint32_t node);
+    uint8_t* code(uint32_t node) { return record(node) + sizeof(node_header); }
+    uint32_t* links(uint32_t node, uint32_t level);
+    uint32_t max_links(uint32_t level) const { return level == 0 ? 2 * params_.M : params_.M; }
+
+    void reserve(uint32_t capacity);
+    void insert(int64_t id, const float* vec);
+    // Encode a vector of dim floats into code_size_ bytes
+    void encode(const float* vec, uint8_t* out);
+    float distance(const uint8_t* a, const uint8_t* b) const;
+    float score(float distance) const;
+
+    // Greedy descent to the closest node on one level
+    uint32_t search_greedy(const uint8_t* query, uint32_t entry, uint32_t level);
+    // The ef closest nodes found from entry on one level, closest first
+    std::vector<candidate> search_level(const uint8_t* query, uint32_t entry, size_t ef, uint32_t level);
+    // Pick up to m diverse neighbours out of candidates sorted closest first
+    std::vector<uint32_t> select_neighbors(const std::vector<candidate>& candidates, uint32_t m);
+    void link(uint32_t from, uint32_t to, uint32_t level);
+
+    std::vector<rn_vector_match> search_flat(const uint8_t* query, size_t k);
+    std::vector<rn_vector_match> search_hnsw(const uint8_t* query, size_t k, size_t ef);
+
+    rn_vector_index_params params_;
+    size_t code_size_ = 0; // bytes of an encoded vector, a multiple of 4
+    std::unique_ptr<rn_mapped_file> file_;
+    std::vector<uint8_t> buffer_; // storage of an in-memory index
+    std::unordered_map<int64_t, uint32_t> nodes_;  // live node of each id
+    std::atomic<size_t> n_live_{0};                // nodes_.size(), read without the lock
+
+    // Visited marks of the graph searches, reset by bumping the tag
+    std::vector<uint32_t> visited_;
+    uint32_t visited_tag_ = 0;
+
+    std::mt19937 rng_;
+    std::vector<float> scratch_;  // normalized copy of a cosine vector
+    std::vector<uint8_t> query_;  // encoded query
+    std::mutex mutex_;
+};
+
+} // namespace facebook::react
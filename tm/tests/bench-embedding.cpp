@@ -0,0 +1,81 @@
+#include "rn-embedding.hpp"
+#include "test-utils.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <mutex>
+#include <string>
+#include <vector>
+
+using namespace facebook::react;
+
+// rn_embed on a set of short inputs: one call per input, as an array of inputs
+// was embedded before packing, against a single call that packs them into
+// batches of up to RN_EMBEDDING_N_SEQ sequences. Both produce the same vectors.
+//
+//   bench-embedding <embedding-model.gguf> [n_inputs]
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        std::fprintf(stderr, "usage: %s <embedding-model.gguf> [n_inputs]\n", argv[0]);
+        return 1;
+    }
+    const size_t n_inputs = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 256;
+
+    llama_backend_init();
+
+    llama_model_ptr model(llama_model_load_from_file(argv[1], llama_model_default_params()));
+    RN_CHECK(model != nullptr);
+
+    rn_llama_context rn_ctx;
+    rn_ctx.model = model.get();
+    rn_ctx.vocab = llama_model_get_vocab(rn_ctx.model);
+    rn_ctx.params.embd_n_threads = cpu_get_num_math();
+
+    std::vector<std::vector<llama_token>> inputs(n_inputs);
+    size_t n_tokens = 0;
+    for (size_t i = 0; i < n_inputs; ++i) {
+        const std::string text = "Document " + std::to_string(i) + " is about topic " + std::to_string(i % 17) +
+                                 " and was written in year " + std::to_string(1900 + i % 120) + ".";
+        inputs[i] = common_tokenize(rn_ctx.vocab, text, true, false);
+        n_tokens += inputs[i].size();
+    }
+
+    std::unique_lock<std::mutex> lock(rn_ctx.embd_mutex);
+    const int n_embd = llama_model_n_embd(rn_ctx.model);
+
+    // Creates the embedding context and warms it up
+    rn_embed(&rn_ctx, { inputs[0] }, LLAMA_POOLING_TYPE_UNSPECIFIED);
+
+    double t_start = rn_time_ms();
+    std::vector<float> single;
+    for (const auto& input : inputs) {
+        const std::vector<float> embd = rn_embed(&rn_ctx, { input }, LLAMA_POOLING_TYPE_UNSPECIFIED);
+        single.insert(single.end(), embd.begin(), embd.end());
+    }
+    const double t_single = rn_time_ms() - t_start;
+
+    t_start = rn_time_ms();
+    const std::vector<float> packed = rn_embed(&rn_ctx, inputs, LLAMA_POOLING_TYPE_UNSPECIFIED);
+    const double t_packed = rn_time_ms() - t_start;
+
+    RN_CHECK(packed.size() == single.size());
+    float max_diff = 0.0f;
+    for (size_t i = 0; i < packed.size(); ++i) {
+        max_diff = std::max(max_diff, std::fabs(packed[i] - single[i]));
+    }
+
+    std::printf("%zu inputs, %zu tokens, %d dimensions\n", n_inputs, n_tokens, n_embd);
+    std::printf("%-8s %12s %12s\n", "", "ms", "inputs/s");
+    std::printf("%-8s %12.1f %12.1f\n", "single", t_single, 1e3 * n_inputs / t_single);
+    std::printf("%-8s %12.1f %12.1f\n", "packed", t_packed, 1e3 * n_inputs / t_packed);
+    std::printf("largest difference between the vectors: %g\n", max_diff);
+
+    llama_free(rn_ctx.embd_ctx);
+    rn_ctx.embd_ctx = nullptr;
+    lock.unlock();
+    model.reset();
+    llama_backend_free();
+    return 0;
+}
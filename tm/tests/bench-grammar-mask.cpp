@@ -0,0 +1,139 @@
+#include "rn-grammar-mask.hpp"
+#include "test-utils.hpp"
+#include "llama-cpp.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <random>
+#include <vector>
+
+using namespace facebook::react;
+
+// Cost of constraining one sampled token to a grammar once the unconstrained
+// sample was rejected, which is when sample_token computes the mask:
+//
+//   resample  the grammar sampler applied to the whole vocab, then the best
+//             token taken, as common_sampler resamples
+//   reject    tokens checked one at a time from the most likely down until
+//             the grammar accepts one
+//   mask      rn_grammar_mask::compute and apply, then the best token taken
+//
+// The logits are random: the JSON grammar rarely agrees with them, free text
+// mostly does. The three pick the same token, which drives the walk through
+// the grammar.
+//
+//   bench-grammar-mask <model.gguf>
+
+static const char* json_grammar = R"(
+root   ::= "{" ws "\"name\":" ws string "," ws "\"age\":" ws number "," ws "\"tags\":" ws "[" ws tags? "]" ws "}"
+tags   ::= string ("," ws string)*
+string ::= "\"" [a-zA-Z0-9 ]{0,16} "\""
+number ::= [0-9]{1,3}
+ws     ::= [ \t\n]?
+)";
+
+static const char* text_grammar = R"(root ::= [^\n]+ "\n")";
+
+static llama_token best_token(const std::vector<llama_token_data>& data) {
+    const auto best = std::max_element(data.begin(), data.end(),
+        [](const llama_token_data& a, const llama_token_data& b) { return a.logit < b.logit; });
+    return best->id;
+}
+
+static void run(const llama_vocab* vocab, const char* name, const char* grammar_str) {
+    const int n_vocab = llama_vocab_n_tokens(vocab);
+    const int n_steps = 200;
+
+    std::mt19937 rng(42);
+    std::normal_distribution<float> dist(0.0f, 1.0f);
+
+    rn_grammar_mask grammar_mask;
+    llama_sampler_ptr grammar(llama_sampler_init_grammar(vocab, grammar_str, "root"));
+    std::vector<float> logits(n_vocab);
+    std::vector<llama_token_data> data(n_vocab);
+    std::vector<llama_token> order(n_vocab);
+    std::vector<uint64_t> mask;
+
+    // Warm up the trie outside the timings
+    grammar_mask.compute(vocab, grammar.get(), mask);
+
+    double t_resample = 0.0;
+    double t_reject = 0.0;
+    double t_mask = 0.0;
+    size_t n_tries = 0;
+
+    for (int step = 0; step < n_steps; ++step) {
+        for (float& logit : logits) {
+            logit = dist(rng);
+        }
+        // Candidates sorted by logit, as after the sampler chain
+        std::iota(order.begin(), order.end(), 0);
+        std::sort(order.begin(), order.end(), [&logits](llama_token a, llama_token b) { return logits[a] > logits[b]; });
+
+        double t_start = rn_time_ms();
+        for (llama_token token = 0; token < n_vocab; ++token) {
+            data[token] = { token, logits[token], 0.0f };
+        }
+        llama_token_data_array cur_p = { data.data(), data.size(), -1, false };
+        llama_sampler_apply(grammar.get(), &cur_p);
+        const llama_token id_resample = best_token(data);
+        t_resample += rn_time_ms() - t_start;
+
+        t_start = rn_time_ms();
+        llama_token id_reject = LLAMA_TOKEN_NULL;
+        for (llama_token token : order) {
+            llama_token_data single = { token, logits[token], 0.0f };
+            llama_token_data_array single_p = { &single, 1, -1, false };
+            llama_sampler_apply(grammar.get(), &single_p);
+            n_tries++;
+            if (single.logit != -INFINITY) {
+                id_reject = token;
+                break;
+            }
+        }
+        t_reject += rn_time_ms() - t_start;
+
+        t_start = rn_time_ms();
+        grammar_mask.compute(vocab, grammar.get(), mask);
+        rn_grammar_mask::apply(mask, logits.data(), n_vocab);
+        const llama_token id_mask = (llama_token)(std::max_element(logits.begin(), logits.end()) - logits.begin());
+        t_mask += rn_time_ms() - t_start;
+
+        RN_CHECK(id_resample == id_reject && id_resample == id_mask);
+
+        if (llama_vocab_is_eog(vocab, id_mask)) {
+            grammar.reset(llama_sampler_init_grammar(vocab, grammar_str, "root"));
+        } else {
+            llama_sampler_accept(grammar.get(), id_mask);
+        }
+    }
+
+    std::printf("%-6s %14.3f %14.3f %10.1f %14.3f\n", name,
+                t_resample / n_steps, t_reject / n_steps, (double)n_tries / n_steps, t_mask / n_steps);
+
+    grammar_mask.clear();
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        std::fprintf(stderr, "usage: %s <model.gguf>\n", argv[0]);
+        return 1;
+    }
+
+    llama_backend_init();
+    llama_model_params params = llama_model_default_params();
+    params.vocab_only = true;
+    llama_model_ptr model(llama_model_load_from_file(argv[1], params));
+    RN_CHECK(model != nullptr);
+    const llama_vocab* vocab = llama_model_get_vocab(model.get());
+
+    std::printf("vocab of %d tokens, ms per sampled token\n", llama_vocab_n_tokens(vocab));
+    std::printf("%-6s %14s %14s %10s %14s\n", "", "resample", "reject", "tries", "mask");
+    run(vocab, "json", json_grammar);
+    run(vocab, "text", text_grammar);
+
+    model.reset();
+    llama_backend_free();
+    return 0;
+}
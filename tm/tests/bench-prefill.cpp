@@ -0,0 +1,68 @@
+#include "rn-llama.hpp"
+#include "test-utils.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <string>
+
+using namespace facebook::react;
+
+// Prompt processing speed through the completion scheduler for a range of
+// n_batch values, the number of prompt tokens submitted per llama_decode call.
+// n_batch 1 decodes the prompt one token at a time.
+//
+//   bench-prefill <model.gguf> [n_words]
+
+static void run(const char* model_path, int n_batch, const std::string& prompt) {
+    common_params params;
+    params.model.path = model_path;
+    params.n_ctx = 4096;
+    params.n_batch = n_batch;
+    params.n_ubatch = std::min(n_batch, 512);
+    params.n_parallel = 1;
+
+    common_init_result init = common_init_from_params(params);
+    RN_CHECK(init.model && init.context);
+
+    rn_llama_context rn_ctx;
+    static_cast<common_params&>(rn_ctx.params) = params;
+    rn_ctx.model = init.model.get();
+    rn_ctx.ctx = init.context.get();
+    rn_ctx.vocab = llama_model_get_vocab(rn_ctx.model);
+    rn_ctx.model_loaded = true;
+    rn_ctx.scheduler = std::make_unique<rn_completion_scheduler>(&rn_ctx);
+
+    // common_init_from_params has warmed the backend up and left the cache empty
+    CompletionOptions options;
+    options.prompt = prompt;
+    options.n_predict = 1;
+    const CompletionResult result = rn_ctx.scheduler->submit(options, [](const CompletionChunk&, bool) { return true; });
+    RN_CHECK(result.error_msg.empty());
+
+    const int n_prompt = result.n_prompt_tokens - result.n_cached_tokens;
+    std::printf("%8d %10d %12.1f %12.1f\n", n_batch, n_prompt, result.prompt_ms, 1e3 * n_prompt / result.prompt_ms);
+
+    rn_ctx.scheduler.reset();
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        std::fprintf(stderr, "usage: %s <model.gguf> [n_words]\n", argv[0]);
+        return 1;
+    }
+    const size_t n_words = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 1024;
+
+    // A word is one to three tokens depending on the vocab; the count is printed
+    std::string prompt = "The";
+    for (size_t i = 0; i < n_words; ++i) {
+        prompt += " word" + std::to_string(i % 100);
+    }
+
+    llama_backend_init();
+    std::printf("%8s %10s %12s %12s\n", "n_batch", "tokens", "prompt ms", "tokens/s");
+    for (int n_batch : { 1, 16, 64, 256, 512, 2048 }) {
+        run(argv[1], n_batch, prompt);
+    }
+    llama_backend_free();
+    return 0;
+}
@@ -0,0 +1,94 @@
+#include "rn-vector-index.hpp"
+#include "test-utils.hpp"
+
+#include <cstdlib>
+#include <random>
+#include <set>
+#include <vector>
+
+using namespace facebook::react;
+
+// Flat against HNSW search: build time, query time and recall@10 of HNSW for
+// a range of search breadths, on clustered vectors.
+//
+//   bench-vector-index [n_vectors] [dim]
+
+int main(int argc, char** argv) {
+    const size_t n = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 20000;
+    const size_t dim = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 128;
+    const size_t n_queries = 200;
+    const size_t k = 10;
+
+    std::mt19937 rng(42);
+    std::normal_distribution<float> dist(0.0f, 1.0f);
+    std::vector<float> centers(1024 * dim);
+    for (float& x : centers) {
+        x = dist(rng);
+    }
+    auto make_vectors = [&](size_t count) {
+        std::uniform_int_distribution<size_t> pick(0, 1023);
+        std::vector<float> vecs(count * dim);
+        for (size_t i = 0; i < count; ++i) {
+            const float* center = &centers[pick(rng) * dim];
+            for (size_t j = 0; j < dim; ++j) {
+                vecs[i * dim + j] = center[j] + dist(rng);
+            }
+        }
+        return vecs;
+    };
+    const std::vector<float> vecs = make_vectors(n);
+    const std::vector<float> queries = make_vectors(n_queries);
+    std::vector<int64_t> ids(n);
+    for (size_t i = 0; i < n; ++i) {
+        ids[i] = (int64_t)i;
+    }
+
+    std::printf("%zu vectors of %zu dimensions, %zu queries, k = %zu\n\n", n, dim, n_queries, k);
+
+    for (rn_vector_encoding encoding : { RN_VECTOR_ENCODING_FLOAT32, RN_VECTOR_ENCODING_INT8, RN_VECTOR_ENCODING_BINARY }) {
+        rn_vector_index_params params;
+        params.dim = dim;
+        params.encoding = encoding;
+
+        double t_start = rn_time_ms();
+        rn_vector_index flat(params);
+        flat.add(ids.data(), vecs.data(), n);
+        const double t_flat_build = rn_time_ms() - t_start;
+
+        params.type = RN_VECTOR_INDEX_HNSW;
+        t_start = rn_time_ms();
+        rn_vector_index hnsw(params);
+        hnsw.add(ids.data(), vecs.data(), n);
+        const double t_hnsw_build = rn_time_ms() - t_start;
+
+        std::vector<std::set<int64_t>> exact(n_queries);
+        t_start = rn_time_ms();
+        for (size_t q = 0; q < n_queries; ++q) {
+            for (const auto& match : flat.search(&queries[q * dim], k)) {
+                exact[q].insert(match.id);
+            }
+        }
+        const double t_flat = (rn_time_ms() - t_start) / n_queries;
+
+        std::printf("encoding %u: flat build %.0f ms, hnsw build %.0f ms\n", encoding, t_flat_build, t_hnsw_build);
+        std::printf("  %-12s %12s %8s\n", "search", "ms/query", "recall");
+        std::printf("  %-12s %12.4f %8.3f\n", "flat", t_flat, 1.0);
+
+        for (size_t ef : { 16, 32, 64, 128, 256 }) {
+            size_t n_hit = 0;
+            t_start = rn_time_ms();
+            for (size_t q = 0; q < n_queries; ++q) {
+                for (const auto& match : hnsw.search(&queries[q * dim], k, ef)) {
+                    n_hit += exact[q].count(match.id);
+                }
+            }
+            const double t_hnsw = (rn_time_ms() - t_start) / n_queries;
+            char name[32];
+            std::snprintf(name, sizeof(name), "hnsw ef %zu", ef);
+            std::printf("  %-12s %12.4f %8.3f\n", name, t_hnsw, (double)n_hit / (n_queries * k));
+        }
+        std::printf("\n");
+    }
+
+    return 0;
+}
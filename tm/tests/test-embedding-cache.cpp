@@ -0,0 +1,157 @@
+#include "rn-embedding-cache.hpp"
+#include "test-utils.hpp"
+
+#include <filesystem>
+#include <string>
+#include <vector>
+
+using namespace facebook::react;
+
+// The cache only reads the model's description and sizes, so the vocab-only
+// models that come with llama.cpp are enough.
+//
+//   test-embedding-cache <model.gguf>
+
+namespace fs = std::filesystem;
+
+static std::vector<float> vector_of(size_t i, int n_embd) {
+    std::vector<float> embd(n_embd);
+    for (int j = 0; j < n_embd; ++j) {
+        embd[j] = (float)i + (float)j / n_embd;
+    }
+    return embd;
+}
+
+static rn_embedding_key key_of(size_t i) {
+    return rn_embedding_cache::make_key("document " + std::to_string(i), LLAMA_POOLING_TYPE_MEAN, true);
+}
+
+static void test_keys() {
+    const rn_embedding_key key = key_of(1);
+    RN_CHECK(key == key_of(1));
+    RN_CHECK(!(key == key_of(2)));
+    RN_CHECK(!(key == rn_embedding_cache::make_key("document 1", LLAMA_POOLING_TYPE_CLS, true)));
+    RN_CHECK(!(key == rn_embedding_cache::make_key("document 1", LLAMA_POOLING_TYPE_MEAN, false)));
+    // An all-zero key marks a free file slot, so no key is all zero
+    RN_CHECK((rn_embedding_cache::make_key("", LLAMA_POOLING_TYPE_NONE, false).lo & 1) == 1);
+}
+
+static void test_memory(const llama_model* model) {
+    const int n_embd = llama_model_n_embd(model);
+    std::vector<float> out(n_embd);
+
+    rn_embedding_cache cache;
+    RN_CHECK(!cache.get(key_of(0), out.data())); // not opened yet
+
+    cache.open(model, "", 4);
+    for (size_t i = 0; i < 8; ++i) {
+        cache.put(key_of(i), vector_of(i, n_embd).data());
+    }
+    // Only the 4 most recently used are kept
+    for (size_t i = 0; i < 4; ++i) {
+        RN_CHECK(!cache.get(key_of(i), out.data()));
+    }
+    for (size_t i = 4; i < 8; ++i) {
+        RN_CHECK(cache.get(key_of(i), out.data()));
+        RN_CHECK(out == vector_of(i, n_embd));
+    }
+    const rn_embedding_cache_stats stats = cache.stats();
+    RN_CHECK(stats.hits == 4 && stats.misses == 4 && stats.file_hits == 0);
+    RN_CHECK(stats.n_memory == 4 && stats.n_file == 0);
+    cache.close();
+}
+
+// Vectors written by one cache are read back by the next one opening the directory
+static void test_file(const llama_model* model, const fs::path& dir) {
+    const int n_embd = llama_model_n_embd(model);
+    const size_t n = 32;
+    std::vector<float> out(n_embd);
+
+    {
+        rn_embedding_cache cache;
+        cache.open(model, dir.string(), 4, 256);
+        for (size_t i = 0; i < n; ++i) {
+            cache.put(key_of(i), vector_of(i, n_embd).data());
+        }
+        RN_CHECK(cache.stats().n_file == n);
+        cache.close();
+    }
+
+    {
+        rn_embedding_cache cache;
+        cache.open(model, dir.string(), 4, 256);
+        RN_CHECK(cache.stats().n_file == n);
+        for (size_t i = 0; i < n; ++i) {
+            RN_CHECK(cache.get(key_of(i), out.data()));
+            RN_CHECK(out == vector_of(i, n_embd));
+        }
+        RN_CHECK(!cache.get(key_of(n), out.data()));
+
+        const rn_embedding_cache_stats stats = cache.stats();
+        RN_CHECK(stats.hits == n && stats.file_hits == n && stats.misses == 1);
+        cache.close();
+    }
+
+    // A file of another layout is started over
+    {
+        rn_embedding_cache cache;
+        cache.open(model, dir.string(), 4, 128);
+        RN_CHECK(cache.stats().n_file == 0);
+        RN_CHECK(!cache.get(key_of(0), out.data()));
+        cache.close();
+    }
+}
+
+// A full file replaces its least recently used vectors
+static void test_file_eviction(const llama_model* model, const fs::path& dir) {
+    const int n_embd = llama_model_n_embd(model);
+    std::vector<float> out(n_embd);
+
+    // As many slots as probes, so every key can take any slot
+    const size_t n_entries = RN_EMBEDDING_CACHE_PROBES;
+    rn_embedding_cache cache;
+    cache.open(model, dir.string(), 0, n_entries);
+    for (size_t i = 0; i < 20; ++i) {
+        cache.put(key_of(i), vector_of(i, n_embd).data());
+    }
+    RN_CHECK(cache.stats().n_file == n_entries);
+    for (size_t i = 0; i < 20; ++i) {
+        const bool kept = i >= 20 - n_entries;
+        RN_CHECK(cache.get(key_of(i), out.data()) == kept);
+        if (kept) {
+            RN_CHECK(out == vector_of(i, n_embd));
+        }
+    }
+    cache.close();
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        std::fprintf(stderr, "usage: %s <model.gguf>\n", argv[0]);
+        return 1;
+    }
+
+    llama_backend_init();
+    llama_model_params params = llama_model_default_params();
+    params.vocab_only = true;
+    llama_model* model = llama_model_load_from_file(argv[1], params);
+    RN_CHECK(model != nullptr);
+
+    const fs::path dir = fs::temp_directory_path() / "rn-test-embedding-cache";
+    fs::remove_all(dir);
+    fs::create_directories(dir);
+
+    test_keys();
+    test_memory(model);
+    test_file(model, dir);
+    fs::remove_all(dir);
+    fs::create_directories(dir);
+    test_file_eviction(model, dir);
+
+    fs::remove_all(dir);
+    llama_model_free(model);
+    llama_backend_free();
+
+    std::printf("test-embedding-cache: OK\n");
+    return 0;
+}
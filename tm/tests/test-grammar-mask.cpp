@@ -0,0 +1,166 @@
+#include "rn-grammar-mask.hpp"
+#include "test-utils.hpp"
+#include "llama-cpp.h"
+
+#include <cmath>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace facebook::react;
+
+// rn_grammar_mask against the grammar sampler applied to the whole vocab, which
+// is what sampling without the mask does, along random walks through a few
+// grammars. Only the vocab is needed, so the vocab-only models that come with
+// llama.cpp are enough.
+//
+//   test-grammar-mask <model.gguf>
+
+static const char* json_grammar = R"(
+root   ::= "{" ws "\"name\":" ws string "," ws "\"age\":" ws number "," ws "\"tags\":" ws "[" ws tags? "]" ws "}"
+tags   ::= string ("," ws string)*
+string ::= "\"" [a-zA-Z0-9 ]{0,16} "\""
+number ::= [0-9]{1,3}
+ws     ::= [ \t\n]?
+)";
+
+static const char* choice_grammar = R"(root ::= "hello world" | "hello there")";
+static const char* text_grammar = R"(root ::= [^\n]+ "\n")";
+static const char* unicode_grammar = R"(root ::= "héllo" [0-9]+)";
+
+// Mask of the tokens the grammar accepts when given the whole vocab at once
+static std::vector<uint64_t> reference_mask(llama_sampler* grammar, int n_vocab) {
+    std::vector<llama_token_data> data(n_vocab);
+    for (llama_token token = 0; token < n_vocab; ++token) {
+        data[token] = { token, 0.0f, 0.0f };
+    }
+    llama_token_data_array cur_p = { data.data(), data.size(), -1, false };
+    llama_sampler_apply(grammar, &cur_p);
+
+    std::vector<uint64_t> mask((n_vocab + 63) / 64, 0);
+    for (const auto& d : data) {
+        if (d.logit != -INFINITY) {
+            mask[d.id / 64] |= 1ULL << (d.id % 64);
+        }
+    }
+    return mask;
+}
+
+static bool has_token(const std::vector<uint64_t>& mask, llama_token token) {
+    return (mask[token / 64] >> (token % 64)) & 1;
+}
+
+static llama_sampler* init_grammar(const llama_vocab* vocab, const char* grammar_str) {
+    llama_sampler* grammar = llama_sampler_init_grammar(vocab, grammar_str, "root");
+    RN_CHECK(grammar != nullptr);
+    return grammar;
+}
+
+// The mask must equal the reference at every step of random walks to the end of the grammar
+static void test_walk(const llama_vocab* vocab, rn_grammar_mask& grammar_mask, const char* grammar_str) {
+    const int n_vocab = llama_vocab_n_tokens(vocab);
+    std::mt19937 rng(1);
+
+    for (int walk = 0; walk < 4; ++walk) {
+        llama_sampler_ptr grammar(init_grammar(vocab, grammar_str));
+
+        for (int step = 0; step < 48; ++step) {
+            std::vector<uint64_t> mask;
+            grammar_mask.compute(vocab, grammar.get(), mask);
+            RN_CHECK(mask == reference_mask(grammar.get(), n_vocab));
+
+            std::vector<llama_token> accepted;
+            for (llama_token token = 0; token < n_vocab; ++token) {
+                if (has_token(mask, token) && !llama_vocab_is_eog(vocab, token)) {
+                    accepted.push_back(token);
+                }
+            }
+            if (accepted.empty()) {
+                break;
+            }
+            const llama_token token = accepted[std::uniform_int_distribution<size_t>(0, accepted.size() - 1)(rng)];
+            llama_sampler_accept(grammar.get(), token);
+        }
+    }
+}
+
+static void test_forced_text(const llama_vocab* vocab, rn_grammar_mask& grammar_mask) {
+    const int n_vocab = llama_vocab_n_tokens(vocab);
+
+    llama_sampler_ptr choice(init_grammar(vocab, choice_grammar));
+    const std::vector<uint64_t> before = reference_mask(choice.get(), n_vocab);
+    RN_CHECK(grammar_mask.forced_text(vocab, choice.get(), 256) == "hello ");
+    RN_CHECK(grammar_mask.forced_text(vocab, choice.get(), 3) == "hel");
+    // The grammar is left as it was
+    RN_CHECK(reference_mask(choice.get(), n_vocab) == before);
+
+    // No incomplete UTF-8 sequence at the end
+    llama_sampler_ptr unicode(init_grammar(vocab, unicode_grammar));
+    RN_CHECK(grammar_mask.forced_text(vocab, unicode.get(), 256) == "héllo");
+    RN_CHECK(grammar_mask.forced_text(vocab, unicode.get(), 3) == "hé");
+    RN_CHECK(grammar_mask.forced_text(vocab, unicode.get(), 2) == "h");
+
+    llama_sampler_ptr text(init_grammar(vocab, text_grammar));
+    RN_CHECK(grammar_mask.forced_text(vocab, text.get(), 256).empty());
+}
+
+static void test_single_prefix(const llama_vocab* vocab, rn_grammar_mask& grammar_mask) {
+    std::vector<uint64_t> mask;
+
+    llama_sampler_ptr json(init_grammar(vocab, json_grammar));
+    grammar_mask.compute(vocab, json.get(), mask);
+    RN_CHECK(grammar_mask.single_prefix(mask)); // every token starts with "{"
+
+    llama_sampler_ptr text(init_grammar(vocab, text_grammar));
+    grammar_mask.compute(vocab, text.get(), mask);
+    RN_CHECK(!grammar_mask.single_prefix(mask));
+}
+
+static void test_apply() {
+    std::mt19937_64 rng(2);
+    for (int n_vocab : { 1, 63, 64, 65, 1000, 32000 }) {
+        std::vector<uint64_t> mask((n_vocab + 63) / 64);
+        for (auto& bits : mask) {
+            bits = rng();
+        }
+        mask[0] = ~0ULL; // a whole word of accepted tokens is skipped
+
+        std::vector<float> logits(n_vocab);
+        for (int i = 0; i < n_vocab; ++i) {
+            logits[i] = (float)i;
+        }
+        rn_grammar_mask::apply(mask, logits.data(), n_vocab);
+        for (int i = 0; i < n_vocab; ++i) {
+            RN_CHECK(logits[i] == (has_token(mask, i) ? (float)i : -INFINITY));
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        std::fprintf(stderr, "usage: %s <model.gguf>\n", argv[0]);
+        return 1;
+    }
+
+    llama_backend_init();
+    llama_model_params params = llama_model_default_params();
+    params.vocab_only = true;
+    llama_model_ptr model(llama_model_load_from_file(argv[1], params));
+    RN_CHECK(model != nullptr);
+    const llama_vocab* vocab = llama_model_get_vocab(model.get());
+
+    rn_grammar_mask grammar_mask;
+    for (const char* grammar_str : { json_grammar, choice_grammar, text_grammar, unicode_grammar }) {
+        test_walk(vocab, grammar_mask, grammar_str);
+    }
+    test_forced_text(vocab, grammar_mask);
+    test_single_prefix(vocab, grammar_mask);
+    test_apply();
+
+    grammar_mask.clear();
+    model.reset();
+    llama_backend_free();
+
+    std::printf("test-grammar-mask: OK\n");
+    return 0;
+}
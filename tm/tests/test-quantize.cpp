@@ -0,0 +1,179 @@
+#include "rn-quantize.hpp"
+#include "rn-simd.hpp"
+#include "test-utils.hpp"
+
+#include <cmath>
+#include <random>
+#include <vector>
+
+using namespace facebook::react;
+
+static std::vector<float> random_vector(std::mt19937& rng, size_t n) {
+    std::normal_distribution<float> dist(0.0f, 1.0f);
+    std::vector<float> vec(n);
+    for (float& x : vec) {
+        x = dist(rng);
+    }
+    return vec;
+}
+
+// Sizes around the SIMD widths, to cover the vector loops and their tails
+static const size_t sizes[] = { 0, 1, 3, 7, 8, 9, 15, 16, 17, 31, 32, 33, 63, 64, 65, 384, 768, 1023 };
+
+static void test_normalize() {
+    std::mt19937 rng(1);
+    for (size_t n : sizes) {
+        if (n == 0) {
+            continue;
+        }
+        std::vector<float> vec = random_vector(rng, n);
+        rn_normalize_f32(vec.data(), n);
+        double norm = 0.0;
+        for (float x : vec) {
+            norm += (double)x * x;
+        }
+        RN_CHECK(std::fabs(norm - 1.0) < 1e-4);
+    }
+
+    std::vector<float> zero(16, 0.0f);
+    rn_normalize_f32(zero.data(), zero.size());
+    for (float x : zero) {
+        RN_CHECK(x == 0.0f);
+    }
+}
+
+static void test_int8() {
+    std::mt19937 rng(2);
+    for (size_t n : sizes) {
+        if (n == 0) {
+            continue;
+        }
+        const std::vector<float> vec = random_vector(rng, n);
+        std::vector<int8_t> code(n);
+        const float scale = rn_quantize_int8(vec.data(), n, code.data());
+        RN_CHECK(scale > 0.0f);
+
+        bool has_max = false;
+        for (size_t i = 0; i < n; ++i) {
+            RN_CHECK(code[i] != -128);
+            // Rounded to the nearest step
+            RN_CHECK(std::fabs(code[i] * scale - vec[i]) <= scale * 0.5f + 1e-6f);
+            has_max = has_max || code[i] == 127 || code[i] == -127;
+        }
+        // The largest magnitude uses the full range
+        RN_CHECK(has_max);
+    }
+
+    std::vector<float> zero(16, 0.0f);
+    std::vector<int8_t> code(16, 1);
+    RN_CHECK(rn_quantize_int8(zero.data(), zero.size(), code.data()) == 0.0f);
+    for (int8_t x : code) {
+        RN_CHECK(x == 0);
+    }
+}
+
+static void test_binary() {
+    const float vec[10] = { 1.0f, -1.0f, 0.0f, 2.0f, 0.5f, -0.5f, -2.0f, 3.0f, 4.0f, -4.0f };
+    uint8_t code[2] = { 0xFF, 0xFF };
+    RN_CHECK(rn_binary_size(10) == 2);
+    rn_quantize_binary(vec, 10, code);
+    // Most significant bit first, zero is not positive, unused low bits cleared
+    RN_CHECK(code[0] == 0x99); // 1001 1001
+    RN_CHECK(code[1] == 0x80); // 10-- ----
+
+    RN_CHECK(rn_binary_size(0) == 0);
+    RN_CHECK(rn_binary_size(8) == 1);
+    RN_CHECK(rn_binary_size(9) == 2);
+}
+
+static void test_kernels() {
+    std::mt19937 rng(3);
+    std::uniform_int_distribution<int> byte(0, 255);
+    for (size_t n : sizes) {
+        // Extreme values check that the int8 products do not overflow
+        std::vector<int8_t> a(n);
+        std::vector<int8_t> b(n);
+        for (size_t i = 0; i < n; ++i) {
+            a[i] = i % 5 == 0 ? -127 : (int8_t)(byte(rng) - 128);
+            b[i] = i % 5 == 0 ? -127 : (int8_t)(byte(rng) - 128);
+        }
+        int32_t dot = 0;
+        for (size_t i = 0; i < n; ++i) {
+            dot += (int32_t)a[i] * b[i];
+        }
+        RN_CHECK(rn_dot_i8(a.data(), b.data(), n) == dot);
+
+        std::vector<uint8_t> x(n);
+        std::vector<uint8_t> y(n);
+        uint32_t distance = 0;
+        for (size_t i = 0; i < n; ++i) {
+            x[i] = (uint8_t)byte(rng);
+            y[i] = (uint8_t)byte(rng);
+            for (int bit = 0; bit < 8; ++bit) {
+                distance += ((x[i] ^ y[i]) >> bit) & 1;
+            }
+        }
+        RN_CHECK(rn_hamming(x.data(), y.data(), n) == distance);
+    }
+}
+
+// The int8 and binary codes must keep the neighbours of a vector close to
+// what the float vectors give, since the vector index searches over them
+static void test_ranking() {
+    std::mt19937 rng(4);
+    const size_t dim = 384;
+    const size_t n = 200;
+
+    std::vector<std::vector<float>> vecs;
+    for (size_t i = 0; i < n; ++i) {
+        vecs.push_back(random_vector(rng, dim));
+        rn_normalize_f32(vecs.back().data(), dim);
+    }
+    // The query is a noisy copy of vector 0
+    std::vector<float> query = vecs[0];
+    const std::vector<float> noise = random_vector(rng, dim);
+    for (size_t i = 0; i < dim; ++i) {
+        query[i] += 0.02f * noise[i];
+    }
+    rn_normalize_f32(query.data(), dim);
+
+    std::vector<int8_t> query_i8(dim);
+    std::vector<uint8_t> query_bin(rn_binary_size(dim));
+    rn_quantize_int8(query.data(), dim, query_i8.data());
+    rn_quantize_binary(query.data(), dim, query_bin.data());
+
+    size_t best_i8 = 0;
+    size_t best_bin = 0;
+    int32_t best_dot = INT32_MIN;
+    uint32_t best_distance = UINT32_MAX;
+    for (size_t i = 0; i < n; ++i) {
+        std::vector<int8_t> code_i8(dim);
+        std::vector<uint8_t> code_bin(rn_binary_size(dim));
+        rn_quantize_int8(vecs[i].data(), dim, code_i8.data());
+        rn_quantize_binary(vecs[i].data(), dim, code_bin.data());
+
+        const int32_t dot = rn_dot_i8(query_i8.data(), code_i8.data(), dim);
+        if (dot > best_dot) {
+            best_dot = dot;
+            best_i8 = i;
+        }
+        const uint32_t distance = rn_hamming(query_bin.data(), code_bin.data(), code_bin.size());
+        if (distance < best_distance) {
+            best_distance = distance;
+            best_bin = i;
+        }
+    }
+    RN_CHECK(best_i8 == 0);
+    RN_CHECK(best_bin == 0);
+}
+
+int main() {
+    test_normalize();
+    test_int8();
+    test_binary();
+    test_kernels();
+    test_ranking();
+
+    std::printf("test-quantize: OK\n");
+    return 0;
+}
@@ -0,0 +1,41 @@
+#include "rn-simd.hpp"
+#include "test-utils.hpp"
+
+#include <cmath>
+#include <random>
+#include <vector>
+
+using namespace facebook::react;
+
+// rn_mask_f32_64 against the scalar loop it vectorizes, on random and edge
+// bit patterns; the floats whose bits are set must come through unchanged.
+static void test_mask_f32_64() {
+    std::mt19937_64 rng(1);
+    std::normal_distribution<float> dist(0.0f, 10.0f);
+
+    std::vector<uint64_t> patterns = { 0, ~0ULL, 1, 1ULL << 63, 0x5555555555555555ULL, 0xAAAAAAAAAAAAAAAAULL,
+                                       0x00000000FFFFFFFFULL, 0xFFFFFFFF00000000ULL, 0x0F0F0F0F0F0F0F0FULL };
+    for (int i = 0; i < 1000; ++i) {
+        patterns.push_back(rng());
+    }
+
+    for (uint64_t bits : patterns) {
+        float x[64];
+        float expected[64];
+        for (int i = 0; i < 64; ++i) {
+            x[i] = i % 17 == 0 ? -INFINITY : dist(rng);
+            expected[i] = ((bits >> i) & 1) ? x[i] : -INFINITY;
+        }
+        rn_mask_f32_64(x, bits);
+        for (int i = 0; i < 64; ++i) {
+            RN_CHECK(x[i] == expected[i]);
+        }
+    }
+}
+
+int main() {
+    test_mask_f32_64();
+
+    std::printf("test-simd: OK\n");
+    return 0;
+}
@@ -0,0 +1,154 @@
+#include "rn-stop-matcher.hpp"
+#include "test-utils.hpp"
+
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace facebook::react;
+
+// Earliest full match in text as the per-word search the matcher replaced found it
+static bool find_naive(const std::string& text, const std::vector<std::string>& words,
+                       size_t& match_pos, size_t& match_word) {
+    bool found = false;
+    for (size_t w = 0; w < words.size(); ++w) {
+        if (words[w].empty()) {
+            continue;
+        }
+        const size_t pos = text.find(words[w]);
+        if (pos != std::string::npos && (!found || pos < match_pos)) {
+            match_pos = pos;
+            match_word = w;
+            found = true;
+        }
+    }
+    return found;
+}
+
+// Longest suffix of text that is the start of a word
+static size_t partial_naive(const std::string& text, const std::vector<std::string>& words) {
+    size_t best = 0;
+    for (const auto& word : words) {
+        for (size_t n = std::min(word.size(), text.size()); n > best; --n) {
+            if (text.compare(text.size() - n, n, word, 0, n) == 0) {
+                best = n;
+                break;
+            }
+        }
+    }
+    return best;
+}
+
+// Feed text in chunks and check the matcher against the naive search after each one
+static void check_text(const std::vector<std::string>& words, const std::string& text,
+                       const std::vector<size_t>& chunks) {
+    rn_stop_matcher matcher(words);
+
+    size_t fed = 0;
+    for (size_t chunk : chunks) {
+        chunk = std::min(chunk, text.size() - fed);
+        size_t pos = 0;
+        size_t word = 0;
+        const bool found = matcher.feed(text.data() + fed, chunk, pos, word);
+        fed += chunk;
+
+        size_t pos_naive = 0;
+        size_t word_naive = 0;
+        const bool found_naive = find_naive(text.substr(0, fed), words, pos_naive, word_naive);
+        RN_CHECK(found == found_naive);
+        if (found) {
+            RN_CHECK(pos == pos_naive);
+            // Several stop strings can start there, any of them may be reported
+            RN_CHECK(text.compare(pos, matcher.word(word).size(), matcher.word(word)) == 0);
+            // A completion stops at its first match
+            return;
+        }
+        RN_CHECK(matcher.partial_length() == partial_naive(text.substr(0, fed), words));
+    }
+}
+
+static void test_examples() {
+    // A later stop string can start earlier than the first one to end
+    check_text({ "abcd", "c" }, "xxabcd", { 6 });
+    check_text({ "abcd", "bc" }, "abcd", { 1, 1, 1, 1 });
+
+    // Overlapping prefixes and failure links
+    check_text({ "aab" }, "aaab", { 1, 1, 1, 1 });
+    check_text({ "he", "she", "his", "hers" }, "ushers", { 2, 2, 2 });
+
+    // Stop string split across tokens
+    check_text({ "</s>" }, "hello</s>", { 5, 1, 2, 1 });
+
+    // Bytes outside ASCII
+    check_text({ "\xE2\x80\x9C" }, "say \xE2\x80\x9Chi", { 4, 1, 1, 1, 2 });
+
+    // Duplicate and empty stop strings
+    {
+        rn_stop_matcher matcher({ "", "end", "end" });
+        size_t pos = 0;
+        size_t word = 0;
+        RN_CHECK(matcher.feed("the end", 7, pos, word));
+        RN_CHECK(pos == 4);
+        RN_CHECK(word == 0);
+        RN_CHECK(matcher.word(word) == "end");
+    }
+
+    // No stop strings
+    {
+        rn_stop_matcher matcher({ "" });
+        size_t pos = 0;
+        size_t word = 0;
+        RN_CHECK(matcher.empty());
+        RN_CHECK(!matcher.feed("abc", 3, pos, word));
+        RN_CHECK(matcher.partial_length() == 0);
+    }
+
+    // Partial match held back, then dropped
+    {
+        rn_stop_matcher matcher({ "STOP" });
+        size_t pos = 0;
+        size_t word = 0;
+        RN_CHECK(!matcher.feed("abST", 4, pos, word));
+        RN_CHECK(matcher.partial_length() == 2);
+        RN_CHECK(!matcher.feed("x", 1, pos, word));
+        RN_CHECK(matcher.partial_length() == 0);
+    }
+}
+
+static void test_random() {
+    std::mt19937 rng(42);
+    auto rand = [&rng](int lo, int hi) { return std::uniform_int_distribution<int>(lo, hi)(rng); };
+
+    // A small alphabet, so stop strings overlap and occur often
+    auto random_string = [&](int min_len, int max_len) {
+        std::string s(rand(min_len, max_len), ' ');
+        for (char& c : s) {
+            c = (char)('a' + rand(0, 2));
+        }
+        return s;
+    };
+
+    for (int iter = 0; iter < 20000; ++iter) {
+        std::vector<std::string> words(rand(1, 5));
+        for (auto& word : words) {
+            word = random_string(1, 5);
+        }
+        const std::string text = random_string(0, 40);
+
+        std::vector<size_t> chunks;
+        for (size_t n = 0; n < text.size();) {
+            chunks.push_back(rand(1, 6));
+            n += chunks.back();
+        }
+        check_text(words, text, chunks);
+    }
+}
+
+int main() {
+    test_examples();
+    test_random();
+
+    std::printf("test-stop-matcher: OK\n");
+    return 0;
+}
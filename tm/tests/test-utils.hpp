@@ -0,0 +1,21 @@
+#pragma once
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+// Checks that stay on in release builds, so the tests can be built with the
+// same flags as the benchmarks
+#define RN_CHECK(cond)                                                          \
+    do {                                                                        \
+        if (!(cond)) {                                                          \
+            std::fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            std::exit(1);                                                       \
+        }                                                                       \
+    } while (0)
+
+// Milliseconds since an arbitrary start, for the benchmarks
+static inline double rn_time_ms() {
+    using clock = std::chrono::steady_clock;
+    return std::chrono::duration<double, std::milli>(clock::now().time_since_epoch()).count();
+}
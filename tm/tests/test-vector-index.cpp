@@ -0,0 +1,287 @@
+#include "rn-vector-index.hpp"
+#include "rn-quantize.hpp"
+#include "rn-simd.hpp"
+#include "test-utils.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
+#include <random>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace facebook::react;
+
+// Vectors are drawn around a few hundred centers, closer to real embeddings
+// than uniform noise, where every vector is about as far from all the others
+static std::vector<float> random_centers(std::mt19937& rng, size_t dim) {
+    std::normal_distribution<float> dist(0.0f, 1.0f);
+    std::vector<float> centers(256 * dim);
+    for (float& x : centers) {
+        x = dist(rng);
+    }
+    return centers;
+}
+
+static std::vector<float> clustered_vectors(std::mt19937& rng, const std::vector<float>& centers, size_t n, size_t dim) {
+    std::normal_distribution<float> dist(0.0f, 1.0f);
+    std::uniform_int_distribution<size_t> pick(0, centers.size() / dim - 1);
+    std::vector<float> vecs(n * dim);
+    for (size_t i = 0; i < n; ++i) {
+        const float* center = &centers[pick(rng) * dim];
+        for (size_t j = 0; j < dim; ++j) {
+            vecs[i * dim + j] = center[j] + 0.5f * dist(rng);
+        }
+    }
+    return vecs;
+}
+
+static std::vector<int64_t> ids_of(const std::vector<rn_vector_match>& matches) {
+    std::vector<int64_t> ids;
+    for (const auto& match : matches) {
+        ids.push_back(match.id);
+    }
+    return ids;
+}
+
+// Fraction of the exact neighbours an approximate search found
+static double recall(const std::vector<rn_vector_match>& exact, const std::vector<rn_vector_match>& found) {
+    std::set<int64_t> expected;
+    for (const auto& match : exact) {
+        expected.insert(match.id);
+    }
+    size_t n_hit = 0;
+    for (const auto& match : found) {
+        n_hit += expected.count(match.id);
+    }
+    return exact.empty() ? 1.0 : (double)n_hit / exact.size();
+}
+
+// The flat float index must return the brute-force ranking and scores
+static void test_flat_exact() {
+    std::mt19937 rng(1);
+    const size_t dim = 37; // not a multiple of the SIMD width
+    const std::vector<float> centers = random_centers(rng, dim);
+    const size_t n = 500;
+    const std::vector<float> vecs = clustered_vectors(rng, centers, n, dim);
+    std::vector<int64_t> ids(n);
+    for (size_t i = 0; i < n; ++i) {
+        ids[i] = 1000 + (int64_t)i;
+    }
+
+    for (rn_vector_metric metric : { RN_VECTOR_METRIC_COSINE, RN_VECTOR_METRIC_DOT, RN_VECTOR_METRIC_L2 }) {
+        rn_vector_index_params params;
+        params.metric = metric;
+        params.dim = dim;
+        rn_vector_index index(params);
+        index.add(ids.data(), vecs.data(), n);
+        RN_CHECK(index.size() == n);
+
+        const std::vector<float> query = clustered_vectors(rng, centers, 1, dim);
+        std::vector<float> query_unit = query;
+        rn_normalize_f32(query_unit.data(), dim);
+
+        std::vector<rn_vector_match> expected;
+        for (size_t i = 0; i < n; ++i) {
+            std::vector<float> vec(vecs.begin() + i * dim, vecs.begin() + (i + 1) * dim);
+            float score = 0.0f;
+            if (metric == RN_VECTOR_METRIC_COSINE) {
+                rn_normalize_f32(vec.data(), dim);
+                score = rn_dot_f32(query_unit.data(), vec.data(), dim);
+            } else if (metric == RN_VECTOR_METRIC_DOT) {
+                score = rn_dot_f32(query.data(), vec.data(), dim);
+            } else {
+                score = std::sqrt(rn_l2sq_f32(query.data(), vec.data(), dim));
+            }
+            expected.push_back({ ids[i], score });
+        }
+        std::sort(expected.begin(), expected.end(), [metric](const rn_vector_match& a, const rn_vector_match& b) {
+            return metric == RN_VECTOR_METRIC_L2 ? a.score < b.score : a.score > b.score;
+        });
+        expected.resize(10);
+
+        const std::vector<rn_vector_match> found = index.search(query.data(), 10);
+        RN_CHECK(found.size() == 10);
+        for (size_t i = 0; i < found.size(); ++i) {
+            RN_CHECK(found[i].id == expected[i].id);
+            RN_CHECK(std::fabs(found[i].score - expected[i].score) < 1e-3f * std::max(1.0f, std::fabs(expected[i].score)));
+        }
+    }
+}
+
+// HNSW and the quantized encodings against the exact flat float search
+static void test_recall() {
+    std::mt19937 rng(2);
+    const size_t dim = 64;
+    const std::vector<float> centers = random_centers(rng, dim);
+    const size_t n = 5000;
+    const size_t n_queries = 100;
+    const size_t k = 10;
+    const std::vector<float> vecs = clustered_vectors(rng, centers, n, dim);
+    const std::vector<float> queries = clustered_vectors(rng, centers, n_queries, dim);
+    std::vector<int64_t> ids(n);
+    for (size_t i = 0; i < n; ++i) {
+        ids[i] = (int64_t)i;
+    }
+
+    rn_vector_index_params params;
+    params.dim = dim;
+    rn_vector_index flat(params);
+    flat.add(ids.data(), vecs.data(), n);
+
+    struct variant {
+        rn_vector_index_type type;
+        rn_vector_encoding encoding;
+        double min_recall;
+    };
+    const variant variants[] = {
+        { RN_VECTOR_INDEX_HNSW, RN_VECTOR_ENCODING_FLOAT32, 0.95 },
+        { RN_VECTOR_INDEX_FLAT, RN_VECTOR_ENCODING_INT8, 0.90 },
+        { RN_VECTOR_INDEX_HNSW, RN_VECTOR_ENCODING_INT8, 0.85 },
+        { RN_VECTOR_INDEX_FLAT, RN_VECTOR_ENCODING_BINARY, 0.40 },
+    };
+
+    for (const auto& v : variants) {
+        params.type = v.type;
+        params.encoding = v.encoding;
+        rn_vector_index index(params);
+        index.add(ids.data(), vecs.data(), n);
+
+        double total = 0.0;
+        for (size_t q = 0; q < n_queries; ++q) {
+            const float* query = &queries[q * dim];
+            total += recall(flat.search(query, k), index.search(query, k));
+        }
+        const double mean = total / n_queries;
+        std::printf("recall@%zu type %u encoding %u: %.3f\n", k, v.type, v.encoding, mean);
+        RN_CHECK(mean >= v.min_recall);
+    }
+}
+
+// Replacing and removing ids, in both index types
+static void test_update() {
+    std::mt19937 rng(3);
+    const size_t dim = 16;
+    const std::vector<float> centers = random_centers(rng, dim);
+    const size_t n = 300;
+
+    for (rn_vector_index_type type : { RN_VECTOR_INDEX_FLAT, RN_VECTOR_INDEX_HNSW }) {
+        rn_vector_index_params params;
+        params.type = type;
+        params.dim = dim;
+        rn_vector_index index(params);
+
+        const std::vector<float> vecs = clustered_vectors(rng, centers, n, dim);
+        std::vector<int64_t> ids(n);
+        for (size_t i = 0; i < n; ++i) {
+            ids[i] = (int64_t)i;
+        }
+        index.add(ids.data(), vecs.data(), n);
+
+        // Every vector finds itself
+        for (size_t i = 0; i < n; i += 7) {
+            const auto found = index.search(&vecs[i * dim], 1);
+            RN_CHECK(found.size() == 1 && found[0].id == (int64_t)i);
+        }
+
+        // Re-adding an id replaces its vector
+        const int64_t moved = 5;
+        index.add(&moved, &vecs[100 * dim], 1);
+        RN_CHECK(index.size() == n);
+        auto found = index.search(&vecs[100 * dim], 2);
+        const std::vector<int64_t> top = ids_of(found);
+        RN_CHECK(std::find(top.begin(), top.end(), moved) != top.end());
+        RN_CHECK(std::find(top.begin(), top.end(), 100) != top.end());
+
+        // Removed ids are not found; unknown ids are not counted
+        const int64_t removed[] = { 10, 20, 30, 12345 };
+        RN_CHECK(index.remove(removed, 4) == 3);
+        RN_CHECK(index.size() == n - 3);
+        for (int64_t id : { 10, 20, 30 }) {
+            for (const auto& match : index.search(&vecs[id * dim], 20)) {
+                RN_CHECK(match.id != id);
+            }
+        }
+
+        // Asking for more than there is returns every live vector
+        RN_CHECK(index.search(vecs.data(), n + 10, n + 10).size() == n - 3);
+    }
+
+    rn_vector_index_params params;
+    params.dim = dim;
+    rn_vector_index empty(params);
+    RN_CHECK(empty.search(std::vector<float>(dim, 1.0f).data(), 5).empty());
+}
+
+// A file-backed index reopens with its parameters and contents
+static void test_file() {
+    namespace fs = std::filesystem;
+    const fs::path path = fs::temp_directory_path() / "rn-test-vector-index.bin";
+    fs::remove(path);
+
+    std::mt19937 rng(4);
+    const size_t dim = 24;
+    const std::vector<float> centers = random_centers(rng, dim);
+    const size_t n = 1000;
+    const std::vector<float> vecs = clustered_vectors(rng, centers, n, dim);
+    std::vector<int64_t> ids(n);
+    for (size_t i = 0; i < n; ++i) {
+        ids[i] = 7 * (int64_t)i;
+    }
+    const std::vector<float> query = clustered_vectors(rng, centers, 1, dim);
+
+    std::vector<rn_vector_match> before;
+    {
+        rn_vector_index_params params;
+        params.type = RN_VECTOR_INDEX_HNSW;
+        params.metric = RN_VECTOR_METRIC_L2;
+        params.encoding = RN_VECTOR_ENCODING_INT8;
+        params.dim = dim;
+        rn_vector_index index(params, path.string());
+        index.add(ids.data(), vecs.data(), n);
+        const int64_t removed = 14;
+        index.remove(&removed, 1);
+        index.sync();
+        before = index.search(query.data(), 10);
+    }
+
+    {
+        // The stored parameters win over the requested ones
+        rn_vector_index_params params;
+        rn_vector_index index(params, path.string());
+        RN_CHECK(index.params().type == RN_VECTOR_INDEX_HNSW);
+        RN_CHECK(index.params().metric == RN_VECTOR_METRIC_L2);
+        RN_CHECK(index.params().encoding == RN_VECTOR_ENCODING_INT8);
+        RN_CHECK(index.params().dim == dim);
+        RN_CHECK(index.size() == n - 1);
+
+        const std::vector<rn_vector_match> after = index.search(query.data(), 10);
+        RN_CHECK(ids_of(after) == ids_of(before));
+    }
+
+    {
+        rn_vector_index_params params;
+        params.dim = dim + 1;
+        bool thrown = false;
+        try {
+            rn_vector_index index(params, path.string());
+        } catch (const std::runtime_error&) {
+            thrown = true;
+        }
+        RN_CHECK(thrown);
+    }
+
+    fs::remove(path);
+}
+
+int main() {
+    test_flat_exact();
+    test_recall();
+    test_update();
+    test_file();
+
+    std::printf("test-vector-index: OK\n");
+    return 0;
+}